@@ -419,6 +419,7 @@ time warp info and AudioIOListener and whether the playback is looped.
 #include "Experimental.h"
 
 #include "AudioIOListener.h"
+#include "TaskPool.h"
 
 #include "float_cast.h"
 #include "DeviceManager.h"
@@ -427,9 +428,17 @@ time warp info and AudioIOListener and whether the playback is looped.
 #include <math.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <chrono>
 
 #ifdef __WXMSW__
 #include <malloc.h>
+#include <wx/msw/wrapwin.h> // for semaphores
+#elif defined(__WXMAC__)
+#include <dispatch/dispatch.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#include <time.h>
 #endif
 
 #ifdef HAVE_ALLOCA_H
@@ -456,6 +465,7 @@ time warp info and AudioIOListener and whether the playback is looped.
 #endif
 
 #include "Mix.h"
+#include "MixKernels.h"
 #include "Resample.h"
 #include "RingBuffer.h"
 #include "prefs/GUISettings.h"
@@ -526,6 +536,18 @@ enum {
 
 constexpr size_t TimeQueueGrainSize = 2000;
 
+// When FillBuffers applies realtime effects, it keeps at least the minimum
+// lead ready for the callback, more if the effects are slow, but never more
+// than the maximum, so that changes of effect settings are heard soon.  It
+// fills in small batches, and calls the effects with blocks of at most
+// RealtimeEffectsBlockSize, which are allocated on the stack, and no more
+// than the block sizes of the effects allow.  The groups are processed one
+// at a time, because an effect shares its buffers among its processors.
+constexpr double RealtimeLeadMinSecs = 0.25;
+constexpr double RealtimeLeadMaxSecs = 2.0;
+constexpr double RealtimeLeadFillSecs = 0.05;
+constexpr size_t RealtimeEffectsBlockSize = 16384;
+
 #ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
 
 #ifdef __WXGTK__
@@ -901,6 +923,94 @@ class MidiThread final : public AudioThread {
 };
 #endif
 
+// Longest sleep of the audio thread between wakeups by the callback
+static constexpr unsigned AudioThreadTimeout_ms = 50;
+
+//////////////////////////////////////////////////////////////////////
+//
+//     WakeupSignal
+//
+//////////////////////////////////////////////////////////////////////
+
+// Semaphores that may be posted from real-time threads
+#ifdef __WXMSW__
+
+struct WakeupSignal::Semaphore {
+   // The count can't exceed one, so posts coalesce anyway
+   HANDLE handle{ CreateSemaphore( nullptr, 0, 1, nullptr ) };
+   ~Semaphore() { CloseHandle( handle ); }
+   void Post() { ReleaseSemaphore( handle, 1, nullptr ); }
+   bool WaitFor( std::chrono::milliseconds timeout )
+   {
+      return WAIT_OBJECT_0 ==
+         WaitForSingleObject( handle, (DWORD) timeout.count() );
+   }
+};
+
+#elif defined(__WXMAC__)
+
+struct WakeupSignal::Semaphore {
+   dispatch_semaphore_t semaphore{ dispatch_semaphore_create( 0 ) };
+   ~Semaphore() { dispatch_release( semaphore ); }
+   void Post() { dispatch_semaphore_signal( semaphore ); }
+   bool WaitFor( std::chrono::milliseconds timeout )
+   {
+      return 0 == dispatch_semaphore_wait( semaphore, dispatch_time(
+         DISPATCH_TIME_NOW,
+         std::chrono::nanoseconds( timeout ).count() ) );
+   }
+};
+
+#else
+
+struct WakeupSignal::Semaphore {
+   sem_t semaphore;
+   Semaphore() { sem_init( &semaphore, 0, 0 ); }
+   ~Semaphore() { sem_destroy( &semaphore ); }
+   // sem_post is even async-signal-safe
+   void Post() { sem_post( &semaphore ); }
+   bool WaitFor( std::chrono::milliseconds timeout )
+   {
+      timespec until;
+      clock_gettime( CLOCK_REALTIME, &until );
+      const auto ns = until.tv_nsec +
+         std::chrono::nanoseconds( timeout ).count();
+      until.tv_sec += ns / 1000000000;
+      until.tv_nsec = ns % 1000000000;
+      int rc;
+      while ( ( rc = sem_timedwait( &semaphore, &until ) ) != 0 &&
+              errno == EINTR )
+         ;
+      return rc == 0;
+   }
+};
+
+#endif
+
+WakeupSignal::WakeupSignal()
+   : mpSemaphore{ std::make_unique<Semaphore>() }
+{
+}
+
+WakeupSignal::~WakeupSignal() = default;
+
+void WakeupSignal::Signal()
+{
+   // Post only for the first signal since the waiter last woke
+   if ( !mPending.exchange( true, std::memory_order_acq_rel ) )
+      mpSemaphore->Post();
+}
+
+bool WakeupSignal::WaitFor( std::chrono::milliseconds timeout )
+{
+   const bool result = mpSemaphore->WaitFor( timeout );
+   // Signals from now on post again.  Any that came since the wakeup find
+   // the waiter awake, about to do their work.
+   if ( result )
+      mPending.store( false, std::memory_order_release );
+   return result;
+}
+
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -1077,6 +1187,8 @@ AudioIO::AudioIO()
 
 AudioIO::~AudioIO()
 {
+   StopCaptureWriter();
+
 #if defined(USE_PORTMIXER)
    if (mPortMixer) {
       #if __WXMAC__
@@ -1532,6 +1644,8 @@ int AudioIO::StartStream(const TransportTracks &tracks,
    gPrefs->Read(wxT("/AudioIO/SWPlaythrough"), &mSoftwarePlaythrough, false);
    gPrefs->Read(wxT("/AudioIO/SoundActivatedRecord"), &mPauseRec, false);
    gPrefs->Read(wxT("/AudioIO/Microfades"), &mbMicroFades, false);
+   gPrefs->Read(wxT("/AudioIO/RealtimeEffectsAhead"),
+      &mRealtimeEffectsAhead, false);
    int silenceLevelDB;
    gPrefs->Read(wxT("/AudioIO/SilenceLevel"), &silenceLevelDB, -50);
    int dBRange;
@@ -1590,7 +1704,9 @@ int AudioIO::StartStream(const TransportTracks &tracks,
    });
 
    mPlaybackBuffers.reset();
+   mPlaybackMixPool.reset();
    mPlaybackMixers.reset();
+   mPlaybackMixed.reset();
    mCaptureBuffers.reset();
    mResample.reset();
    mTimeQueue.mData.reset();
@@ -1680,9 +1796,11 @@ int AudioIO::StartStream(const TransportTracks &tracks,
       // group determination should mimic what is done in audacityAudioCallback()
       // when calling RealtimeProcess().
       int group = 0;
+      mPlaybackGroups.clear();
       for (size_t i = 0, cnt = mPlaybackTracks.size(); i < cnt;)
       {
          const WaveTrack *vt = mPlaybackTracks[i].get();
+         mPlaybackGroups.push_back(i);
 
          // TODO: more-than-two-channels
          unsigned chanCnt = TrackList::Channels(vt).size();
@@ -1735,18 +1853,22 @@ int AudioIO::StartStream(const TransportTracks &tracks,
       mScrubState.reset();
 #endif
 
+   if (mCaptureTracks.size() > 0)
+      StartCaptureWriter();
+
    // We signal the audio thread to call FillBuffers, to prime the RingBuffers
    // so that they will have data in them when the stream starts.  Having the
    // audio thread call FillBuffers here makes the code more predictable, since
    // FillBuffers will ALWAYS get called from the Audio thread.
-   mAudioThreadShouldCallFillBuffersOnce = true;
+   RequestFillBuffersOnce();
 
-   while( mAudioThreadShouldCallFillBuffersOnce ) {
+   while( true ) {
       auto interval = 50ull;
       if (options.playbackStreamPrimer) {
          interval = options.playbackStreamPrimer();
       }
-      wxMilliSleep( interval );
+      if ( WaitForFillBuffersOnce( std::chrono::milliseconds( interval ) ) )
+         break;
    }
 
    if(mNumPlaybackChannels > 0 || mNumCaptureChannels > 0) {
@@ -1864,6 +1986,13 @@ bool AudioIO::AllocateBuffers(
       playbackTime =
          lrint(options.pScrubbingOptions->delay * mRate) / mRate;
    
+   // Scrubbing can't wait for effects that run ahead
+   if (scrubbing)
+      mRealtimeEffectsAhead = false;
+   else if (mRealtimeEffectsAhead)
+      // Fill often and in small batches; GetRealtimeLead() limits how far
+      playbackTime = RealtimeLeadFillSecs;
+
    wxASSERT( playbackTime >= 0 );
    mPlaybackSamplesToCopy = playbackTime * mRate;
 
@@ -1891,6 +2020,7 @@ bool AudioIO::AllocateBuffers(
 
             mPlaybackBuffers.reinit(mPlaybackTracks.size());
             mPlaybackMixers.reinit(mPlaybackTracks.size());
+            mPlaybackMixed.reinit(mPlaybackTracks.size());
 
             const Mixer::WarpOptions &warpOptions =
 #ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
@@ -1910,9 +2040,18 @@ bool AudioIO::AllocateBuffers(
                // presses in the ruler)
                mPlaybackQueueMinimum = lrint(
                   2 * options.pScrubbingOptions->minStutterTime * mRate );
+            else if (mRealtimeEffectsAhead)
+               mPlaybackQueueMinimum = lrint( RealtimeLeadMinSecs * mRate );
             mPlaybackQueueMinimum =
                std::min( mPlaybackQueueMinimum, playbackBufferSize );
 
+            mRealtimeLeadMin = mPlaybackQueueMinimum;
+            mRealtimeLeadMax = 0;
+            if (mRealtimeEffectsAhead)
+               mRealtimeLeadMax = std::max( mRealtimeLeadMin, std::min(
+                  (size_t)lrint( RealtimeLeadMaxSecs * mRate ),
+                  playbackBufferSize ) );
+
             for (unsigned int i = 0; i < mPlaybackTracks.size(); i++)
             {
                // Bug 1763 - We must fade in from zero to avoid a click on starting.
@@ -1950,7 +2089,8 @@ bool AudioIO::AllocateBuffers(
                   mPlaybackSchedule.mT0,
                   endTime,
                   1,
-                  std::max( mPlaybackSamplesToCopy, mPlaybackQueueMinimum ),
+                  std::max( { mPlaybackSamplesToCopy, mPlaybackQueueMinimum,
+                     mRealtimeLeadMax } ),
                   false,
                   mRate, floatSample,
                   false, // low quality dithering and resampling
@@ -1958,6 +2098,18 @@ bool AudioIO::AllocateBuffers(
                   false // don't apply track gains
                );
             }
+
+            // The mixers are independent.  Let other threads share them with
+            // the audio thread, when there are enough of them for one core
+            // not to keep up with many tracks or much resampling.
+            const auto nThreads = std::max<size_t>(1, std::min<size_t>(
+               mPlaybackTracks.size(), std::thread::hardware_concurrency()));
+            mPlaybackMixPool.reset();
+            if (nThreads > 1)
+               mPlaybackMixPool = std::make_unique<TaskPool>(nThreads - 1);
+            for (auto &count : mMixTimingCounts)
+               count = 0;
+            mMixThreads = nThreads;
          }
 
          if( mNumCaptureChannels > 0 )
@@ -2023,8 +2175,12 @@ void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
       RealtimeEffectManager::Get().RealtimeFinalize();
    }
 
+   StopCaptureWriter();
+
    mPlaybackBuffers.reset();
+   mPlaybackMixPool.reset();
    mPlaybackMixers.reset();
+   mPlaybackMixed.reset();
    mCaptureBuffers.reset();
    mResample.reset();
    mTimeQueue.mData.reset();
@@ -2321,15 +2477,17 @@ void AudioIO::StopStream()
       // to the target WaveTrack.  To do this, we ask the audio thread to
       // call FillBuffers one last time (it normally would not do so since
       // Pa_GetStreamActive() would now return false
-      mAudioThreadShouldCallFillBuffersOnce = true;
+      RequestFillBuffersOnce();
 
-      while( mAudioThreadShouldCallFillBuffersOnce )
+      while( !WaitForFillBuffersOnce( std::chrono::milliseconds( 50 ) ) )
       {
          // LLL:  Experienced recursive yield here...once.
          wxTheApp->Yield(true); // Pass true for onlyIfNeeded to avoid recursive call error.
-         wxMilliSleep( 50 );
       }
 
+      // Wait for the capture writer thread to append everything to the tracks
+      StopCaptureWriter();
+
       //
       // Everything is taken care of.  Now, just free all the resources
       // we allocated in StartStream()
@@ -2337,8 +2495,11 @@ void AudioIO::StopStream()
 
       if (mPlaybackTracks.size() > 0)
       {
+         LogMixTimings();
          mPlaybackBuffers.reset();
+         mPlaybackMixPool.reset();
          mPlaybackMixers.reset();
+         mPlaybackMixed.reset();
          mTimeQueue.mData.reset();
       }
 
@@ -2617,11 +2778,23 @@ AudioThread::ExitCode AudioThread::Entry()
       }
       gAudioIO->mAudioThreadFillBuffersLoopActive = false;
 
+      // Tell threads waiting in WaitForFillBuffersOnce() or
+      // PauseAudioThread()
+      {
+         std::lock_guard<std::mutex> guard( gAudioIO->mAudioThreadMutex );
+      }
+      gAudioIO->mAudioThreadIdle.notify_all();
+
       if ( gAudioIO->mPlaybackSchedule.Interactive() )
+         // Scrubbing takes new work from the user interface, not the callback
          std::this_thread::sleep_until(
             loopPassStart + std::chrono::milliseconds( interval ) );
       else
-         Sleep(10);
+         // Sleep until the callback has made work for FillBuffers(), or
+         // another thread requests a pass.  The timeout allows for the end of
+         // play, when less than a whole batch remains, and for destruction.
+         gAudioIO->mAudioThreadWakeup.WaitFor(
+            std::chrono::milliseconds( AudioThreadTimeout_ms ) );
    }
 
    return 0;
@@ -2733,6 +2906,15 @@ void AudioIO::FillBuffers()
       auto nNeeded =
          mPlaybackQueueMinimum - std::min(mPlaybackQueueMinimum, nReady);
 
+      if (mRealtimeEffectsAhead)
+      {
+         // Don't run farther ahead of the callback than the effects need,
+         // so that changes of their settings are heard soon
+         const auto lead = GetRealtimeLead();
+         nNeeded = lead - std::min(lead, nReady);
+         nAvailable = std::min(nAvailable, nNeeded);
+      }
+
       // wxASSERT( nNeeded <= nAvailable );
 
       auto realTimeRemaining = mPlaybackSchedule.RealTimeRemaining();
@@ -2798,18 +2980,22 @@ void AudioIO::FillBuffers()
                (mPlaybackSchedule.Interactive() ? mScrubSpeed : 1.0),
                frames);
 
+            // The mixers here aren't actually mixing: they're just doing
+            // resampling, format conversion, and possibly time track
+            // warping.  All finish before any ring buffer gets samples.
+            if (frames > 0) {
+               ProcessPlaybackMixers( toProcess );
+               if (mRealtimeEffectsAhead)
+                  ProcessRealtimeEffects( frames );
+            }
+
             for (i = 0; i < mPlaybackTracks.size(); i++)
             {
-               // The mixer here isn't actually mixing: it's just doing
-               // resampling, format conversion, and possibly time track
-               // warping
                samplePtr warpedSamples;
 
                if (frames > 0)
                {
-                  size_t processed = 0;
-                  if ( toProcess )
-                     processed = mPlaybackMixers[i]->Process( toProcess );
+                  const auto processed = mPlaybackMixed[i];
                   //wxASSERT(processed <= toProcess);
                   warpedSamples = mPlaybackMixers[i]->GetBuffer();
                   const auto put = mPlaybackBuffers[i]->Put(
@@ -2913,16 +3099,22 @@ void AudioIO::FillBuffers()
          if (mAudioThreadShouldCallFillBuffersOnce ||
              deltat >= mMinCaptureSecsToCopy)
          {
-            // This scope may combine many appendings of wave tracks,
-            // and also an autosave, into one transaction,
-            // lessening the number of checkpoints
-            Optional<TransactionScope> pScope;
-            if (mOwningProject) {
-               auto &pIO = ProjectFileIO::Get(*mOwningProject);
-               pScope.emplace(pIO.GetConnection(), "Recording");
+            // If the capture writer thread has fallen behind, leave the
+            // samples in the ring buffers for now -- unless this is the last
+            // pass, which must wait for room
+            if (mCaptureQueue.Full()) {
+               if (!mAudioThreadShouldCallFillBuffersOnce) {
+                  ++mCaptureBackpressure;
+                  return;
+               }
+               while (mCaptureQueue.Full() &&
+                      mCaptureWriterThread.joinable())
+                  std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
 
-            bool newBlocks = false;
+            // Appending to the wave tracks, and the autosave that follows,
+            // happen in the capture writer thread
+            auto pWork = std::make_unique<CaptureWork>();
 
             // Append captured samples to the end of the WaveTracks.
             // The WaveTracks have their own buffering for efficiency.
@@ -2941,9 +3133,11 @@ void AudioIO::FillBuffers()
                      // Once only (per track per recording), insert some initial
                      // silence.
                      size_t size = floor( correction * mRate * mFactor);
-                     SampleBuffer temp(size, trackFormat);
-                     ClearSamples(temp.ptr(), trackFormat, 0, size);
-                     mCaptureTracks[i]->Append(temp.ptr(), trackFormat, size, 1);
+                     auto pTemp =
+                        std::make_unique<SampleBuffer>(size, trackFormat);
+                     ClearSamples(pTemp->ptr(), trackFormat, 0, size);
+                     pWork->appends.push_back(
+                        { i, std::move(pTemp), trackFormat, size });
                   }
                   else {
                      // Leftward shift
@@ -2980,7 +3174,8 @@ void AudioIO::FillBuffers()
 
                wxASSERT(discarded <= avail);
                size_t toGet = avail - discarded;
-               SampleBuffer temp;
+               auto pTemp = std::make_unique<SampleBuffer>();
+               auto &temp = *pTemp;
                size_t size;
                sampleFormat format;
                if( mFactor == 1.0 )
@@ -3043,22 +3238,17 @@ void AudioIO::FillBuffers()
                   }
                }
 
-               // Now append
-               // see comment in second handler about guarantee
-               newBlocks = mCaptureTracks[i]->Append(temp.ptr(), format, size, 1)
-                  || newBlocks;
+               // Now queue for appending
+               pWork->appends.push_back({ i, std::move(pTemp), format, size });
             } // end loop over capture channels
 
             // Now update the recording schedule position
             mRecordingSchedule.mPosition += avail / mRate;
             mRecordingSchedule.mLatencyCorrected = latencyCorrected;
 
-            auto pListener = GetListener();
-            if (pListener && newBlocks)
-               pListener->OnAudioIONewBlocks(&mCaptureTracks);
-
-            if (pScope)
-               pScope->Commit();
+            // There is room, checked above, and this is the only producer
+            mCaptureQueue.Push(std::move(pWork));
+            mCaptureWriterCondition.notify_one();
          }
          // end of record buffering
       },
@@ -3078,6 +3268,227 @@ void AudioIO::FillBuffers()
    );
 }
 
+void AudioIO::ProcessPlaybackMixers(size_t toProcess)
+{
+   const auto nTracks = mPlaybackTracks.size();
+   if (toProcess == 0) {
+      std::fill(mPlaybackMixed.get(), mPlaybackMixed.get() + nTracks, 0);
+      return;
+   }
+
+   const auto start = std::chrono::steady_clock::now();
+
+   const auto process = [&](size_t ii) {
+      mPlaybackMixed[ii] = mPlaybackMixers[ii]->Process( toProcess );
+   };
+   if (mPlaybackMixPool)
+      mPlaybackMixPool->Run(nTracks, process);
+   else
+      for (size_t ii = 0; ii < nTracks; ++ii)
+         process(ii);
+
+   const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+   size_t bucket = 0;
+   while (bucket + 1 < MixTimings::nBuckets && (micros >> (bucket + 1)) > 0)
+      ++bucket;
+   mMixTimingCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioIO::ProcessRealtimeEffects(size_t len)
+{
+   auto &em = RealtimeEffectManager::Get();
+   em.RealtimeProcessStart();
+   auto cleanup = finally([&]{ em.RealtimeProcessEnd(); });
+
+   auto blockSize = RealtimeEffectsBlockSize;
+   if (const auto effectsBlockSize = em.GetRealtimeBlockSize())
+      blockSize = std::min(blockSize, effectsBlockSize);
+
+   const auto nTracks = mPlaybackTracks.size();
+   const auto nGroups = mPlaybackGroups.size();
+   const auto process = [&](size_t group) {
+      const auto first = mPlaybackGroups[group];
+      const auto end =
+         group + 1 < nGroups ? mPlaybackGroups[group + 1] : nTracks;
+
+      // Pad short output of the mixers with silence here, not in Put, so
+      // that the effects see all of it
+      // TODO: more-than-two-channels
+      float *buffers[2];
+      unsigned chanCnt = 0;
+      for (auto t = first; t < end; ++t) {
+         auto buffer = (float *) mPlaybackMixers[t]->GetBuffer();
+         std::fill(buffer + mPlaybackMixed[t], buffer + len, 0.0f);
+         mPlaybackMixed[t] = len;
+         if (chanCnt < 2)
+            buffers[chanCnt++] = buffer;
+      }
+
+      // As in FillOutputBuffers, effects apply only to selected tracks.
+      // But they apply to muted tracks too, which may be unmuted before the
+      // callback plays these samples.
+      if (!mPlaybackTracks[first]->GetSelected())
+         return;
+
+      float *blockBuffers[2];
+      for (size_t start = 0; start < len; start += blockSize) {
+         const auto block = std::min(len - start, blockSize);
+         for (unsigned c = 0; c < chanCnt; ++c)
+            blockBuffers[c] = buffers[c] + start;
+         em.RealtimeProcess(group, chanCnt, blockBuffers, block);
+      }
+   };
+   for (size_t group = 0; group < nGroups; ++group)
+      process(group);
+}
+
+size_t AudioIO::GetRealtimeLead() const
+{
+   // Stay ahead by the minimum, plus twice the time the effects may take to
+   // process the next batch, estimated from the latency of the last call
+   // for one group, for each of the groups in turn
+   const auto nGroups = mPlaybackGroups.size();
+   const auto latency =
+      RealtimeEffectManager::Get().GetRealtimeLatency() / 1000.0;
+   const auto lead =
+      mRealtimeLeadMin + (size_t)lrint(2 * nGroups * latency * mRate);
+   return std::min(lead, mRealtimeLeadMax);
+}
+
+auto AudioIO::GetMixTimings() const -> MixTimings
+{
+   MixTimings result;
+   for (size_t ii = 0; ii < MixTimings::nBuckets; ++ii)
+      result.counts[ii] = mMixTimingCounts[ii].load(std::memory_order_relaxed);
+   result.nThreads = mMixThreads;
+   return result;
+}
+
+void AudioIO::LogMixTimings() const
+{
+   const auto timings = GetMixTimings();
+   wxString histogram;
+   for (size_t ii = 0; ii < MixTimings::nBuckets; ++ii)
+      if (timings.counts[ii] > 0)
+         histogram += wxString::Format(wxT(" %llu us: %llu;"),
+            1ull << ii, timings.counts[ii]);
+   wxLogDebug(wxT("Playback mixing on %lu threads, passes by time:%s"),
+      (unsigned long) timings.nThreads, histogram);
+}
+
+void AudioIO::StartCaptureWriter()
+{
+   wxASSERT(!mCaptureWriterThread.joinable());
+
+   mCaptureWriterStop = false;
+   mCaptureBackpressure = 0;
+   mCaptureWriterThread = std::thread([this]{ CaptureWriterThread(); });
+}
+
+void AudioIO::StopCaptureWriter()
+{
+   if (!mCaptureWriterThread.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> guard(mCaptureWriterMutex);
+      mCaptureWriterStop = true;
+      mCaptureWriterCondition.notify_one();
+   }
+
+   // The thread writes everything queued before it exits
+   mCaptureWriterThread.join();
+
+   if (mCaptureBackpressure > 0)
+      wxLogMessage(wxT("Capture writer fell behind; %llu passes were deferred"),
+         mCaptureBackpressure.load());
+}
+
+void AudioIO::CaptureWriterThread()
+{
+   while (true)
+   {
+      bool stop;
+      {
+         std::unique_lock<std::mutex> lock(mCaptureWriterMutex);
+         // The audio thread notifies without taking the lock, so a wakeup
+         // might be missed; don't wait indefinitely
+         mCaptureWriterCondition.wait_for(lock,
+            std::chrono::milliseconds(50),
+            [this]{ return mCaptureWriterStop || !mCaptureQueue.Empty(); });
+         stop = mCaptureWriterStop;
+      }
+
+      // Drain the queue even when stopping, so that the last pass of
+      // FillBuffers() is written
+      WriteCapture();
+
+      if (stop)
+         break;
+   }
+}
+
+void AudioIO::WriteCapture()
+{
+   if (mCaptureQueue.Empty())
+      return;
+
+   auto delayedHandler = [this] ( AudacityException * pException ) {
+      // In the main thread, stop recording, as for failures in FillBuffers()
+      StopStream();
+      DefaultDelayedHandlerAction{}( pException );
+   };
+
+   GuardedCall( [&] {
+      // This scope may combine many appendings of wave tracks,
+      // and also an autosave, into one transaction,
+      // lessening the number of checkpoints
+      Optional<TransactionScope> pScope;
+      if (mOwningProject) {
+         auto &pIO = ProjectFileIO::Get(*mOwningProject);
+         pScope.emplace(pIO.GetConnection(), "Recording");
+      }
+
+      bool newBlocks = false;
+
+      CaptureWorkPtr pWork;
+      while (mCaptureQueue.Pop(pWork)) {
+         // After a failure, discard what remains; the main thread is
+         // stopping the stream
+         if (mRecordingException)
+            continue;
+
+         for (auto &append : pWork->appends)
+            // see comment in second handler about guarantee
+            newBlocks = mCaptureTracks[append.channel]->Append(
+               append.pBuffer->ptr(), append.format, append.len, 1)
+               || newBlocks;
+      }
+
+      auto pListener = GetListener();
+      if (pListener && newBlocks)
+         pListener->OnAudioIONewBlocks(&mCaptureTracks);
+
+      if (pScope)
+         pScope->Commit();
+   },
+      // handler
+      [this] ( AudacityException *pException ) {
+         if ( pException ) {
+            // So that we don't attempt to append again
+            // before the main thread stops recording
+            SetRecordingException();
+            return ;
+         }
+         else
+            // Don't want to intercept other exceptions (?)
+            throw;
+      },
+      delayedHandler
+   );
+}
+
 void AudioIoCallback::SetListener(
    const std::shared_ptr< AudioIOListener > &listener)
 {
@@ -3775,9 +4186,8 @@ void AudioIoCallback::AddToOutputChannel( unsigned int chan,
    // Output volume emulation: possibly copy meter samples, then
    // apply volume, then copy to the output buffer
    if (outputMeterFloats != outputFloats)
-      for ( unsigned i = 0; i < len; ++i)
-         outputMeterFloats[numPlaybackChannels*i+chan] +=
-            gain*tempBuf[i];
+      MixKernels::ScaleAccumulate(outputMeterFloats + chan,
+         numPlaybackChannels, tempBuf, len, gain);
 
    if (mEmulateMixerOutputVol)
       gain *= mMixerOutputVol;
@@ -3792,14 +4202,13 @@ void AudioIoCallback::AddToOutputChannel( unsigned int chan,
 
    // Linear interpolate.
    float deltaGain = (gain - oldGain) / len;
-   for (unsigned i = 0; i < len; i++)
-      outputFloats[numPlaybackChannels*i+chan] += (oldGain + deltaGain * i) *tempBuf[i];
+   MixKernels::RampAccumulate(outputFloats + chan, numPlaybackChannels,
+      tempBuf, len, oldGain, deltaGain);
 };
 
 // Limit values to -1.0..+1.0
 void ClampBuffer(float * pBuffer, unsigned long len){
-   for(unsigned i = 0; i < len; i++)
-      pBuffer[i] = wxClip( pBuffer[i], -1.0f, 1.0f);
+   MixKernels::Clamp(pBuffer, len);
 };
 
 
@@ -3849,8 +4258,11 @@ bool AudioIoCallback::FillOutputBuffers(
       tempBufs[c] = (float *) alloca(framesPerBuffer * sizeof(float));
    // ------ End of MEMORY ALLOCATION ---------------
 
+   // When FillBuffers has applied the realtime effects, only sum here
+   const bool applyEffects = !mRealtimeEffectsAhead;
    auto & em = RealtimeEffectManager::Get();
-   em.RealtimeProcessStart();
+   if (applyEffects)
+      em.RealtimeProcessStart();
 
    bool selected = false;
    int group = 0;
@@ -3947,7 +4359,7 @@ bool AudioIoCallback::FillOutputBuffers(
       // Last channel of a track seen now
       len = mMaxFramesOutput;
 
-      if( !dropQuickly && selected )
+      if( applyEffects && !dropQuickly && selected )
          len = em.RealtimeProcess(group, chanCnt, tempBufs, len);
       group++;
 
@@ -3991,7 +4403,8 @@ bool AudioIoCallback::FillOutputBuffers(
 
    // wxASSERT( maxLen == toGet );
 
-   em.RealtimeProcessEnd();
+   if (applyEffects)
+      em.RealtimeProcessEnd();
    mLastPlaybackTimeMillis = ::wxGetUTCTimeMillis();
 
    ClampBuffer( outputFloats, framesPerBuffer*numPlaybackChannels );
@@ -4108,9 +4521,8 @@ void AudioIoCallback::FillInputBuffers(
       switch(mCaptureFormat) {
          case floatSample: {
             float *inputFloats = (float *)inputBuffer;
-            for(unsigned i = 0; i < len; i++)
-               tempFloats[i] =
-                  inputFloats[numCaptureChannels*i+t];
+            MixKernels::Deinterleave(tempFloats,
+               inputFloats + t, numCaptureChannels, len);
          } break;
          case int24Sample:
             // We should never get here. Audacity's int24Sample format
@@ -4362,6 +4774,11 @@ int AudioIoCallback::AudioCallback(const void *inputBuffer, void *outputBuffer,
                           const PaStreamCallbackTimeInfo *timeInfo,
                           const PaStreamCallbackFlags statusFlags, void * WXUNUSED(userData) )
 {
+#if defined(EXPERIMENTAL_REALTIME_ALLOCATION_CHECK)
+   // Covers everything until the callback returns
+   RealtimeAllocationCheck allocationCheck;
+#endif
+
    mbHasSoloTracks = CountSoloingTracks() > 0 ;
    mCallbackReturn = paContinue;
 
@@ -4459,11 +4876,73 @@ int AudioIoCallback::AudioCallback(const void *inputBuffer, void *outputBuffer,
       statusFlags,
       tempFloats);
 
+   WakeAudioThreadIfNeeded();
+
    SendVuOutputMeterData( outputMeterFloats, framesPerBuffer);
 
    return mCallbackReturn;
 }
 
+void AudioIoCallback::WakeAudioThreadIfNeeded()
+{
+   if (!mAudioThreadFillBuffersLoopRunning)
+      return;
+
+   // The same thresholds as in FillBuffers()
+   bool wake = false;
+   if (mPlaybackBuffers && !mPlaybackTracks.empty()) {
+      if (mRealtimeEffectsAhead) {
+         // The ring buffers are mostly empty, but FillBuffers keeps only a
+         // short lead; wake it when the lead falls below the least, and
+         // otherwise let it time out
+         auto commonlyReady = mPlaybackBuffers[0]->AvailForGet();
+         for (size_t i = 1; i < mPlaybackTracks.size(); ++i)
+            commonlyReady = std::min(commonlyReady,
+               mPlaybackBuffers[i]->AvailForGet());
+         wake = (commonlyReady + mPlaybackSamplesToCopy <= mRealtimeLeadMin);
+      }
+      else {
+         auto commonlyFree = mPlaybackBuffers[0]->AvailForPut();
+         for (size_t i = 1; i < mPlaybackTracks.size(); ++i)
+            commonlyFree = std::min(commonlyFree,
+               mPlaybackBuffers[i]->AvailForPut());
+         wake = (commonlyFree >= mPlaybackSamplesToCopy);
+      }
+   }
+   if (!wake && mCaptureBuffers && !mCaptureTracks.empty()) {
+      auto commonlyAvail = mCaptureBuffers[0]->AvailForGet();
+      for (size_t i = 1; i < mCaptureTracks.size(); ++i)
+         commonlyAvail = std::min(commonlyAvail,
+            mCaptureBuffers[i]->AvailForGet());
+      wake = (commonlyAvail >= mMinCaptureSecsToCopy * mRate);
+   }
+
+   if (wake)
+      mAudioThreadWakeup.Signal();
+}
+
+void AudioIoCallback::RequestFillBuffersOnce()
+{
+   mAudioThreadShouldCallFillBuffersOnce = true;
+   mAudioThreadWakeup.Signal();
+}
+
+bool AudioIoCallback::WaitForFillBuffersOnce(
+   std::chrono::milliseconds timeout )
+{
+   std::unique_lock<std::mutex> lock( mAudioThreadMutex );
+   return mAudioThreadIdle.wait_for( lock, timeout,
+      [this]{ return !mAudioThreadShouldCallFillBuffersOnce; } );
+}
+
+void AudioIoCallback::PauseAudioThread()
+{
+   mAudioThreadFillBuffersLoopRunning = false;
+   std::unique_lock<std::mutex> lock( mAudioThreadMutex );
+   mAudioThreadIdle.wait( lock,
+      [this]{ return !mAudioThreadFillBuffersLoopActive; } );
+}
+
 int AudioIoCallback::CallbackDoSeek()
 {
    const int token = mStreamToken;
@@ -4475,11 +4954,7 @@ int AudioIoCallback::CallbackDoSeek()
    const auto numPlaybackTracks = mPlaybackTracks.size();
 
    // Pause audio thread and wait for it to finish
-   mAudioThreadFillBuffersLoopRunning = false;
-   while( mAudioThreadFillBuffersLoopActive )
-   {
-      wxMilliSleep( 50 );
-   }
+   PauseAudioThread();
 
    // Calculate the NEW time position, in the PortAudio callback
    const auto time = mPlaybackSchedule.ClampTrackTime(
@@ -4504,11 +4979,9 @@ int AudioIoCallback::CallbackDoSeek()
    }
 
    // Reload the ring buffers
-   mAudioThreadShouldCallFillBuffersOnce = true;
-   while( mAudioThreadShouldCallFillBuffersOnce )
-   {
-      wxMilliSleep( 50 );
-   }
+   RequestFillBuffersOnce();
+   while( !WaitForFillBuffersOnce( std::chrono::milliseconds( 50 ) ) )
+      ;
 
    // Reenable the audio thread
    mAudioThreadFillBuffersLoopRunning = true;
@@ -19,8 +19,15 @@
 
 #include "Experimental.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <utility>
+#include <vector>
 #include <wx/atomic.h> // member variable
 
 #ifdef USE_MIDI
@@ -54,6 +61,7 @@ class RingBuffer;
 class Mixer;
 class Resample;
 class AudioThread;
+class TaskPool;
 class SelectedRegion;
 
 class AudacityProject;
@@ -234,6 +242,78 @@ void MessageBuffer<Data>::Write( Data &&data )
    mSlots[idx].mBusy.store( false, std::memory_order_release );
 }
 
+// Bounded queue for one producer thread and one consumer thread, which
+// neither locks nor allocates.  Data are moved in and out.
+template<typename Data, size_t Capacity>
+class LockFreeQueue {
+   // One slot always stays empty, to distinguish full from empty
+   Data mSlots[Capacity + 1];
+
+   alignas( 64 ) std::atomic<size_t> mHead{ 0 }; // written by consumer
+   alignas( 64 ) std::atomic<size_t> mTail{ 0 }; // written by producer
+
+   static size_t Next( size_t index ) { return (index + 1) % (Capacity + 1); }
+
+public:
+   // Producer only; returns false if full, leaving data unmoved
+   bool Push( Data &&data );
+   // Consumer only; returns false if empty
+   bool Pop( Data &data );
+
+   // Either thread may ask, but the answer may be stale
+   bool Empty() const
+   { return mHead.load( std::memory_order_acquire ) ==
+      mTail.load( std::memory_order_acquire ); }
+   bool Full() const
+   { return Next( mTail.load( std::memory_order_acquire ) ) ==
+      mHead.load( std::memory_order_acquire ); }
+};
+
+template<typename Data, size_t Capacity>
+bool LockFreeQueue<Data, Capacity>::Push( Data &&data )
+{
+   const auto tail = mTail.load( std::memory_order_relaxed );
+   const auto next = Next( tail );
+   if ( next == mHead.load( std::memory_order_acquire ) )
+      return false;
+   mSlots[tail] = std::move( data );
+   mTail.store( next, std::memory_order_release );
+   return true;
+}
+
+template<typename Data, size_t Capacity>
+bool LockFreeQueue<Data, Capacity>::Pop( Data &data )
+{
+   const auto head = mHead.load( std::memory_order_relaxed );
+   if ( head == mTail.load( std::memory_order_acquire ) )
+      return false;
+   data = std::move( mSlots[head] );
+   mHead.store( Next( head ), std::memory_order_release );
+   return true;
+}
+
+// Wakes a thread waiting in WaitFor(), from any other thread, even the
+// PortAudio callback:  Signal() neither locks nor allocates, but posts to a
+// semaphore of the operating system.  Signals coalesce until the waiter
+// wakes.
+class WakeupSignal {
+public:
+   WakeupSignal();
+   ~WakeupSignal();
+
+   WakeupSignal( const WakeupSignal& ) = delete;
+   WakeupSignal &operator=( const WakeupSignal& ) = delete;
+
+   void Signal();
+   // For one thread only; returns false if the timeout passed first
+   bool WaitFor( std::chrono::milliseconds timeout );
+
+private:
+   struct Semaphore;
+   std::unique_ptr<Semaphore> mpSemaphore;
+   std::atomic<bool> mPending{ false };
+};
+
 class AUDACITY_DLL_API AudioIoCallback /* not final */
    : public AudioIOBase
 {
@@ -464,6 +544,20 @@ public:
    WaveTrackArray      mPlaybackTracks;
 
    ArrayOf<std::unique_ptr<Mixer>> mPlaybackMixers;
+   //! Counts of samples that the mixers produced in the last pass
+   ArrayOf<size_t>     mPlaybackMixed;
+   //! Threads that share the mixers with the audio thread; null if only
+   //! the audio thread runs them
+   std::unique_ptr<TaskPool> mPlaybackMixPool;
+   //! Whether FillBuffers applies the realtime effects to the output of the
+   //! mixers, so that the callback only sums processed samples
+   bool                mRealtimeEffectsAhead{ false };
+   //! Index of the first playback track of each realtime effect group
+   std::vector<size_t> mPlaybackGroups;
+   //! Least and greatest numbers of samples that FillBuffers keeps ready
+   //! when it applies realtime effects
+   size_t              mRealtimeLeadMin{ 0 };
+   size_t              mRealtimeLeadMax{ 0 };
    static int          mNextStreamToken;
    double              mFactor;
    unsigned long       mMaxFramesOutput; // The actual number of frames output.
@@ -487,9 +581,28 @@ public:
    unsigned int        mNumPlaybackChannels;
    sampleFormat        mCaptureFormat;
    unsigned long long  mLostSamples{ 0 };
-   volatile bool       mAudioThreadShouldCallFillBuffersOnce;
-   volatile bool       mAudioThreadFillBuffersLoopRunning;
-   volatile bool       mAudioThreadFillBuffersLoopActive;
+   std::atomic<bool>   mAudioThreadShouldCallFillBuffersOnce;
+   std::atomic<bool>   mAudioThreadFillBuffersLoopRunning;
+   std::atomic<bool>   mAudioThreadFillBuffersLoopActive;
+
+   //! Wakes the audio thread when the ring buffers need it, or for requests
+   WakeupSignal        mAudioThreadWakeup;
+   //! Signalled, under mAudioThreadMutex, when the audio thread leaves
+   //! FillBuffers()
+   std::mutex          mAudioThreadMutex;
+   std::condition_variable mAudioThreadIdle;
+
+   //! Wake the audio thread if the callback has made room in the playback
+   //! ring buffers, or put samples in the capture ring buffers, for a pass
+   //! of FillBuffers() to do its work
+   void WakeAudioThreadIfNeeded();
+   //! Ask the audio thread for one pass of FillBuffers() as soon as it can
+   void RequestFillBuffersOnce();
+   //! Wait until the requested pass finishes, or the timeout passes;
+   //! return whether it finished
+   bool WaitForFillBuffersOnce( std::chrono::milliseconds timeout );
+   //! Stop passes of FillBuffers(), and wait until none is in progress
+   void PauseAudioThread();
 
    wxLongLong          mLastPlaybackTimeMillis;
 
@@ -690,6 +803,20 @@ public:
    // Meaning really capturing, not just pre-rolling
    bool IsCapturing() const;
 
+   //! Distribution of the times that passes of the audio thread took to run
+   //! the mixers of the playback tracks
+   struct MixTimings {
+      //! Bucket k counts passes that took at least 2^k microseconds and less
+      //! than twice that; the first also counts quicker passes, and the last
+      //! slower ones
+      static constexpr size_t nBuckets = 20;
+      std::array<unsigned long long, nBuckets> counts{};
+      //! Threads that shared the mixers, counting the audio thread
+      size_t nThreads{ 0 };
+   };
+   //! Timings of the current stream, or else of the last one
+   MixTimings GetMixTimings() const;
+
    /** \brief Ensure selected device names are valid
     *
     */
@@ -779,10 +906,56 @@ private:
       const TransportTracks &tracks, double t0, double t1, double sampleRate,
       bool scrubbing );
 
+   //! Run the mixers of all playback tracks, on the threads of
+   //! mPlaybackMixPool if there is one, filling mPlaybackMixed
+   void ProcessPlaybackMixers(size_t toProcess);
+   //! Apply realtime effects to len samples of output of the mixers, one
+   //! group after another, if mRealtimeEffectsAhead
+   void ProcessRealtimeEffects(size_t len);
+   //! How many samples FillBuffers keeps ready when it applies realtime
+   //! effects:  enough to cover the time that the effects take
+   size_t GetRealtimeLead() const;
+   void LogMixTimings() const;
+
    /** \brief Clean up after StartStream if it fails.
      *
      * If bOnlyBuffers is specified, it only cleans up the buffers. */
    void StartStreamCleanup(bool bOnlyBuffers = false);
+
+   /** \brief Samples taken from the capture ring buffers by one pass of
+    * FillBuffers(), to be appended to the capture tracks by the capture
+    * writer thread, so that database writes never stall the audio thread */
+   struct CaptureWork {
+      struct Append {
+         size_t channel;
+         std::unique_ptr<SampleBuffer> pBuffer;
+         sampleFormat format;
+         size_t len;
+      };
+      std::vector<Append> appends;
+   };
+   using CaptureWorkPtr = std::unique_ptr<CaptureWork>;
+
+   void StartCaptureWriter();
+   //! Waits for all queued work to be written
+   void StopCaptureWriter();
+   void CaptureWriterThread();
+   //! Appends all queued work to the tracks, in one transaction
+   void WriteCapture();
+
+   // Enough passes of FillBuffers() to absorb many seconds of disk latency;
+   // when it is full, FillBuffers() leaves samples in the ring buffers
+   LockFreeQueue<CaptureWorkPtr, 256> mCaptureQueue;
+   std::thread mCaptureWriterThread;
+   std::mutex mCaptureWriterMutex;
+   std::condition_variable mCaptureWriterCondition;
+   std::atomic<bool> mCaptureWriterStop{ false };
+   //! Count of passes of FillBuffers() deferred because the queue was full
+   std::atomic<unsigned long long> mCaptureBackpressure{ 0 };
+
+   std::array<std::atomic<unsigned long long>, MixTimings::nBuckets>
+      mMixTimingCounts{};
+   std::atomic<size_t> mMixThreads{ 0 };
 };
 
 static constexpr unsigned ScrubPollInterval_ms = 50;
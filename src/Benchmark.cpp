@@ -18,6 +18,11 @@ of sample block storage.
 #include "Audacity.h"
 #include "Benchmark.h"
 
+#include <cmath>
+#include <cfloat>
+#include <functional>
+#include <thread>
+
 #include <wx/app.h>
 #include <wx/log.h>
 #include <wx/textctrl.h>
@@ -33,25 +38,60 @@ of sample block storage.
 #include <wx/valtext.h>
 #include <wx/intl.h>
 
+#include "Mix.h"
+#include "MixKernels.h"
 #include "SampleBlock.h"
+#include "SampleBlockCodec.h"
+#include "SampleStatistics.h"
 #include "ShuttleGui.h"
+#include "TaskPool.h"
 #include "Project.h"
 #include "WaveClip.h"
 #include "WaveTrack.h"
 #include "Sequence.h"
 #include "Prefs.h"
+#include "ProjectSerializer.h"
 #include "ProjectSettings.h"
 #include "ViewInfo.h"
 
 #include "FileNames.h"
 #include "widgets/AudacityMessageBox.h"
 #include "widgets/wxPanelWrapper.h"
+#include "xml/XMLFileReader.h"
 
 // Change these to the desired format...should probably make the
 // choice available in the dialog
 #define SampleType short
 #define SampleFormat int16Sample
 
+namespace {
+
+//! Accepts any document, counting what it sees, so that the loading of
+//! project documents can be timed without building a project
+struct CountingHandler final : XMLTagHandler
+{
+   bool HandleXMLTag(const wxChar *, const wxChar **attrs) override
+   {
+      ++tags;
+      for (; *attrs; attrs += 2) {
+         ++attributes;
+         valueLength += wxStrlen(attrs[1]);
+      }
+      return true;
+   }
+
+   XMLTagHandler *HandleXMLChild(const wxChar *) override
+   {
+      return this;
+   }
+
+   size_t tags{ 0 };
+   size_t attributes{ 0 };
+   size_t valueLength{ 0 };
+};
+
+}
+
 class BenchmarkDialog final : public wxDialogWrapper
 {
 public:
@@ -63,10 +103,28 @@ public:
 private:
    // WDR: handler declarations
    void OnRun( wxCommandEvent &event );
+   // Timings of parts of storage, loading, editing and playback
+   void OnRandomReads( wxCommandEvent &event );
+   void OnCompression( wxCommandEvent &event );
+   void OnLoading( wxCommandEvent &event );
+   void OnBlockIndex( wxCommandEvent &event );
+   void OnStatistics( wxCommandEvent &event );
+   void OnAppending( wxCommandEvent &event );
+   void OnMixing( wxCommandEvent &event );
+   void OnMixKernels( wxCommandEvent &event );
    void OnSave( wxCommandEvent &event );
    void OnClear( wxCommandEvent &event );
    void OnClose( wxCommandEvent &event );
 
+   //! Check the settings, telling the user if they are out of range
+   bool GetSettings(
+      long &blockSize, long &numEdits, long &dataSize, long &randSeed);
+   //! Run a timing with the block size and random seed of the settings
+   void Time( const std::function< void( long blockSize, long dataSize ) >
+      &timing );
+   //! A track of random samples of the test data size
+   std::shared_ptr<WaveTrack> MakeTrack( long dataSize );
+
    void Printf(const TranslatableString &str);
    void HoldPrint(bool hold);
    void FlushPrint();
@@ -120,6 +178,14 @@ XO("This will close all project windows (without saving)\nand open the Audacity
 
 enum {
    RunID = 1000,
+   RandomReadsID,
+   CompressionID,
+   LoadingID,
+   BlockIndexID,
+   StatisticsID,
+   AppendingID,
+   MixingID,
+   MixKernelsID,
    BSaveID,
    ClearID,
    StaticTextID,
@@ -131,6 +197,14 @@ enum {
 
 BEGIN_EVENT_TABLE(BenchmarkDialog, wxDialogWrapper)
    EVT_BUTTON( RunID,   BenchmarkDialog::OnRun )
+   EVT_BUTTON( RandomReadsID, BenchmarkDialog::OnRandomReads )
+   EVT_BUTTON( CompressionID, BenchmarkDialog::OnCompression )
+   EVT_BUTTON( LoadingID, BenchmarkDialog::OnLoading )
+   EVT_BUTTON( BlockIndexID, BenchmarkDialog::OnBlockIndex )
+   EVT_BUTTON( StatisticsID, BenchmarkDialog::OnStatistics )
+   EVT_BUTTON( AppendingID, BenchmarkDialog::OnAppending )
+   EVT_BUTTON( MixingID, BenchmarkDialog::OnMixing )
+   EVT_BUTTON( MixKernelsID, BenchmarkDialog::OnMixKernels )
    EVT_BUTTON( BSaveID,  BenchmarkDialog::OnSave )
    EVT_BUTTON( ClearID, BenchmarkDialog::OnClear )
    EVT_BUTTON( wxID_CANCEL, BenchmarkDialog::OnClose )
@@ -232,6 +306,24 @@ void BenchmarkDialog::MakeBenchmarkDialog()
          .MinSize( { 500, 200 } )
          .AddTextWindow(wxT(""));
 
+      //
+      S.StartStatic(XO("Timings"));
+      {
+         S.StartMultiColumn(4);
+         {
+            S.Id(RandomReadsID).AddButton(XXO("Random Reads"));
+            S.Id(CompressionID).AddButton(XXO("Compression"));
+            S.Id(LoadingID).AddButton(XXO("Loading"));
+            S.Id(BlockIndexID).AddButton(XXO("Block Index"));
+            S.Id(StatisticsID).AddButton(XXO("Statistics"));
+            S.Id(AppendingID).AddButton(XXO("Appending"));
+            S.Id(MixingID).AddButton(XXO("Mixing"));
+            S.Id(MixKernelsID).AddButton(XXO("Mix Kernels"));
+         }
+         S.EndMultiColumn();
+      }
+      S.EndStatic();
+
       //
       S.SetBorder(10);
       S.StartHorizontalLay(wxALIGN_LEFT | wxEXPAND, false);
@@ -319,16 +411,13 @@ void BenchmarkDialog::FlushPrint()
    mToPrint = wxT("");
 }
 
-void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
+bool BenchmarkDialog::GetSettings(
+   long &blockSize, long &numEdits, long &dataSize, long &randSeed)
 {
    TransferDataFromWindow();
 
    if (!Validate())
-      return;
-
-   // This code will become part of libaudacity,
-   // and this class will be phased out.
-   long blockSize, numEdits, dataSize, randSeed;
+      return false;
 
    mBlockSizeStr.ToLong(&blockSize);
    mNumEditsStr.ToLong(&numEdits);
@@ -338,21 +427,32 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    if (blockSize < 1 || blockSize > 1024) {
       AudacityMessageBox(
          XO("Block size should be in the range 1 - 1024 KB.") );
-      return;
+      return false;
    }
 
    if (numEdits < 1 || numEdits > 10000) {
       AudacityMessageBox(
          XO("Number of edits should be in the range 1 - 10000.") );
-      return;
+      return false;
    }
 
    if (dataSize < 1 || dataSize > 2000) {
       AudacityMessageBox(
          XO("Test data size should be in the range 1 - 2000 MB.") );
-      return;
+      return false;
    }
 
+   return true;
+}
+
+void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
+{
+   // This code will become part of libaudacity,
+   // and this class will be phased out.
+   long blockSize, numEdits, dataSize, randSeed;
+   if (!GetSettings(blockSize, numEdits, dataSize, randSeed))
+      return;
+
    bool editClipCanMove = true;
    gPrefs->Read(wxT("/GUI/EditClipCanMove"), &editClipCanMove);
    gPrefs->Write(wxT("/GUI/EditClipCanMove"), false);
@@ -581,3 +681,503 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    Printf( XO("Benchmark completed successfully.\n") );
    HoldPrint(false);
 }
+
+void BenchmarkDialog::Time(
+   const std::function< void( long blockSize, long dataSize ) > &timing )
+{
+   long blockSize, numEdits, dataSize, randSeed;
+   if (!GetSettings(blockSize, numEdits, dataSize, randSeed))
+      return;
+
+   auto oldBlockSize = Sequence::GetMaxDiskBlockSize();
+   Sequence::SetMaxDiskBlockSize(blockSize * 1024);
+
+   const auto cleanup = finally( [&] {
+      Sequence::SetMaxDiskBlockSize(oldBlockSize);
+      HoldPrint(false);
+   } );
+
+   wxBusyCursor busy;
+
+   HoldPrint(true);
+
+   srand(randSeed);
+
+   timing(blockSize, dataSize);
+}
+
+std::shared_ptr<WaveTrack> BenchmarkDialog::MakeTrack( long dataSize )
+{
+   Printf( XO("Preparing...\n") );
+   wxTheApp->Yield();
+   FlushPrint();
+
+   const auto pFactory = SampleBlockFactory::New( mProject );
+   const auto t =
+      WaveTrackFactory{ mSettings, pFactory }.NewWaveTrack(SampleFormat);
+   t->SetRate(1);
+
+   const auto len = t->GetMaxBlockSize();
+   const auto nBuffers = std::max<uint64_t>(1,
+      (dataSize * 1048576ull) / (len * sizeof(SampleType)));
+   ArrayOf<SampleType> buffer{ len };
+   {
+      SampleBlockBatch batch{ pFactory };
+      for (uint64_t i = 0; i < nBuffers; i++) {
+         for (size_t j = 0; j < len; j++)
+            buffer[j] = SampleType(rand());
+         t->Append((samplePtr)buffer.get(), SampleFormat, len);
+      }
+      t->Flush();
+   }
+
+   return t;
+}
+
+void BenchmarkDialog::OnRandomReads( wxCommandEvent & WXUNUSED(event))
+{
+   // Short reads at random places, as in scrubbing or seeking, which
+   // mostly miss the cache when the data are large
+   Time( [this]( long, long dataSize ) {
+      const auto t = MakeTrack(dataSize);
+      const auto len = t->GetClipByIndex(0)->GetSequence()->GetNumSamples()
+         .as_long_long();
+      const size_t readLen = std::min<long long>(1024, len);
+      const int nReads = 10000;
+      const auto nStarts = len - readLen + 1;
+
+      Printf( XO("Performing %d random reads of %lld samples...\n")
+         .Format( nReads, (long long)readLen ) );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      ArrayOf<SampleType> samples{ readLen };
+      wxStopWatch timer;
+      for (int i = 0; i < nReads; i++) {
+         const auto start = ((uint64_t)rand() * RAND_MAX + rand()) % nStarts;
+         t->Get((samplePtr)samples.get(), SampleFormat, start, readLen);
+      }
+      const auto elapsed = timer.Time();
+
+      Printf( XO("Time for random reads: %ld ms, %.1f reads per second\n")
+         .Format( elapsed, nReads / (std::max(elapsed, 1L) / 1000.0) ) );
+   } );
+}
+
+void BenchmarkDialog::OnCompression( wxCommandEvent & WXUNUSED(event))
+{
+   if (!SampleBlockCodec::IsAvailable(SampleBlockCodec::Flac)) {
+      Printf( XO("Lossless block compression is not available.\n") );
+      return;
+   }
+
+   // Compare the block codec with raw storage, for a noisy tone stored both
+   // as 16 bit samples and as the floats that importing them would make
+   Time( [this]( long blockSize, long dataSize ) {
+      Printf( XO("Compressing blocks...\n") );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const size_t blockLen = blockSize * 1024 / sizeof(SampleType);
+      const auto nBlocks = std::max<uint64_t>(1,
+         (dataSize * 1048576ull) / (blockLen * sizeof(SampleType)));
+
+      ArrayOf<SampleType> signal{ blockLen };
+      Floats floats{ blockLen };
+      for (size_t i = 0; i < blockLen; i++) {
+         signal[i] = SampleType(8000 * sin(i * 0.05) + (rand() % 512) - 256);
+         floats[i] = signal[i] / 32768.0f;
+      }
+
+      wxStopWatch timer;
+      for (auto format : { SampleFormat, floatSample }) {
+         const auto src = (format == floatSample)
+            ? (constSamplePtr)floats.get() : (constSamplePtr)signal.get();
+         const auto rawBytes = blockLen * SAMPLE_SIZE(format);
+         SampleBuffer decoded(blockLen, format);
+         ArrayOf<char> encoded;
+         size_t encodedBytes = 0;
+         long encodeTime = 0, decodeTime = 0;
+         bool ok = true;
+
+         for (uint64_t i = 0; ok && i < nBlocks; i++) {
+            timer.Start();
+            ok = SampleBlockCodec::Encode(SampleBlockCodec::Flac,
+               src, format, blockLen, encoded, encodedBytes);
+            encodeTime += timer.Time();
+
+            timer.Start();
+            ok = ok && SampleBlockCodec::Decode(SampleBlockCodec::Flac,
+               encoded.get(), encodedBytes, format, blockLen, decoded.ptr());
+            decodeTime += timer.Time();
+         }
+
+         if (!ok) {
+            Printf( XO("Block codec failed for %s samples.\n")
+               .Format( GetSampleFormatStr(format) ) );
+            continue;
+         }
+
+         const double megabytes = nBlocks * rawBytes / 1048576.0;
+         Printf( XO("%s: compressed to %.1f%% of raw size; encoding %.1f MB/s, decoding %.1f MB/s\n")
+            .Format( GetSampleFormatStr(format),
+               100.0 * encodedBytes / rawBytes,
+               megabytes / std::max(encodeTime, 1L) * 1000.0,
+               megabytes / std::max(decodeTime, 1L) * 1000.0 ) );
+      }
+   } );
+}
+
+void BenchmarkDialog::OnLoading( wxCommandEvent & WXUNUSED(event))
+{
+   // Compare two ways to load a project document:  decoding it to XML
+   // text for expat, or dispatching straight to the tag handlers.  Repeat
+   // the track until the document describes at least 50000 blocks.
+   Time( [this]( long, long dataSize ) {
+      const auto t = MakeTrack(dataSize);
+      const size_t minBlocks = 50000;
+      const size_t blocksPerTrack = std::max<size_t>(1,
+         t->GetClipByIndex(0)->GetSequence()->GetBlockArray().size());
+      const auto copies = (minBlocks + blocksPerTrack - 1) / blocksPerTrack;
+
+      Printf( XO("Loading a project document of %lld blocks...\n")
+         .Format( (long long) (copies * blocksPerTrack) ) );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      ProjectSerializer doc;
+      doc.StartTag(wxT("project"));
+      for (size_t i = 0; i < copies; i++)
+         t->WriteXML(doc);
+      doc.EndTag(wxT("project"));
+
+      wxMemoryBuffer buffer;
+      buffer.AppendData(doc.GetDict().GetData(), doc.GetDict().GetDataLen());
+      buffer.AppendData(doc.GetData().GetData(), doc.GetData().GetDataLen());
+
+      CountingHandler viaText, direct;
+      wxStopWatch timer;
+
+      timer.Start();
+      XMLFileReader reader;
+      bool ok = reader.ParseString(&viaText, ProjectSerializer::Decode(buffer));
+      const long textTime = timer.Time();
+
+      timer.Start();
+      TranslatableString error;
+      ok = ProjectSerializer::Decode(buffer, &direct, error) && ok;
+      const long directTime = timer.Time();
+
+      if (!ok)
+         Printf( XO("The project document could not be loaded.\n%s\n")
+            .Format( error.empty() ? reader.GetErrorStr() : error ) );
+      else
+         Printf( XO("Decoding to XML and parsing: %ld ms; decoding to handlers: %ld ms\n")
+            .Format( textTime, directTime ) );
+   } );
+}
+
+void BenchmarkDialog::OnBlockIndex( wxCommandEvent & WXUNUSED(event))
+{
+   // Compare repeated cut and paste of runs of blocks in a ten hour track,
+   // with the block index and with a vector of blocks with absolute
+   // starts, as Sequence formerly kept them
+   Time( [this]( long, long ) {
+      const auto pFactory = SampleBlockFactory::New( mProject );
+      Sequence seq{ pFactory, SampleFormat };
+      seq.InsertSilence(0, sampleCount{ 10 * 3600 } * 44100);
+      const auto &blocks = seq.GetBlockArray();
+
+      Printf( XO("Cutting and pasting in a ten hour track of %lld blocks...\n")
+         .Format( (long long) blocks.size() ) );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const auto random = [](size_t n){
+         return ((size_t(rand()) << 15) ^ size_t(rand())) % n; };
+      const int nEdits = 1000;
+      struct Edit { size_t from, len, to; };
+      std::vector<Edit> edits;
+      for (int i = 0; i < nEdits; i++) {
+         const size_t len = 1 + random(16);
+         const auto from = random(blocks.size() - len + 1);
+         edits.push_back({ from, len, random(blocks.size() - len + 1) });
+      }
+
+      wxStopWatch timer;
+      std::vector<SeqBlock> vec{ blocks.begin(), blocks.end() };
+      timer.Start();
+      for (const auto &edit : edits) {
+         const auto first = vec.begin() + edit.from;
+         std::vector<SeqBlock> cut{ first, first + edit.len };
+         sampleCount cutLen = 0;
+         for (const auto &block : cut)
+            cutLen += block.sb->GetSampleCount();
+         vec.erase(first, first + edit.len);
+         for (auto ii = edit.from; ii < vec.size(); ++ii)
+            vec[ii].start -= cutLen;
+
+         auto at = edit.to < vec.size()
+            ? vec[edit.to].start
+            : seq.GetNumSamples() - cutLen;
+         for (auto &block : cut) {
+            block.start = at;
+            at += block.sb->GetSampleCount();
+         }
+         vec.insert(vec.begin() + edit.to, cut.begin(), cut.end());
+         for (auto ii = edit.to + edit.len; ii < vec.size(); ++ii)
+            vec[ii].start += cutLen;
+      }
+      const long vectorTime = timer.Time();
+
+      BlockArray tree{ blocks };
+      timer.Start();
+      for (const auto &edit : edits) {
+         const auto cut = tree.Slice(edit.from, edit.from + edit.len);
+         auto rest = tree.Slice(0, edit.from);
+         rest.Append(tree.Slice(edit.from + edit.len, tree.size()));
+         tree = rest.Slice(0, edit.to);
+         tree.Append(cut);
+         tree.Append(rest.Slice(edit.to, rest.size()));
+      }
+      const long treeTime = timer.Time();
+
+      Printf( XO("%d cuts and pastes of up to 16 blocks: vector %ld ms, block index %ld ms\n")
+         .Format( nEdits, vectorTime, treeTime ) );
+
+      // Now the same edits of the Sequence, which also check consistency
+      // and rewrite the blocks at the edges
+      const int nSequenceEdits = 100;
+      timer.Start();
+      for (int i = 0; i < nSequenceEdits; i++) {
+         const auto &edit = edits[i];
+         // Edits at the edges may have changed the number of blocks
+         if (edit.from + edit.len >= blocks.size())
+            continue;
+         const auto s0 = blocks[edit.from].start;
+         const auto s1 = s0 + blocks.Slice(edit.from, edit.from + edit.len)
+            .GetNumSamples();
+         auto pCut = seq.Copy(pFactory, s0, s1);
+         seq.Delete(s0, s1 - s0);
+         const auto to = std::min(edit.to, blocks.size() - 1);
+         seq.Paste(blocks[to].start, pCut.get());
+      }
+      const long sequenceTime = timer.Time();
+
+      Printf( XO("%d cuts and pastes in the Sequence: %ld ms\n")
+         .Format( nSequenceEdits, sequenceTime ) );
+   } );
+}
+
+void BenchmarkDialog::OnStatistics( wxCommandEvent & WXUNUSED(event))
+{
+   // Time each kernel for min, max and sum of squares; tests/ checks that
+   // they agree
+   Time( [this]( long, long ) {
+      const size_t len = 1 << 22;
+      Floats floats{ len };
+      ArrayOf<short> shorts{ len };
+      for (size_t i = 0; i < len; i++) {
+         shorts[i] = (short)(rand() - RAND_MAX / 2);
+         floats[i] = shorts[i] / 32768.0f + (rand() % 1000) / 1e7f;
+      }
+
+      const auto original = SampleStatistics::GetKernel();
+      auto cleanup = finally([&]{ SampleStatistics::SetKernel(original); });
+
+      wxStopWatch timer;
+      for (int k = 0; k < SampleStatistics::nKernels; k++) {
+         const auto kernel = static_cast<SampleStatistics::Kernel>(k);
+         if (!SampleStatistics::IsAvailable(kernel))
+            continue;
+         SampleStatistics::SetKernel(kernel);
+
+         const int nRepeats = 20;
+         float min = FLT_MAX, max = -FLT_MAX;
+         double sumsq = 0;
+         timer.Start();
+         for (int i = 0; i < nRepeats; i++)
+            SampleStatistics::Accumulate(floats.get(), len, min, max, sumsq);
+         const auto floatTime = std::max(1L, timer.Time());
+         timer.Start();
+         for (int i = 0; i < nRepeats; i++)
+            SampleStatistics::Accumulate(shorts.get(), len, min, max, sumsq);
+         const auto shortTime = std::max(1L, timer.Time());
+
+         Printf( XO("Kernel %s: %.0f million float samples per second, %.0f million int16 samples per second\n")
+            .Format( SampleStatistics::GetName(kernel),
+               (double) nRepeats * len / floatTime / 1000,
+               (double) nRepeats * len / shortTime / 1000 ) );
+      }
+   } );
+}
+
+void BenchmarkDialog::OnAppending( wxCommandEvent & WXUNUSED(event))
+{
+   // Compare ways to append the channels of interleaved float samples, as
+   // the PCM importer reads them:  de-interleaving each channel into a
+   // buffer first, or appending with a stride; and mono samples in whole
+   // blocks, which skip the append buffer
+   Time( [this]( long, long dataSize ) {
+      const auto pFactory = SampleBlockFactory::New( mProject );
+      WaveTrackFactory trackFactory{ mSettings, pFactory };
+      const size_t nChannels = 2;
+      const size_t maxBlock =
+         trackFactory.NewWaveTrack(floatSample)->GetMaxBlockSize();
+      const size_t nReads = std::max<size_t>(1,
+         (dataSize * 1048576ull) / (maxBlock * nChannels * sizeof(float)));
+      Floats interleaved{ maxBlock * nChannels };
+      Floats channel{ maxBlock };
+      for (size_t i = 0; i < maxBlock * nChannels; i++)
+         interleaved[i] = (rand() - RAND_MAX / 2) / (float)RAND_MAX;
+
+      Printf( XO("Appending %.1f MB of interleaved samples in reads of %lld frames...\n")
+         .Format( nReads * maxBlock * nChannels * sizeof(float) / 1048576.0,
+            (long long) maxBlock ) );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const auto append = [&](size_t channels, bool deinterleave) {
+         std::vector<std::shared_ptr<WaveTrack>> tracks;
+         for (size_t c = 0; c < channels; c++)
+            tracks.push_back(trackFactory.NewWaveTrack(floatSample));
+         wxStopWatch watch;
+         {
+            SampleBlockBatch batch{ pFactory };
+            for (size_t r = 0; r < nReads; r++)
+               for (size_t c = 0; c < channels; c++) {
+                  const auto src = (samplePtr)(interleaved.get() + c);
+                  if (deinterleave) {
+                     for (size_t j = 0; j < maxBlock; j++)
+                        channel[j] = interleaved[channels * j + c];
+                     tracks[c]->Append(
+                        (samplePtr)channel.get(), floatSample, maxBlock);
+                  }
+                  else
+                     tracks[c]->Append(src, floatSample, maxBlock, channels);
+               }
+            for (auto &track : tracks)
+               track->Flush();
+         }
+         const auto time = std::max(1L, watch.Time());
+         return nReads * maxBlock * channels * sizeof(float) / 1048.576 / time;
+      };
+
+      const auto copied = append(nChannels, true);
+      const auto strided = append(nChannels, false);
+      const auto mono = append(1, false);
+      Printf( XO("De-interleaved first: %.1f MB/s; with stride: %.1f MB/s; mono whole blocks: %.1f MB/s\n")
+         .Format( copied, strided, mono ) );
+   } );
+}
+
+void BenchmarkDialog::OnMixing( wxCommandEvent & WXUNUSED(event))
+{
+   // Run the mixers of many playback tracks, resampling, as the audio
+   // thread does, first on one thread and then shared with a pool
+   Time( [this]( long, long dataSize ) {
+      const auto t = MakeTrack(dataSize);
+      const size_t nTracks = 32, bufferSize = 4096;
+      const double endTime = std::min(t->GetEndTime(), double(1 << 20));
+      const auto nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+      Printf( XO("Mixing %lld tracks of %.0f samples each, on 1 and %lld threads...\n")
+         .Format( (long long) nTracks, endTime, (long long) nThreads ) );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      const auto mix = [&](TaskPool *pPool) {
+         std::vector<std::unique_ptr<Mixer>> mixers;
+         for (size_t ii = 0; ii < nTracks; ++ii)
+            mixers.push_back(std::make_unique<Mixer>(
+               WaveTrackConstArray{ t },
+               false,
+               Mixer::WarpOptions{
+                  static_cast<const BoundedEnvelope*>(nullptr) },
+               0.0, endTime,
+               1, bufferSize, false,
+               1.1, floatSample,
+               false, nullptr, false));
+         std::vector<size_t> processed(nTracks);
+         const auto process = [&](size_t ii) {
+            processed[ii] = mixers[ii]->Process(bufferSize);
+         };
+         do {
+            if (pPool)
+               pPool->Run(nTracks, process);
+            else
+               for (size_t ii = 0; ii < nTracks; ++ii)
+                  process(ii);
+         } while (processed[0] > 0);
+      };
+
+      wxStopWatch timer;
+      timer.Start();
+      mix(nullptr);
+      const auto serialTime = std::max(1L, timer.Time());
+
+      TaskPool pool{ nThreads - 1 };
+      timer.Start();
+      mix(&pool);
+      const auto parallelTime = std::max(1L, timer.Time());
+
+      Printf( XO("Mixing on one thread: %ld ms; on %lld threads: %ld ms\n")
+         .Format( serialTime, (long long) nThreads, parallelTime ) );
+   } );
+}
+
+void BenchmarkDialog::OnMixKernels( wxCommandEvent & WXUNUSED(event))
+{
+   // Time, for each kernel of the mix primitives, the work that the audio
+   // callback does for each track:  gain for the meters and a gain ramp for
+   // the output, into interleaved stereo; tests/ checks that they agree
+   Time( [this]( long, long ) {
+      const size_t nTracks = 32, framesPerBuffer = 512, nChannels = 2;
+      const int nCallbacks = 2000;
+      Floats tracks{ nTracks * framesPerBuffer };
+      for (size_t i = 0; i < nTracks * framesPerBuffer; i++)
+         tracks[i] = (rand() - RAND_MAX / 2) / (float)RAND_MAX;
+      Floats output{ framesPerBuffer * nChannels };
+      Floats meter{ framesPerBuffer * nChannels };
+
+      const auto callback = [&]{
+         std::fill(output.get(), output.get() + framesPerBuffer * nChannels, 0);
+         std::fill(meter.get(), meter.get() + framesPerBuffer * nChannels, 0);
+         for (size_t t = 0; t < nTracks; t++) {
+            const auto tempBuf = tracks.get() + t * framesPerBuffer;
+            for (size_t chan = 0; chan < nChannels; chan++) {
+               const float gain = 0.5f + 0.01f * t, oldGain = 0.4f;
+               MixKernels::ScaleAccumulate(meter.get() + chan, nChannels,
+                  tempBuf, framesPerBuffer, gain);
+               MixKernels::RampAccumulate(output.get() + chan, nChannels,
+                  tempBuf, framesPerBuffer,
+                  oldGain, (gain - oldGain) / framesPerBuffer);
+            }
+         }
+         MixKernels::Clamp(output.get(), framesPerBuffer * nChannels);
+         MixKernels::Clamp(meter.get(), framesPerBuffer * nChannels);
+      };
+
+      const auto original = MixKernels::GetKernel();
+      auto cleanup = finally([&]{ MixKernels::SetKernel(original); });
+
+      Printf( XO("Mixing %lld tracks into stereo as the audio callback does, in buffers of %lld frames...\n")
+         .Format( (long long) nTracks, (long long) framesPerBuffer ) );
+
+      for (int k = 0; k < MixKernels::nKernels; k++) {
+         const auto kernel = static_cast<MixKernels::Kernel>(k);
+         if (!MixKernels::IsAvailable(kernel))
+            continue;
+         MixKernels::SetKernel(kernel);
+
+         wxStopWatch watch;
+         for (int i = 0; i < nCallbacks; i++)
+            callback();
+         const auto time = std::max(1L, watch.Time());
+
+         Printf( XO("Mix kernel %s: %.3f microseconds per track per callback\n")
+            .Format( MixKernels::GetName(kernel),
+               1000.0 * time / nCallbacks / nTracks ) );
+      }
+   } );
+}
@@ -0,0 +1,311 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file BlockArray.cpp
+@brief Implements BlockArray as a persistent randomized tree with implicit keys
+
+**********************************************************************/
+
+#include "BlockArray.h"
+
+#include <atomic>
+
+#include <wx/debug.h>
+
+#include "SampleBlock.h"
+
+struct BlockArray::Node
+{
+   SeqBlock::SampleBlockPtr sb;
+   //! Cached sample count of sb
+   size_t length{ 0 };
+   //! Blocks in this subtree
+   size_t count{ 0 };
+   //! Samples in this subtree
+   sampleCount samples{ 0 };
+   NodePtr left, right;
+};
+
+namespace {
+
+// Pseudo-random and well distributed choices in Merge() keep the expected
+// depth of the tree logarithmic, whatever the order of insertions
+unsigned NextRandom()
+{
+   static std::atomic<unsigned> sCounter{ 0 };
+   auto x = sCounter++ * 0x9E3779B9u;
+   x ^= x >> 16;
+   x *= 0x85EBCA6Bu;
+   x ^= x >> 13;
+   x *= 0xC2B2AE35u;
+   x ^= x >> 16;
+   return x;
+}
+
+}
+
+BlockArray::~BlockArray() = default;
+
+size_t BlockArray::Count(const NodePtr &pNode)
+{
+   return pNode ? pNode->count : 0;
+}
+
+sampleCount BlockArray::Samples(const NodePtr &pNode)
+{
+   return pNode ? pNode->samples : 0;
+}
+
+auto BlockArray::MakeNode(const SeqBlock::SampleBlockPtr &sb) -> NodePtr
+{
+   wxASSERT(sb);
+   auto result = std::make_shared<Node>();
+   result->sb = sb;
+   result->length = sb->GetSampleCount();
+   result->count = 1;
+   result->samples = result->length;
+   return result;
+}
+
+auto BlockArray::Rebuild(const NodePtr &pNode, NodePtr left, NodePtr right)
+   -> NodePtr
+{
+   if (left == pNode->left && right == pNode->right)
+      return pNode;
+
+   auto result = std::make_shared<Node>();
+   result->sb = pNode->sb;
+   result->length = pNode->length;
+   result->count = Count(left) + 1 + Count(right);
+   result->samples = Samples(left) + result->length + Samples(right);
+   result->left = std::move(left);
+   result->right = std::move(right);
+   return result;
+}
+
+auto BlockArray::Merge(const NodePtr &left, const NodePtr &right) -> NodePtr
+{
+   if (!left)
+      return right;
+   if (!right)
+      return left;
+   // Choose the root from either side, with odds proportional to the sizes.
+   // Stored priorities, as in a treap, would not do:  appending a subtree
+   // to a tree that shares it, as by repeated pasting, would tie every
+   // priority on the merge spine and make the depth grow linearly.  Choices
+   // made fresh at each merge keep the tree a random one even so.
+   const auto leftCount = Count(left);
+   const auto total = leftCount + Count(right);
+   if (NextRandom() % total < leftCount)
+      return Rebuild(left, left->left, Merge(left->right, right));
+   else
+      return Rebuild(right, Merge(left, right->left), right->right);
+}
+
+auto BlockArray::Split(const NodePtr &pNode, size_t n)
+   -> std::pair<NodePtr, NodePtr>
+{
+   if (n == 0)
+      return { nullptr, pNode };
+   if (n >= Count(pNode))
+      return { pNode, nullptr };
+
+   const auto leftCount = Count(pNode->left);
+   if (n <= leftCount) {
+      auto parts = Split(pNode->left, n);
+      return { std::move(parts.first),
+         Rebuild(pNode, std::move(parts.second), pNode->right) };
+   }
+   else {
+      auto parts = Split(pNode->right, n - leftCount - 1);
+      return { Rebuild(pNode, pNode->left, std::move(parts.first)),
+         std::move(parts.second) };
+   }
+}
+
+auto BlockArray::Replace(const NodePtr &pNode, size_t ii,
+   const SeqBlock::SampleBlockPtr &sb) -> NodePtr
+{
+   const auto leftCount = Count(pNode->left);
+   if (ii < leftCount)
+      return Rebuild(pNode, Replace(pNode->left, ii, sb), pNode->right);
+   else if (ii > leftCount)
+      return Rebuild(pNode,
+         pNode->left, Replace(pNode->right, ii - leftCount - 1, sb));
+   else {
+      auto result = std::make_shared<Node>(*pNode);
+      result->sb = sb;
+      result->length = sb->GetSampleCount();
+      result->samples =
+         Samples(result->left) + result->length + Samples(result->right);
+      return result;
+   }
+}
+
+size_t BlockArray::size() const
+{
+   return Count(mRoot);
+}
+
+sampleCount BlockArray::GetNumSamples() const
+{
+   return Samples(mRoot);
+}
+
+SeqBlock BlockArray::operator[] (size_t ii) const
+{
+   wxASSERT(ii < size());
+
+   sampleCount start = 0;
+   auto pNode = mRoot.get();
+   while (pNode) {
+      const auto leftCount = Count(pNode->left);
+      if (ii < leftCount)
+         pNode = pNode->left.get();
+      else {
+         start += Samples(pNode->left);
+         if (ii == leftCount)
+            return { pNode->sb, start };
+         ii -= leftCount + 1;
+         start += pNode->length;
+         pNode = pNode->right.get();
+      }
+   }
+   return {};
+}
+
+size_t BlockArray::FindBlock(sampleCount pos) const
+{
+   wxASSERT(pos >= 0 && pos < GetNumSamples());
+
+   size_t index = 0;
+   auto pNode = mRoot.get();
+   while (pNode) {
+      const auto leftSamples = Samples(pNode->left);
+      if (pos < leftSamples)
+         pNode = pNode->left.get();
+      else {
+         index += Count(pNode->left);
+         pos -= leftSamples;
+         if (pos < pNode->length)
+            return index;
+         ++index;
+         pos -= pNode->length;
+         pNode = pNode->right.get();
+      }
+   }
+   // Position out of range
+   return size() - 1;
+}
+
+auto BlockArray::end() const -> const_iterator
+{
+   const_iterator result;
+   result.mIndex = size();
+   return result;
+}
+
+auto BlockArray::At(size_t ii) const -> const_iterator
+{
+   const_iterator result;
+   if (ii >= size()) {
+      result.mIndex = size();
+      return result;
+   }
+
+   result.mIndex = ii;
+   sampleCount start = 0;
+   auto pNode = mRoot.get();
+   while (true) {
+      const auto leftCount = Count(pNode->left);
+      if (ii < leftCount) {
+         result.mStack.push_back(pNode);
+         pNode = pNode->left.get();
+      }
+      else {
+         start += Samples(pNode->left);
+         if (ii == leftCount)
+            break;
+         ii -= leftCount + 1;
+         start += pNode->length;
+         pNode = pNode->right.get();
+      }
+   }
+   result.mpNode = pNode;
+   result.mBlock = { pNode->sb, start };
+   return result;
+}
+
+void BlockArray::const_iterator::Descend(const Node *pNode)
+{
+   while (pNode->left) {
+      mStack.push_back(pNode);
+      pNode = pNode->left.get();
+   }
+   mpNode = pNode;
+}
+
+auto BlockArray::const_iterator::operator ++() -> const_iterator &
+{
+   const auto start = mBlock.start + mpNode->length;
+   if (mpNode->right)
+      Descend(mpNode->right.get());
+   else if (!mStack.empty()) {
+      mpNode = mStack.back();
+      mStack.pop_back();
+   }
+   else
+      mpNode = nullptr;
+
+   ++mIndex;
+   if (mpNode)
+      mBlock = { mpNode->sb, start };
+   else
+      mBlock = {};
+   return *this;
+}
+
+void BlockArray::push_back(const SeqBlock &b)
+{
+   mRoot = Merge(mRoot, MakeNode(b.sb));
+}
+
+void BlockArray::pop_back()
+{
+   wxASSERT(!empty());
+   mRoot = Split(mRoot, size() - 1).first;
+}
+
+void BlockArray::Replace(size_t ii, const SeqBlock::SampleBlockPtr &sb)
+{
+   wxASSERT(ii < size());
+   wxASSERT(sb);
+   mRoot = Replace(mRoot, ii, sb);
+}
+
+BlockArray BlockArray::Slice(size_t first, size_t last) const
+{
+   if (first >= last)
+      return {};
+   auto head = Split(mRoot, last).first;
+   return BlockArray{ Split(head, first).second };
+}
+
+void BlockArray::Append(const BlockArray &other)
+{
+   mRoot = Merge(mRoot, other.mRoot);
+}
+
+bool BlockArray::IsSameAs(const BlockArray &other) const
+{
+   if (mRoot == other.mRoot)
+      return true;
+   if (size() != other.size() || GetNumSamples() != other.GetNumSamples())
+      return false;
+   for (auto iter = begin(), iter2 = other.begin(), stop = end();
+        iter != stop; ++iter, ++iter2)
+      if (iter->sb != iter2->sb)
+         return false;
+   return true;
+}
@@ -0,0 +1,168 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file BlockArray.h
+@brief Declare BlockArray, the persistent sequence of blocks of a Sequence
+
+**********************************************************************/
+
+#ifndef __AUDACITY_BLOCK_ARRAY__
+#define __AUDACITY_BLOCK_ARRAY__
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Audacity.h" // for PROFILE_DLL_API
+#include "audacity/Types.h"
+
+class SampleBlock;
+
+// This is an internal data structure!  For advanced use only.
+class SeqBlock {
+ public:
+   using SampleBlockPtr = std::shared_ptr<SampleBlock>;
+   SampleBlockPtr sb;
+   ///the sample in the global wavetrack that this block starts at.
+   sampleCount start;
+
+   SeqBlock()
+      : sb{}, start(0)
+   {}
+
+   SeqBlock(const SampleBlockPtr &sb_, sampleCount start_)
+      : sb(sb_), start(start_)
+   {}
+
+   // Construct a SeqBlock with changed start, same file
+   SeqBlock Plus(sampleCount delta) const
+   {
+      return SeqBlock(sb, start + delta);
+   }
+};
+
+///\brief The blocks of a Sequence, in a balanced tree
+/*! The start of each block is not stored, but implied by the lengths of the
+    blocks before it, so that insertions and deletions need not renumber the
+    blocks after them.  Lookup by index or by sample position, splitting, and
+    concatenation take logarithmic time.
+
+    Tree nodes are immutable and shared, so that copying a BlockArray takes
+    constant time, and the copy shares all blocks that later edits of either
+    one do not touch.
+
+    Elements are accessed by value, with the implied start filled in.  A
+    reference to an element therefore can't be used to modify it; use
+    Replace() instead. */
+class PROFILE_DLL_API BlockArray
+{
+   struct Node;
+   using NodePtr = std::shared_ptr<const Node>;
+
+public:
+   //! Visits the blocks in order, taking amortized constant time per step
+   /*! It is valid only while the BlockArray is not modified */
+   class PROFILE_DLL_API const_iterator
+   {
+   public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = SeqBlock;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const SeqBlock *;
+      using reference = const SeqBlock &;
+
+      const_iterator() = default;
+
+      reference operator *() const { return mBlock; }
+      pointer operator ->() const { return &mBlock; }
+
+      const_iterator &operator ++();
+      const_iterator operator ++(int)
+      { auto result = *this; ++*this; return result; }
+
+      bool operator == (const const_iterator &other) const
+      { return mIndex == other.mIndex; }
+      bool operator != (const const_iterator &other) const
+      { return !(*this == other); }
+
+      //! Position of the current block in the array
+      size_t Index() const { return mIndex; }
+
+   private:
+      friend BlockArray;
+      void Descend(const Node *pNode);
+
+      //! Ancestors of the current node whose left subtrees contain it
+      std::vector<const Node *> mStack;
+      const Node *mpNode{};
+      size_t mIndex{ 0 };
+      SeqBlock mBlock;
+   };
+   using iterator = const_iterator;
+
+   BlockArray() = default;
+   BlockArray(const BlockArray &) = default;
+   BlockArray(BlockArray &&) = default;
+   BlockArray &operator= (const BlockArray &) = default;
+   BlockArray &operator= (BlockArray &&) = default;
+   ~BlockArray();
+
+   size_t size() const;
+   bool empty() const { return !mRoot; }
+
+   //! Total of the lengths of all the blocks
+   sampleCount GetNumSamples() const;
+
+   //! Logarithmic time; prefer iterators for visiting consecutive blocks
+   SeqBlock operator[] (size_t ii) const;
+   SeqBlock front() const { return (*this)[0]; }
+   SeqBlock back() const { return (*this)[size() - 1]; }
+
+   //! Index of the block containing a sample
+   /*! @pre 0 <= pos < GetNumSamples() */
+   size_t FindBlock(sampleCount pos) const;
+
+   const_iterator begin() const { return At(0); }
+   const_iterator end() const;
+   //! Iterator positioned at the given index, or end() if it is size()
+   const_iterator At(size_t ii) const;
+
+   //! Append a block
+   /*! The start of b is ignored; its sample block must not be null */
+   void push_back(const SeqBlock &b);
+   void pop_back();
+   void clear() { mRoot.reset(); }
+   void swap(BlockArray &other) { mRoot.swap(other.mRoot); }
+
+   //! Substitute the sample block at an index, which may change its length
+   void Replace(size_t ii, const SeqBlock::SampleBlockPtr &sb);
+
+   //! Share the blocks with indices in [first, last) into another array
+   BlockArray Slice(size_t first, size_t last) const;
+
+   //! Share all the blocks of other onto the end of this
+   void Append(const BlockArray &other);
+
+   //! Whether both arrays have the same sample blocks in the same order
+   /*! Takes constant time when one is an unmodified copy of the other */
+   bool IsSameAs(const BlockArray &other) const;
+
+private:
+   explicit BlockArray(NodePtr root) : mRoot{ std::move(root) } {}
+
+   static size_t Count(const NodePtr &pNode);
+   static sampleCount Samples(const NodePtr &pNode);
+   static NodePtr MakeNode(const SeqBlock::SampleBlockPtr &sb);
+   static NodePtr Rebuild(const NodePtr &pNode, NodePtr left, NodePtr right);
+   static NodePtr Merge(const NodePtr &left, const NodePtr &right);
+   static std::pair<NodePtr, NodePtr> Split(const NodePtr &pNode, size_t n);
+   static NodePtr Replace(const NodePtr &pNode, size_t ii,
+      const SeqBlock::SampleBlockPtr &sb);
+
+   NodePtr mRoot;
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file CpuFeatures.cpp
+@brief Implements CpuFeatures with CPUID on x86
+
+**********************************************************************/
+
+#include "CpuFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#define CPU_FEATURES_X86
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef CPU_FEATURES_X86
+
+bool DetectSSE2()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 1);
+   return (info[3] & (1 << 26)) != 0;
+#else
+   return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool DetectAVX2()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7)
+      return false;
+   __cpuid(info, 1);
+   // The operating system must save the AVX registers
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   if (!osxsave || (_xgetbv(0) & 6) != 6)
+      return false;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   // This also checks that the operating system saves the AVX registers
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+bool DetectSSE2()
+{
+   return false;
+}
+
+bool DetectAVX2()
+{
+   return false;
+}
+
+#endif
+
+}
+
+namespace CpuFeatures
+{
+
+bool HasSSE2()
+{
+   static const bool result = DetectSSE2();
+   return result;
+}
+
+bool HasAVX2()
+{
+   static const bool result = DetectAVX2();
+   return result;
+}
+
+}
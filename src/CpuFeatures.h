@@ -0,0 +1,24 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file CpuFeatures.h
+@brief Instruction sets of the machine, for choosing kernels at run time
+
+**********************************************************************/
+
+#ifndef __AUDACITY_CPU_FEATURES__
+#define __AUDACITY_CPU_FEATURES__
+
+//! Whether the processor and the operating system support instruction sets
+/*! Each is false where the build does not target x86.  The results are
+    found once and remembered. */
+namespace CpuFeatures
+{
+   bool HasSSE2();
+
+   //! Also requires that the operating system saves the AVX registers
+   bool HasAVX2();
+}
+
+#endif
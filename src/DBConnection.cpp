@@ -13,16 +13,36 @@ Paul Licameli -- split from ProjectFileIO.cpp
 
 #include "sqlite3.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
 #include <wx/progdlg.h>
 #include <wx/string.h>
+#include <wx/utils.h>
 
 #include "AudacityLogger.h"
 #include "FileNames.h"
 #include "Internat.h"
+#include "Prefs.h"
 #include "Project.h"
 #include "FileException.h"
 #include "wxFileNameWrapper.h"
 
+struct DBConnection::ReadPool
+{
+   //! Give back the connection of a thread that has ended
+   void Release(std::thread::id id);
+
+   std::mutex mutex;
+   //! Null after the DBConnection closes
+   DBConnection *pOwner{};
+   //! Connections in use by threads, which may be null for failure to open
+   std::map<std::thread::id, sqlite3 *> dbs;
+   //! Connections given back by threads that ended
+   std::vector<sqlite3 *> idle;
+};
+
 // Configuration to provide "safe" connections
 static const char *SafeConfig =
    "PRAGMA <schema>.locking_mode = SHARED;"
@@ -132,6 +152,12 @@ bool DBConnection::Open(const FilePath fileName)
    // Set default mode
    // (See comments in ProjectFileIO::SaveProject() about threading
    SafeMode();
+   ComputeMemorySizes();
+   MemoryConfig(mDB);
+   mWaitNanoseconds = 0;
+
+   mpReadPool = std::make_shared<ReadPool>();
+   mpReadPool->pOwner = this;
 
    // Kick off the checkpoint thread
    mCheckpointStop = false;
@@ -142,6 +168,18 @@ bool DBConnection::Open(const FilePath fileName)
    // Install our checkpoint hook
    sqlite3_wal_hook(mDB, CheckpointHook, this);
 
+   // Kick off the compaction thread, which waits for idle time.
+   // Preferences aren't safe to read from other threads.
+   mCompactionSliceKB =
+      gPrefs->Read(wxT("/Database/CompactSliceKB"),
+         static_cast<long>(DefaultCompactionSliceKB));
+   mLastWrite = std::chrono::steady_clock::now().time_since_epoch().count();
+   mFreePages = 0;
+   mReclaimedPages = 0;
+   mPageSize = 0;
+   mCompactionStop = false;
+   mCompactionThread = std::thread([this]{ CompactionThread(); });
+
    return mDB;
 }
 
@@ -156,6 +194,21 @@ bool DBConnection::Close()
       return true;
    }
 
+   // Stop compacting first; any slice it finishes may need a checkpoint.
+   // Free pages that remain are reclaimed when the project next opens.
+   {
+      std::lock_guard<std::mutex> guard(mCompactionMutex);
+      mCompactionStop = true;
+      mCompactionCondition.notify_one();
+   }
+   mCompactionThread.join();
+   {
+      const auto progress = GetCompactionProgress();
+      if (progress.reclaimedPages > 0 || progress.freePages > 0)
+         wxLogMessage(wxT("Compaction reclaimed %lld pages, %lld remain"),
+            progress.reclaimedPages, progress.freePages);
+   }
+
    // Uninstall our checkpoint hook so that no additional checkpoints
    // are sent our way.  (Though this shouldn't really happen.)
    sqlite3_wal_hook(mDB, nullptr, nullptr);
@@ -197,7 +250,20 @@ bool DBConnection::Close()
    // And wait for it to do so
    mCheckpointThread.join();
 
-   // We're done with the prepared statements
+   // Detach the read-only connections from threads that have yet to end
+   std::map<std::thread::id, sqlite3 *> readDBs;
+   std::vector<sqlite3 *> idleDBs;
+   {
+      auto &pool = *mpReadPool;
+      std::lock_guard<std::mutex> guard(pool.mutex);
+      pool.pOwner = nullptr;
+      readDBs.swap(pool.dbs);
+      idleDBs.swap(pool.idle);
+   }
+   mpReadPool.reset();
+
+   // We're done with the blob handles and the prepared statements
+   mBlobCache.Clear();
    {
       std::lock_guard<std::mutex> guard(mStatementMutex);
       for (auto stmt : mStatements)
@@ -208,6 +274,18 @@ bool DBConnection::Close()
       mStatements.clear();
    }
 
+   // And with the read-only connections
+   for (auto &readDB : readDBs)
+   {
+      sqlite3_close(readDB.second);
+   }
+   for (auto db : idleDBs)
+   {
+      sqlite3_close(db);
+   }
+   wxLogMessage(wxT("Database connections: %d readers, %.1f ms waiting"),
+      (int) (readDBs.size() + idleDBs.size()), GetWaitTime().count() / 1.0e6);
+
    // Close the DB
    rc = sqlite3_close(mDB);
    if (rc != SQLITE_OK)
@@ -265,6 +343,205 @@ bool DBConnection::ModeConfig(sqlite3 *db, const char *schema, const char *confi
    return rc == SQLITE_OK;
 }
 
+void DBConnection::ComputeMemorySizes()
+{
+   // Unless preferences say otherwise, size the memory mapping and page cache
+   // from the memory available now; memory mapping spares a system call and a
+   // copy for each page read.  0 MB disables memory mapping.
+   const long long freeMB = std::max<long long>(0,
+      wxGetFreeMemory().GetValue() / (1024 * 1024));
+   const long long maxMmapMB = sizeof(void *) >= 8 ? 1024 : 256;
+
+   mMmapMB = gPrefs->Read(wxT("/Database/MmapSizeMB"), -1L);
+   if (mMmapMB < 0)
+      mMmapMB = std::min(freeMB / 4, maxMmapMB);
+
+   mCacheMB = gPrefs->Read(wxT("/Database/CacheSizeMB"), -1L);
+   if (mCacheMB < 0)
+      mCacheMB = std::max(2LL, std::min(freeMB / 64, 64LL));
+}
+
+void DBConnection::MemoryConfig(sqlite3 *db, int cacheDivisor)
+{
+   const auto mmapMB = mMmapMB;
+   const auto cacheMB = std::max(1LL, mCacheMB / cacheDivisor);
+
+   // A negative cache size is in KiB rather than pages
+   wxString sql;
+   sql.Printf("PRAGMA main.mmap_size = %lld;"
+              "PRAGMA main.cache_size = -%lld;",
+              mmapMB * 1024 * 1024, cacheMB * 1024);
+
+   if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+      wxLogDebug(wxT("DBConnection::MemoryConfig - SQLITE error %s"),
+         sqlite3_errmsg(db));
+   else
+      wxLogDebug(wxT("Database memory map %lld MB, page cache %lld MB"),
+         mmapMB, cacheMB);
+}
+
+sqlite3 *DBConnection::ConnectionFor(bool readOnly)
+{
+   // Read-only connections see only committed data, so they can't be used
+   // while the main connection has a transaction open, in which reads might
+   // need to see uncommitted sample blocks.  (Blocks inserted outside of
+   // transactions are committed before their ids are known.)
+   if (!readOnly || !sqlite3_get_autocommit(mDB))
+      return mDB;
+
+   auto &pool = *mpReadPool;
+   std::lock_guard<std::mutex> guard(pool.mutex);
+
+   const auto id = std::this_thread::get_id();
+   auto iter = pool.dbs.find(id);
+   if (iter == pool.dbs.end())
+   {
+      // Reuse the connection of a thread that ended, else open another.
+      // Threads beyond the limit share the main connection.
+      sqlite3 *db = nullptr;
+      if (!pool.idle.empty())
+      {
+         db = pool.idle.back();
+         pool.idle.pop_back();
+      }
+      else if (pool.dbs.size() >= MaxReadConnections)
+         return mDB;
+      else
+         db = OpenReadConnection();
+      iter = pool.dbs.emplace(id, db).first;
+      ReleaseAtThreadExit(mpReadPool);
+   }
+
+   // Null for a thread whose connection failed to open
+   return iter->second ? iter->second : mDB;
+}
+
+void DBConnection::ReadPool::Release(std::thread::id id)
+{
+   std::lock_guard<std::mutex> guard(mutex);
+   auto iter = dbs.find(id);
+   if (iter == dbs.end())
+      return;
+
+   // Cached statements and blob handles belong to the thread, and can't pass
+   // to the next user of the connection
+   if (pOwner)
+      pOwner->ForgetThread(id);
+   if (iter->second)
+      idle.push_back(iter->second);
+   dbs.erase(iter);
+}
+
+void DBConnection::ReleaseAtThreadExit(const std::shared_ptr<ReadPool> &pPool)
+{
+   // Destroyed when the thread ends; the pools of closed connections are
+   // gone by then, and are skipped
+   struct Releaser
+   {
+      std::vector<std::weak_ptr<ReadPool>> pools;
+      ~Releaser()
+      {
+         const auto id = std::this_thread::get_id();
+         for (auto &wPool : pools)
+            if (auto pPool = wPool.lock())
+               pPool->Release(id);
+      }
+   };
+   static thread_local Releaser releaser;
+
+   auto &pools = releaser.pools;
+   pools.erase(std::remove_if(pools.begin(), pools.end(),
+      [](const std::weak_ptr<ReadPool> &wPool){ return wPool.expired(); }),
+      pools.end());
+   pools.push_back(pPool);
+}
+
+void DBConnection::ForgetThread(std::thread::id id)
+{
+   {
+      std::lock_guard<std::mutex> guard(mStatementMutex);
+      for (auto iter = mStatements.begin(); iter != mStatements.end();)
+      {
+         if (std::get<1>(iter->first) == id)
+         {
+            sqlite3_finalize(iter->second);
+            iter = mStatements.erase(iter);
+         }
+         else
+            ++iter;
+      }
+   }
+   mBlobCache.ForgetThread(id);
+}
+
+sqlite3 *DBConnection::OpenReadConnection()
+{
+   sqlite3 *db = nullptr;
+   int rc = sqlite3_open_v2(sqlite3_db_filename(mDB, "main"), &db,
+                            SQLITE_OPEN_READONLY, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      wxLogDebug(wxT("DBConnection::OpenReadConnection - SQLITE error %s"),
+         sqlite3_errmsg(db));
+      sqlite3_close(db);
+      return nullptr;
+   }
+
+   // Share the page cache budget among several readers; the memory map is
+   // of the same file and costs no more
+   MemoryConfig(db, 4);
+   return db;
+}
+
+void DBConnection::AddWaitTime(
+   sqlite3 *db, std::chrono::steady_clock::time_point start)
+{
+   // Take and release SQLite's lock as the next step or read will
+   if (auto mutex = sqlite3_db_mutex(db))
+   {
+      sqlite3_mutex_enter(mutex);
+      sqlite3_mutex_leave(mutex);
+   }
+
+   mWaitNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+std::chrono::nanoseconds DBConnection::GetWaitTime() const
+{
+   return std::chrono::nanoseconds{ mWaitNanoseconds.load() };
+}
+
+bool DBConnection::RequireVersion(int version)
+{
+   // Other threads may write meanwhile; hold the connection from the check
+   // through the change
+   const auto mutex = sqlite3_db_mutex(mDB);
+   sqlite3_mutex_enter(mutex);
+
+   int current = 0;
+   int rc = sqlite3_exec(mDB, "PRAGMA main.user_version;",
+      [](void *data, int cols, char **vals, char **) {
+         if (cols > 0 && vals[0])
+            *static_cast<int *>(data) = atoi(vals[0]);
+         return 0;
+      }, &current, nullptr);
+   if (rc == SQLITE_OK && current < version)
+   {
+      wxString sql;
+      sql.Printf("PRAGMA main.user_version = %d;", version);
+      rc = sqlite3_exec(mDB, sql, nullptr, nullptr, nullptr);
+      if (rc == SQLITE_OK)
+         wxLogMessage(wxT("Project file version raised to %08x"), version);
+   }
+   if (rc != SQLITE_OK)
+      wxLogDebug(wxT("DBConnection::RequireVersion - SQLITE error %s"),
+         sqlite3_errmsg(mDB));
+
+   sqlite3_mutex_leave(mutex);
+   return rc == SQLITE_OK;
+}
+
 sqlite3 *DBConnection::DB()
 {
    wxASSERT(mDB != nullptr);
@@ -283,14 +560,56 @@ const wxString DBConnection::GetLastMessage() const
 }
 
 sqlite3_stmt *DBConnection::Prepare(enum StatementID id, const char *sql)
+{
+   int rc;
+   auto stmt = TryPrepare(id, sql, rc);
+   if (!stmt)
+      THROW_INCONSISTENCY_EXCEPTION;
+   return stmt;
+}
+
+sqlite3_stmt *DBConnection::TryPrepare(
+   enum StatementID id, const char *sql, int &rc)
+{
+   const auto start = std::chrono::steady_clock::now();
+
+   bool readOnly = false;
+   switch (id)
+   {
+   case GetSamples:
+   case GetSummary256:
+   case GetSummary64k:
+   case GetSummary:
+   case LoadSampleBlock:
+   case GetTotalBlockBytes:
+      readOnly = true;
+      break;
+   default:
+      break;
+   }
+   const auto db = ConnectionFor(readOnly);
+
+   // A blob handle left open on a read-only connection holds a read
+   // transaction, and the statement would not see rows committed since
+   if (db != mDB)
+      mBlobCache.CloseForThread(db);
+
+   auto stmt = DoPrepare(id, sql, db, rc);
+   AddWaitTime(db, start);
+   return stmt;
+}
+
+sqlite3_stmt *DBConnection::DoPrepare(
+   enum StatementID id, const char *sql, sqlite3 *db, int &rc)
 {
    std::lock_guard<std::mutex> guard(mStatementMutex);
 
-   int rc;
+   rc = SQLITE_OK;
+
    // See bug 2673
    // We must not use the same prepared statement from two different threads.
    // Therefore, in the cache, use the thread id too.
-   StatementIndex ndx(id, std::this_thread::get_id());
+   StatementIndex ndx(id, std::this_thread::get_id(), db);
 
    // Return an existing statement if it's already been prepared
    auto iter = mStatements.find(ndx);
@@ -301,23 +620,19 @@ sqlite3_stmt *DBConnection::Prepare(enum StatementID id, const char *sql)
 
    // Prepare the statement
    sqlite3_stmt *stmt = nullptr;
-   rc = sqlite3_prepare_v3(mDB, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0);
+   rc = sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0);
    if (rc != SQLITE_OK)
    {
-      wxLogMessage("prepare error %s", sqlite3_errmsg(mDB));
-      THROW_INCONSISTENCY_EXCEPTION;
+      wxLogMessage("prepare error %s", sqlite3_errmsg(db));
+      return nullptr;
    }
 
    // There are a small number (10 or so) of different id's corresponding 
    // to different SQL statements, see enum StatementID
    // We have relatively few threads running at any one time,
    // e.g. main gui thread, a playback thread, a thread for compacting.
-   // However the cache might keep growing, as we start/stop audio,
-   // perhaps, if we chose to use a new thread each time.
-   // For 3.0.0 I think that's OK.  If it's a data leak it's a slow 
-   // enough one.  wxLogDebugs seem to show that the audio play thread
-   // is being reused, not recreated with a new ID, i.e. no leak at all.
-   // ANSWER-ME Just how serious is the data leak?  How best to fix?
+   // Statements of threads that took read connections are finalized when
+   // those threads end; see ForgetThread().
 
    // Remember the cached statement.
    mStatements.insert({ndx, stmt});
@@ -328,6 +643,30 @@ sqlite3_stmt *DBConnection::Prepare(enum StatementID id, const char *sql)
    return stmt;
 }
 
+bool DBConnection::ReadBlob(enum BlobID id,
+   const char *table, const char *column,
+   long long rowid, void *dest, size_t offset, size_t &bytes)
+{
+   const auto start = std::chrono::steady_clock::now();
+   const auto db = ConnectionFor(true);
+   AddWaitTime(db, start);
+
+   const int rc =
+      mBlobCache.Read(id, db, table, column, rowid, dest, offset, bytes);
+   if (rc != SQLITE_OK)
+   {
+      wxLogDebug(wxT("DBConnection::ReadBlob - SQLITE error %s"),
+         sqlite3_errmsg(db));
+      return false;
+   }
+   return true;
+}
+
+void DBConnection::CloseBlobs()
+{
+   mBlobCache.CloseAll();
+}
+
 void DBConnection::CheckpointThread()
 {
    // Open another connection to the DB to prevent blocking the main thread.
@@ -364,6 +703,10 @@ void DBConnection::CheckpointThread()
             mCheckpointPending = false;
          }
 
+         // Readers' cached blob handles would keep the log from being
+         // reset; they reopen on demand
+         CloseBlobs();
+
          // And kick off the checkpoint. This may not checkpoint ALL frames
          // in the WAL.  They'll be gotten the next time around.
          int rc;
@@ -428,6 +771,13 @@ int DBConnection::CheckpointHook(void *data, sqlite3 *db, const char *schema, in
    // Get access to our object
    DBConnection *that = static_cast<DBConnection *>(data);
 
+   // Any commit but compaction's own postpones compaction
+   if (std::this_thread::get_id() != that->mCompactionThread.get_id())
+   {
+      that->mLastWrite =
+         std::chrono::steady_clock::now().time_since_epoch().count();
+   }
+
    // Queue the database pointer for our checkpoint thread to process
    std::lock_guard<std::mutex> guard(that->mCheckpointMutex);
    that->mCheckpointPending = true;
@@ -505,7 +855,9 @@ TransactionScope::TransactionScope(
    mName(name)
 {
    mInTrans = TransactionStart(mName);
-   if ( !mInTrans )
+   if ( mInTrans )
+      ++mConnection.mSavepointDepth;
+   else
       // To do, improve the message
       throw SimpleMessageBoxException( 
          XO("Database error.  Sorry, but we don't have more details."), 
@@ -527,6 +879,7 @@ TransactionScope::~TransactionScope()
          // Do not throw from a destructor!
          // This has to be a no-fail cleanup that does the best that it can.
       }
+      --mConnection.mSavepointDepth;
    }
 }
 
@@ -537,6 +890,8 @@ bool TransactionScope::Commit()
       THROW_INCONSISTENCY_EXCEPTION;
 
    mInTrans = !TransactionCommit(mName);
+   if ( !mInTrans )
+      --mConnection.mSavepointDepth;
 
    return mInTrans;
 }
@@ -569,3 +924,156 @@ const ConnectionPtr &ConnectionPtr::Get( const AudacityProject &project )
    return Get( const_cast< AudacityProject & >( project ) );
 }
 
+
+static long long GetPragma(sqlite3 *db, const char *sql)
+{
+   sqlite3_stmt *stmt = nullptr;
+   long long result = -1;
+
+   if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK &&
+       sqlite3_step(stmt) == SQLITE_ROW)
+   {
+      result = sqlite3_column_int64(stmt, 0);
+   }
+   sqlite3_finalize(stmt);
+
+   return result;
+}
+
+auto DBConnection::GetCompactionProgress() const -> CompactionProgress
+{
+   return { mFreePages.load(), mReclaimedPages.load(), mPageSize.load() };
+}
+
+bool DBConnection::IsIncremental()
+{
+   // 2 is INCREMENTAL
+   return GetPragma(mDB, "PRAGMA main.auto_vacuum;") == 2;
+}
+
+long long DBConnection::GetCompactionSlicePages()
+{
+   if (mPageSize <= 0)
+   {
+      mPageSize = GetPragma(mDB, "PRAGMA main.page_size;");
+   }
+
+   return std::max(1LL,
+      mCompactionSliceKB * 1024 / std::max(1LL, mPageSize.load()));
+}
+
+long long DBConnection::CompactSlice(long long pages)
+{
+   // This may be called from the compaction thread, so hold SQLite's own
+   // lock on the connection, which a transaction can't begin without
+   auto mutex = sqlite3_db_mutex(mDB);
+   if (!mutex)
+   {
+      // The library is not serialized; don't share the connection
+      return -1;
+   }
+
+   sqlite3_mutex_enter(mutex);
+   auto result = [&]() -> long long
+   {
+      // Never intrude on a transaction of the main thread
+      if (!sqlite3_get_autocommit(mDB))
+      {
+         return -1;
+      }
+
+      const auto before = GetPragma(mDB, "PRAGMA main.freelist_count;");
+      if (before <= 0)
+      {
+         mFreePages = std::max(0LL, before);
+         return before;
+      }
+
+      // Moves pages from the end of the file into free pages, then
+      // truncates the file
+      wxString sql;
+      sql.Printf("PRAGMA main.incremental_vacuum(%lld);",
+                 std::min(before, pages));
+      if (sqlite3_exec(mDB, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+      {
+         wxLogDebug(wxT("DBConnection::CompactSlice - SQLITE error %s"),
+            sqlite3_errmsg(mDB));
+         return -1;
+      }
+
+      const auto after = GetPragma(mDB, "PRAGMA main.freelist_count;");
+      if (after >= 0)
+      {
+         mReclaimedPages += before - after;
+         mFreePages = after;
+      }
+      return after;
+   }();
+   sqlite3_mutex_leave(mutex);
+
+   return result;
+}
+
+void DBConnection::CompactionThread()
+{
+   using namespace std::chrono;
+
+   // Compact only after the user has made no changes for a while, and pause
+   // between slices, so that compaction takes a limited share of the
+   // bandwidth of the device
+   const auto IdleDelay = seconds{ 2 };
+   const auto SliceInterval = milliseconds{ 250 };
+
+   // The time of the last write after which there were no free pages
+   auto exhausted = steady_clock::rep{ -1 };
+   bool checked = false;
+
+   while (true)
+   {
+      {
+         std::unique_lock<std::mutex> lock(mCompactionMutex);
+         mCompactionCondition.wait_for(lock, SliceInterval,
+                                       [&]
+                                       {
+                                          return mCompactionStop.load();
+                                       });
+
+         // Requested to stop, so bail
+         if (mCompactionStop)
+         {
+            break;
+         }
+      }
+
+      const auto lastWrite = mLastWrite.load();
+      if (lastWrite == exhausted ||
+          steady_clock::now().time_since_epoch() -
+             steady_clock::duration{ lastWrite } < IdleDelay)
+      {
+         continue;
+      }
+
+      // Files made before incremental compaction can't have it, until
+      // compacted by copying
+      if (!checked)
+      {
+         if (!IsIncremental())
+         {
+            break;
+         }
+         checked = true;
+      }
+
+      const auto reclaimed = mReclaimedPages.load();
+      const auto remaining = CompactSlice(GetCompactionSlicePages());
+      if (remaining == 0)
+      {
+         exhausted = lastWrite;
+         if (mReclaimedPages > reclaimed)
+         {
+            wxLogDebug(wxT("Compaction reclaimed %lld pages of %lld bytes"),
+               mReclaimedPages.load(), mPageSize.load());
+         }
+      }
+   }
+}
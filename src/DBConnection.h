@@ -13,14 +13,17 @@ Paul Licameli -- split from ProjectFileIO.h
 #define __AUDACITY_DB_CONNECTION__
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <tuple>
 
 #include "ClientData.h"
+#include "SqliteBlobCache.h"
 
 struct sqlite3;
 struct sqlite3_stmt;
@@ -72,13 +75,78 @@ public:
       GetSamples,
       GetSummary256,
       GetSummary64k,
+      GetSummary,
+      InsertSummary,
+      DeleteSummaries,
       LoadSampleBlock,
       InsertSampleBlock,
+      UpdateSampleBlockSummary,
       DeleteSampleBlock,
       GetRootPage,
-      GetDBPage
+      GetDBPage,
+      GetTotalBlockBytes
    };
+   //! Get a statement prepared for the calling thread
+   /*! Statements that only read may be prepared on a read-only connection
+       of the calling thread's own, when the main connection has no
+       transaction open */
    sqlite3_stmt *Prepare(enum StatementID id, const char *sql);
+   //! Like Prepare(), but return null and the SQLite error code for failure
+   //! instead of throwing
+   sqlite3_stmt *TryPrepare(enum StatementID id, const char *sql, int &rc);
+
+   enum BlobID
+   {
+      SamplesBlob
+   };
+   //! Read part of a blob without reading the rest of it
+   /*! Uses an incremental I/O handle cached for the calling thread, moved to
+       the given row as needed.  Reads that extend past the end of the blob
+       are shortened.  The handle is closed when the thread next prepares a
+       statement on the same read-only connection, so that the statement
+       sees what was committed meanwhile.
+       @param bytes in: bytes wanted; out: bytes read
+       @return false for failure, such as a missing row */
+   bool ReadBlob(enum BlobID id, const char *table, const char *column,
+      long long rowid, void *dest, size_t offset, size_t &bytes);
+   //! Close the cached blob handles
+   /*! Open handles keep read transactions open, which prevents resetting of
+       the write-ahead log and detaching of databases */
+   void CloseBlobs();
+
+   //! Total time that threads have waited for locks to use connections
+   std::chrono::nanoseconds GetWaitTime() const;
+
+   //! Raise the version in the header of the file, if it is lower
+   /*! Call it in the transaction that first writes anything that builds
+       reading only older versions would misread, so that both persist or
+       neither does
+       @return false for failure */
+   bool RequireVersion(int version);
+
+   //! How many TransactionScopes are open on the main connection
+   int GetSavepointDepth() const { return mSavepointDepth; }
+
+   struct CompactionProgress
+   {
+      long long freePages{ 0 };      //!< Unused pages last seen in the file
+      long long reclaimedPages{ 0 }; //!< Pages returned to the file system
+      long long pageSize{ 0 };
+   };
+   //! Progress of the incremental compaction of the file
+   /*! Files made with auto_vacuum = INCREMENTAL are compacted in place by a
+       background thread, in slices of limited size, while the project is
+       otherwise idle */
+   CompactionProgress GetCompactionProgress() const;
+   //! Whether free pages can be reclaimed in place
+   bool IsIncremental();
+   //! Reclaim up to the given number of free pages at once, unless a
+   //! transaction is open
+   /*! @return the count of free pages that remain, or -1 if nothing could be
+       done */
+   long long CompactSlice(long long pages);
+   //! Limit on the pages reclaimed by each slice of background compaction
+   long long GetCompactionSlicePages();
 
    void SetBypass( bool bypass );
    bool ShouldBypass();
@@ -97,14 +165,53 @@ public:
 
 private:
    bool ModeConfig(sqlite3 *db, const char *schema, const char *config);
+   //! Choose sizes of memory mapping and the page cache; in the main thread
+   void ComputeMemorySizes();
+   //! Apply the sizes of memory mapping and the page cache, as computed
+   void MemoryConfig(sqlite3 *db, int cacheDivisor = 1);
+   //! Choose the connection for a statement or blob read, opening the
+   //! calling thread's read-only connection if needed
+   sqlite3 *ConnectionFor(bool readOnly);
+   sqlite3 *OpenReadConnection();
+   struct ReadPool;
+   //! Arrange for the calling thread to give back its read connection when
+   //! it ends
+   static void ReleaseAtThreadExit(const std::shared_ptr<ReadPool> &pPool);
+   //! Finalize the cached statements and close the blob handles of a thread
+   //! that has ended
+   void ForgetThread(std::thread::id id);
+   sqlite3_stmt *DoPrepare(enum StatementID id, const char *sql, sqlite3 *db,
+      int &rc);
+   //! Add the time since start to the waiting time, including any wait for
+   //! SQLite's own lock on the connection
+   void AddWaitTime(sqlite3 *db, std::chrono::steady_clock::time_point start);
 
    void CheckpointThread();
    static int CheckpointHook(void *data, sqlite3 *db, const char *schema, int pages);
 
+   void CompactionThread();
+
 private:
    std::weak_ptr<AudacityProject> mpProject;
    sqlite3 *mDB;
 
+   //! Connections that serve reads, one for each reading thread, so that
+   //! reads need not wait for each other or for writes in progress on mDB;
+   //! they see only committed data.  Shared with the threads that use them,
+   //! which give them back when they end.
+   enum { MaxReadConnections = 8 };
+   std::shared_ptr<ReadPool> mpReadPool;
+
+   //! Computed at Open(), because preferences may be read only in the main
+   //! thread
+   long long mMmapMB{ 0 };
+   long long mCacheMB{ 0 };
+
+   std::atomic<long long> mWaitNanoseconds{ 0 };
+
+   friend class TransactionScope;
+   std::atomic<int> mSavepointDepth{ 0 };
+
    std::thread mCheckpointThread;
    std::condition_variable mCheckpointCondition;
    std::mutex mCheckpointMutex;
@@ -112,10 +219,25 @@ private:
    std::atomic_bool mCheckpointPending{ false };
    std::atomic_bool mCheckpointActive{ false };
 
+   std::thread mCompactionThread;
+   std::condition_variable mCompactionCondition;
+   std::mutex mCompactionMutex;
+   std::atomic_bool mCompactionStop{ false };
+   //! When the main connection last committed anything but compaction
+   std::atomic<std::chrono::steady_clock::rep> mLastWrite{ 0 };
+   std::atomic<long long> mFreePages{ 0 };
+   std::atomic<long long> mReclaimedPages{ 0 };
+   std::atomic<long long> mPageSize{ 0 };
+   enum : long { DefaultCompactionSliceKB = 2048 };
+   long long mCompactionSliceKB{ DefaultCompactionSliceKB };
+
    std::mutex mStatementMutex;
-   using StatementIndex = std::pair<enum StatementID, std::thread::id>;
+   using StatementIndex =
+      std::tuple<enum StatementID, std::thread::id, sqlite3 *>;
    std::map<StatementIndex, sqlite3_stmt *> mStatements;
 
+   SqliteBlobCache mBlobCache;
+
    std::shared_ptr<DBConnectionErrors> mpErrors;
    CheckpointFailureCallback mCallback;
 
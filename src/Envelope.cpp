@@ -266,6 +266,25 @@ Envelope::Envelope(const Envelope &orig)
    CopyRange(orig, 0, orig.GetNumberOfPoints());
 }
 
+bool Envelope::IsSameAs(const Envelope &other) const
+{
+   if (mDB != other.mDB ||
+       mMinValue != other.mMinValue ||
+       mMaxValue != other.mMaxValue ||
+       mDefaultValue != other.mDefaultValue ||
+       mOffset != other.mOffset ||
+       mTrackLen != other.mTrackLen ||
+       mEnv.size() != other.mEnv.size())
+      return false;
+
+   for (size_t ii = 0, count = mEnv.size(); ii < count; ++ii)
+      if (mEnv[ii].GetT() != other.mEnv[ii].GetT() ||
+          mEnv[ii].GetVal() != other.mEnv[ii].GetVal())
+         return false;
+
+   return true;
+}
+
 void Envelope::CopyRange(const Envelope &orig, size_t begin, size_t end)
 {
    size_t len = orig.mEnv.size();
@@ -847,24 +866,27 @@ void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
 {
    // Optimizations for the usual pattern of repeated calls with
    // small increases of t.
+   // Mixers on several threads may share an envelope, so read the guess once
    {
-      if (mSearchGuess >= 0 && mSearchGuess < (int)mEnv.size()) {
-         if (t >= mEnv[mSearchGuess].GetT() &&
-             (1 + mSearchGuess == (int)mEnv.size() ||
-              t < mEnv[1 + mSearchGuess].GetT())) {
-            Lo = mSearchGuess;
-            Hi = 1 + mSearchGuess;
+      int guess = mSearchGuess.load(std::memory_order_relaxed);
+      if (guess >= 0 && guess < (int)mEnv.size()) {
+         if (t >= mEnv[guess].GetT() &&
+             (1 + guess == (int)mEnv.size() ||
+              t < mEnv[1 + guess].GetT())) {
+            Lo = guess;
+            Hi = 1 + guess;
             return;
          }
       }
 
-      ++mSearchGuess;
-      if (mSearchGuess >= 0 && mSearchGuess < (int)mEnv.size()) {
-         if (t >= mEnv[mSearchGuess].GetT() &&
-             (1 + mSearchGuess == (int)mEnv.size() ||
-              t < mEnv[1 + mSearchGuess].GetT())) {
-            Lo = mSearchGuess;
-            Hi = 1 + mSearchGuess;
+      ++guess;
+      if (guess >= 0 && guess < (int)mEnv.size()) {
+         if (t >= mEnv[guess].GetT() &&
+             (1 + guess == (int)mEnv.size() ||
+              t < mEnv[1 + guess].GetT())) {
+            mSearchGuess.store(guess, std::memory_order_relaxed);
+            Lo = guess;
+            Hi = 1 + guess;
             return;
          }
       }
@@ -884,7 +906,7 @@ void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
    }
    wxASSERT( Hi == ( Lo+1 ));
 
-   mSearchGuess = Lo;
+   mSearchGuess.store(Lo, std::memory_order_relaxed);
 }
 
 // relative time
@@ -906,7 +928,7 @@ void Envelope::BinarySearchForTime_LeftLimit( int &Lo, int &Hi, double t ) const
    }
    wxASSERT( Hi == ( Lo+1 ));
 
-   mSearchGuess = Lo;
+   mSearchGuess.store(Lo, std::memory_order_relaxed);
 }
 
 /// GetInterpolationStartValueAtPoint() is used to select either the
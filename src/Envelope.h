@@ -13,6 +13,7 @@
 
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include "xml/XMLTagHandler.h"
@@ -78,6 +79,9 @@ public:
    // Create from a subrange of another envelope.
    Envelope(const Envelope &orig, double t0, double t1);
 
+   //! Whether a copy of this envelope would be the same as other
+   bool IsSameAs(const Envelope &other) const;
+
    void Initialize(int numPoints);
 
    virtual ~Envelope();
@@ -260,7 +264,8 @@ private:
    bool mDragPointValid { false };
    int mDragPoint { -1 };
 
-   mutable int mSearchGuess { -2 };
+   //! Hint for the next search; atomic, because threads may share envelopes
+   mutable std::atomic<int> mSearchGuess { -2 };
 };
 
 inline void EnvPoint::SetVal( Envelope *pEnvelope, double val )
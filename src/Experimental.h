@@ -178,6 +178,11 @@
 // Define to include the effects rack (such as it is).
 //#define EXPERIMENTAL_EFFECTS_RACK
 
+// Define to fail an assertion whenever the audio callback, or the realtime
+// effect chain, allocates or frees memory.  For debugging only:  it replaces
+// the global operator new and operator delete.
+//#define EXPERIMENTAL_REALTIME_ALLOCATION_CHECK
+
 // Define to make the meters look like a row of LEDs
 //#define EXPERIMENTAL_METER_LED_STYLE
 
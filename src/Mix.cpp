@@ -31,6 +31,7 @@
 #include <wx/intl.h>
 
 #include "Envelope.h"
+#include "MixKernels.h"
 #include "WaveTrack.h"
 #include "Prefs.h"
 #include "Resample.h"
@@ -383,10 +384,8 @@ void MixBuffers(unsigned numChannels, int *channelFlags, float *gains,
       float gain = gains[c];
       float *dest = (float *)destPtr;
       float *temp = (float *)src;
-      for (int j = 0; j < len; j++) {
-         *dest += temp[j] * gain;   // the actual mixing process
-         dest += skip;
-      }
+      // the actual mixing process
+      MixKernels::ScaleAccumulate(dest, skip, temp, len, gain);
    }
 }
 
@@ -485,9 +484,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
                *pos += getLen;
             }
 
-            for (decltype(getLen) i = 0; i < getLen; i++) {
-               queue[(*queueLen) + i] *= mEnvValues[i];
-            }
+            MixKernels::Multiply(&queue[*queueLen], mEnvValues.get(), getLen);
 
             if (backwards)
                ReverseSamples((samplePtr)&queue[0], floatSample,
@@ -595,8 +592,8 @@ size_t Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
       else
          memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
       track->GetEnvelopeValues(mEnvValues.get(), slen, t - (slen - 1) / mRate);
-      for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+      // Track gain control will go here?
+      MixKernels::Multiply(mFloatBuffer.get(), mEnvValues.get(), slen);
       ReverseSamples((samplePtr)mFloatBuffer.get(), floatSample, 0, slen);
 
       *pos -= slen;
@@ -608,8 +605,8 @@ size_t Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
       else
          memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
       track->GetEnvelopeValues(mEnvValues.get(), slen, t);
-      for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+      // Track gain control will go here?
+      MixKernels::Multiply(mFloatBuffer.get(), mEnvValues.get(), slen);
 
       *pos += slen;
    }
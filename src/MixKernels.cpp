@@ -0,0 +1,437 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file MixKernels.cpp
+@brief Implements MixKernels with SSE2 and AVX2 kernels on x86
+
+**********************************************************************/
+
+#include "MixKernels.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "CpuFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#define MIX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// GCC and clang compile intrinsics of instruction sets beyond the baseline
+// only in functions so marked; the functions are called only when the
+// machine has them
+#if defined(__GNUC__)
+#define MIX_KERNELS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MIX_KERNELS_TARGET(isa)
+#endif
+
+namespace {
+
+void ScaleScalar(float *buffer, size_t len, float gain)
+{
+   for (size_t ii = 0; ii < len; ++ii)
+      buffer[ii] *= gain;
+}
+
+void MultiplyScalar(float *buffer, const float *envelope, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii)
+      buffer[ii] *= envelope[ii];
+}
+
+void ScaleAccumulateScalar(float *dst, size_t stride,
+   const float *src, size_t len, float gain)
+{
+   for (size_t ii = 0; ii < len; ++ii)
+      dst[ii * stride] += gain * src[ii];
+}
+
+void RampAccumulateScalar(float *dst, size_t stride,
+   const float *src, size_t len, float gain, float delta)
+{
+   for (size_t ii = 0; ii < len; ++ii)
+      dst[ii * stride] += (gain + delta * ii) * src[ii];
+}
+
+void InterleaveScalar(float *dst, size_t stride, const float *src, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii)
+      dst[ii * stride] = src[ii];
+}
+
+void DeinterleaveScalar(float *dst, const float *src, size_t stride, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii)
+      dst[ii] = src[ii * stride];
+}
+
+void ClampScalar(float *buffer, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii) {
+      const float v = buffer[ii];
+      buffer[ii] = v < -1.0f ? -1.0f : v > 1.0f ? 1.0f : v;
+   }
+}
+
+#ifdef MIX_KERNELS_X86
+
+// Interleaved loops with stride two touch one more sample past the last of
+// the channel, so they stop one group early and leave the rest to the
+// scalar loop; group is a power of two
+size_t WholeStrided(size_t len, size_t group)
+{
+   return len > group ? (len - 1) & ~(group - 1) : 0;
+}
+
+MIX_KERNELS_TARGET("sse2")
+void ScaleSSE2(float *buffer, size_t len, float gain)
+{
+   const size_t whole = len & ~size_t(3);
+   const __m128 g = _mm_set1_ps(gain);
+   for (size_t ii = 0; ii < whole; ii += 4)
+      _mm_storeu_ps(buffer + ii, _mm_mul_ps(_mm_loadu_ps(buffer + ii), g));
+   ScaleScalar(buffer + whole, len - whole, gain);
+}
+
+MIX_KERNELS_TARGET("sse2")
+void MultiplySSE2(float *buffer, const float *envelope, size_t len)
+{
+   const size_t whole = len & ~size_t(3);
+   for (size_t ii = 0; ii < whole; ii += 4)
+      _mm_storeu_ps(buffer + ii, _mm_mul_ps(
+         _mm_loadu_ps(buffer + ii), _mm_loadu_ps(envelope + ii)));
+   MultiplyScalar(buffer + whole, envelope + whole, len - whole);
+}
+
+// Add four products to every other sample of dst, adding -0 to the samples
+// between, which leaves them unchanged
+MIX_KERNELS_TARGET("sse2")
+inline void AccumulateStride2(float *dst, __m128 products)
+{
+   const __m128 zero = _mm_set1_ps(-0.0f);
+   _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst),
+      _mm_unpacklo_ps(products, zero)));
+   _mm_storeu_ps(dst + 4, _mm_add_ps(_mm_loadu_ps(dst + 4),
+      _mm_unpackhi_ps(products, zero)));
+}
+
+MIX_KERNELS_TARGET("sse2")
+void ScaleAccumulateSSE2(float *dst, size_t stride,
+   const float *src, size_t len, float gain)
+{
+   const __m128 g = _mm_set1_ps(gain);
+   size_t whole = 0;
+   if (stride == 1) {
+      whole = len & ~size_t(3);
+      for (size_t ii = 0; ii < whole; ii += 4)
+         _mm_storeu_ps(dst + ii, _mm_add_ps(_mm_loadu_ps(dst + ii),
+            _mm_mul_ps(g, _mm_loadu_ps(src + ii))));
+   }
+   else if (stride == 2) {
+      whole = WholeStrided(len, 4);
+      for (size_t ii = 0; ii < whole; ii += 4)
+         AccumulateStride2(dst + 2 * ii, _mm_mul_ps(g, _mm_loadu_ps(src + ii)));
+   }
+   ScaleAccumulateScalar(dst + whole * stride, stride,
+      src + whole, len - whole, gain);
+}
+
+MIX_KERNELS_TARGET("sse2")
+void RampAccumulateSSE2(float *dst, size_t stride,
+   const float *src, size_t len, float gain, float delta)
+{
+   size_t whole = 0;
+   if (stride == 1 || stride == 2) {
+      whole = stride == 1 ? len & ~size_t(3) : WholeStrided(len, 4);
+      // Indices are exact in single precision for any buffer of audio
+      __m128 indices = _mm_setr_ps(0, 1, 2, 3);
+      const __m128 four = _mm_set1_ps(4);
+      const __m128 g = _mm_set1_ps(gain), d = _mm_set1_ps(delta);
+      for (size_t ii = 0; ii < whole; ii += 4) {
+         const __m128 products = _mm_mul_ps(
+            _mm_add_ps(g, _mm_mul_ps(d, indices)), _mm_loadu_ps(src + ii));
+         if (stride == 1)
+            _mm_storeu_ps(dst + ii,
+               _mm_add_ps(_mm_loadu_ps(dst + ii), products));
+         else
+            AccumulateStride2(dst + 2 * ii, products);
+         indices = _mm_add_ps(indices, four);
+      }
+   }
+   for (size_t ii = whole; ii < len; ++ii)
+      dst[ii * stride] += (gain + delta * ii) * src[ii];
+}
+
+MIX_KERNELS_TARGET("sse2")
+void InterleaveSSE2(float *dst, size_t stride, const float *src, size_t len)
+{
+   size_t whole = 0;
+   if (stride == 2) {
+      whole = WholeStrided(len, 4);
+      const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0));
+      for (size_t ii = 0; ii < whole; ii += 4) {
+         const __m128 v = _mm_loadu_ps(src + ii);
+         float *const p = dst + 2 * ii;
+         _mm_storeu_ps(p, _mm_or_ps(_mm_and_ps(mask, _mm_unpacklo_ps(v, v)),
+            _mm_andnot_ps(mask, _mm_loadu_ps(p))));
+         _mm_storeu_ps(p + 4, _mm_or_ps(_mm_and_ps(mask, _mm_unpackhi_ps(v, v)),
+            _mm_andnot_ps(mask, _mm_loadu_ps(p + 4))));
+      }
+   }
+   InterleaveScalar(dst + whole * stride, stride, src + whole, len - whole);
+}
+
+MIX_KERNELS_TARGET("sse2")
+void DeinterleaveSSE2(float *dst, const float *src, size_t stride, size_t len)
+{
+   size_t whole = 0;
+   if (stride == 2) {
+      whole = WholeStrided(len, 4);
+      for (size_t ii = 0; ii < whole; ii += 4) {
+         const float *const p = src + 2 * ii;
+         _mm_storeu_ps(dst + ii, _mm_shuffle_ps(
+            _mm_loadu_ps(p), _mm_loadu_ps(p + 4), _MM_SHUFFLE(2, 0, 2, 0)));
+      }
+   }
+   DeinterleaveScalar(dst + whole, src + whole * stride, stride, len - whole);
+}
+
+// Note that _mm_min_ps(a, v) is v when v is NaN, as in the scalar loop
+
+MIX_KERNELS_TARGET("sse2")
+void ClampSSE2(float *buffer, size_t len)
+{
+   const size_t whole = len & ~size_t(3);
+   const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+   for (size_t ii = 0; ii < whole; ii += 4)
+      _mm_storeu_ps(buffer + ii,
+         _mm_max_ps(lo, _mm_min_ps(hi, _mm_loadu_ps(buffer + ii))));
+   ClampScalar(buffer + whole, len - whole);
+}
+
+// The AVX2 kernels widen the loops over contiguous and stereo samples, and
+// leave interleaving to SSE2, for which wider loads gain little
+
+// Add eight products to every other sample of dst, as AccumulateStride2
+// does; unpacking works within each half, which then are exchanged
+MIX_KERNELS_TARGET("avx2")
+inline void AccumulateStride2AVX2(float *dst, __m256 products)
+{
+   const __m256 zero = _mm256_set1_ps(-0.0f);
+   const __m256 lo = _mm256_unpacklo_ps(products, zero);
+   const __m256 hi = _mm256_unpackhi_ps(products, zero);
+   _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_loadu_ps(dst),
+      _mm256_permute2f128_ps(lo, hi, 0x20)));
+   _mm256_storeu_ps(dst + 8, _mm256_add_ps(_mm256_loadu_ps(dst + 8),
+      _mm256_permute2f128_ps(lo, hi, 0x31)));
+}
+
+MIX_KERNELS_TARGET("avx2")
+void ScaleAVX2(float *buffer, size_t len, float gain)
+{
+   const size_t whole = len & ~size_t(7);
+   const __m256 g = _mm256_set1_ps(gain);
+   for (size_t ii = 0; ii < whole; ii += 8)
+      _mm256_storeu_ps(buffer + ii,
+         _mm256_mul_ps(_mm256_loadu_ps(buffer + ii), g));
+   ScaleSSE2(buffer + whole, len - whole, gain);
+}
+
+MIX_KERNELS_TARGET("avx2")
+void MultiplyAVX2(float *buffer, const float *envelope, size_t len)
+{
+   const size_t whole = len & ~size_t(7);
+   for (size_t ii = 0; ii < whole; ii += 8)
+      _mm256_storeu_ps(buffer + ii, _mm256_mul_ps(
+         _mm256_loadu_ps(buffer + ii), _mm256_loadu_ps(envelope + ii)));
+   MultiplySSE2(buffer + whole, envelope + whole, len - whole);
+}
+
+MIX_KERNELS_TARGET("avx2")
+void ScaleAccumulateAVX2(float *dst, size_t stride,
+   const float *src, size_t len, float gain)
+{
+   const __m256 g = _mm256_set1_ps(gain);
+   size_t whole = 0;
+   if (stride == 1) {
+      whole = len & ~size_t(7);
+      for (size_t ii = 0; ii < whole; ii += 8)
+         _mm256_storeu_ps(dst + ii, _mm256_add_ps(_mm256_loadu_ps(dst + ii),
+            _mm256_mul_ps(g, _mm256_loadu_ps(src + ii))));
+   }
+   else if (stride == 2) {
+      whole = WholeStrided(len, 8);
+      for (size_t ii = 0; ii < whole; ii += 8)
+         AccumulateStride2AVX2(dst + 2 * ii,
+            _mm256_mul_ps(g, _mm256_loadu_ps(src + ii)));
+   }
+   ScaleAccumulateScalar(dst + whole * stride, stride,
+      src + whole, len - whole, gain);
+}
+
+MIX_KERNELS_TARGET("avx2")
+void RampAccumulateAVX2(float *dst, size_t stride,
+   const float *src, size_t len, float gain, float delta)
+{
+   size_t whole = 0;
+   if (stride == 1 || stride == 2) {
+      whole = stride == 1 ? len & ~size_t(7) : WholeStrided(len, 8);
+      __m256 indices = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+      const __m256 eight = _mm256_set1_ps(8);
+      const __m256 g = _mm256_set1_ps(gain), d = _mm256_set1_ps(delta);
+      for (size_t ii = 0; ii < whole; ii += 8) {
+         const __m256 products = _mm256_mul_ps(
+            _mm256_add_ps(g, _mm256_mul_ps(d, indices)),
+            _mm256_loadu_ps(src + ii));
+         if (stride == 1)
+            _mm256_storeu_ps(dst + ii,
+               _mm256_add_ps(_mm256_loadu_ps(dst + ii), products));
+         else
+            AccumulateStride2AVX2(dst + 2 * ii, products);
+         indices = _mm256_add_ps(indices, eight);
+      }
+   }
+   for (size_t ii = whole; ii < len; ++ii)
+      dst[ii * stride] += (gain + delta * ii) * src[ii];
+}
+
+MIX_KERNELS_TARGET("avx2")
+void ClampAVX2(float *buffer, size_t len)
+{
+   const size_t whole = len & ~size_t(7);
+   const __m256 lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+   for (size_t ii = 0; ii < whole; ii += 8)
+      _mm256_storeu_ps(buffer + ii,
+         _mm256_max_ps(lo, _mm256_min_ps(hi, _mm256_loadu_ps(buffer + ii))));
+   ClampSSE2(buffer + whole, len - whole);
+}
+
+#endif
+
+struct Kernels
+{
+   void (*scale)(float *, size_t, float);
+   void (*multiply)(float *, const float *, size_t);
+   void (*scaleAccumulate)(float *, size_t, const float *, size_t, float);
+   void (*rampAccumulate)(
+      float *, size_t, const float *, size_t, float, float);
+   void (*interleave)(float *, size_t, const float *, size_t);
+   void (*deinterleave)(float *, const float *, size_t, size_t);
+   void (*clamp)(float *, size_t);
+   const char *name;
+};
+
+const Kernels sKernels[MixKernels::nKernels] = {
+   { ScaleScalar, MultiplyScalar, ScaleAccumulateScalar, RampAccumulateScalar,
+     InterleaveScalar, DeinterleaveScalar, ClampScalar, "scalar" },
+#ifdef MIX_KERNELS_X86
+   { ScaleSSE2, MultiplySSE2, ScaleAccumulateSSE2, RampAccumulateSSE2,
+     InterleaveSSE2, DeinterleaveSSE2, ClampSSE2, "SSE2" },
+   { ScaleAVX2, MultiplyAVX2, ScaleAccumulateAVX2, RampAccumulateAVX2,
+     InterleaveSSE2, DeinterleaveSSE2, ClampAVX2, "AVX2" },
+#else
+   { ScaleScalar, MultiplyScalar, ScaleAccumulateScalar, RampAccumulateScalar,
+     InterleaveScalar, DeinterleaveScalar, ClampScalar, "SSE2" },
+   { ScaleScalar, MultiplyScalar, ScaleAccumulateScalar, RampAccumulateScalar,
+     InterleaveScalar, DeinterleaveScalar, ClampScalar, "AVX2" },
+#endif
+};
+
+MixKernels::Kernel BestKernel()
+{
+   for (auto kernel : { MixKernels::AVX2, MixKernels::SSE2 })
+      if (MixKernels::IsAvailable(kernel))
+         return kernel;
+   return MixKernels::Scalar;
+}
+
+std::atomic<const Kernels *> &CurrentKernels()
+{
+   static std::atomic<const Kernels *> sCurrent{ &sKernels[BestKernel()] };
+   return sCurrent;
+}
+
+const Kernels &Current()
+{
+   return *CurrentKernels().load(std::memory_order_relaxed);
+}
+
+}
+
+namespace MixKernels
+{
+
+bool IsAvailable(Kernel kernel)
+{
+   switch (kernel) {
+   case Scalar:
+      return true;
+#ifdef MIX_KERNELS_X86
+   case SSE2:
+      return CpuFeatures::HasSSE2();
+   case AVX2:
+      return CpuFeatures::HasSSE2() && CpuFeatures::HasAVX2();
+#endif
+   default:
+      return false;
+   }
+}
+
+const char *GetName(Kernel kernel)
+{
+   return sKernels[kernel].name;
+}
+
+Kernel GetKernel()
+{
+   return static_cast<Kernel>(&Current() - sKernels);
+}
+
+void SetKernel(Kernel kernel)
+{
+   if (IsAvailable(kernel))
+      CurrentKernels().store(&sKernels[kernel], std::memory_order_relaxed);
+}
+
+void Scale(float *buffer, size_t len, float gain)
+{
+   Current().scale(buffer, len, gain);
+}
+
+void Multiply(float *buffer, const float *envelope, size_t len)
+{
+   Current().multiply(buffer, envelope, len);
+}
+
+void ScaleAccumulate(float *dst, size_t stride,
+   const float *src, size_t len, float gain)
+{
+   Current().scaleAccumulate(dst, stride, src, len, gain);
+}
+
+void RampAccumulate(float *dst, size_t stride,
+   const float *src, size_t len, float gain, float delta)
+{
+   Current().rampAccumulate(dst, stride, src, len, gain, delta);
+}
+
+void Interleave(float *dst, size_t stride, const float *src, size_t len)
+{
+   Current().interleave(dst, stride, src, len);
+}
+
+void Deinterleave(float *dst, const float *src, size_t stride, size_t len)
+{
+   Current().deinterleave(dst, src, stride, len);
+}
+
+void Clamp(float *buffer, size_t len)
+{
+   Current().clamp(buffer, len);
+}
+
+}
@@ -0,0 +1,66 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file MixKernels.h
+@brief Gain, envelope and interleaving loops over float samples, for mixing
+
+**********************************************************************/
+
+#ifndef __AUDACITY_MIX_KERNELS__
+#define __AUDACITY_MIX_KERNELS__
+
+#include <cstddef>
+
+//! Primitives of mixing, as in the audio callback and in Mixer
+/*! The kernel that does the work is chosen at run time for the instruction
+    sets of the machine.  Each computes exactly what the scalar loop in the
+    comment computes, one sample at a time, and leaves the other channels of
+    interleaved samples as they were.
+
+    A stride of one or two is fastest; two is common for stereo. */
+namespace MixKernels
+{
+   enum Kernel
+   {
+      Scalar,
+      SSE2,
+      AVX2,
+      nKernels
+   };
+
+   //! Whether this build and machine can run the kernel
+   bool IsAvailable(Kernel kernel);
+   const char *GetName(Kernel kernel);
+
+   //! The kernel in use, by default the best available
+   Kernel GetKernel();
+   //! Use another kernel, as for comparisons
+   /*! @pre IsAvailable(kernel) */
+   void SetKernel(Kernel kernel);
+
+   //! buffer[i] *= gain
+   void Scale(float *buffer, size_t len, float gain);
+
+   //! buffer[i] *= envelope[i]
+   void Multiply(float *buffer, const float *envelope, size_t len);
+
+   //! dst[i * stride] += gain * src[i]
+   void ScaleAccumulate(float *dst, size_t stride,
+      const float *src, size_t len, float gain);
+
+   //! dst[i * stride] += (gain + delta * i) * src[i]
+   void RampAccumulate(float *dst, size_t stride,
+      const float *src, size_t len, float gain, float delta);
+
+   //! dst[i * stride] = src[i]
+   void Interleave(float *dst, size_t stride, const float *src, size_t len);
+
+   //! dst[i] = src[i * stride]
+   void Deinterleave(float *dst, const float *src, size_t stride, size_t len);
+
+   //! Limit samples to -1.0..+1.0, leaving NaNs
+   void Clamp(float *buffer, size_t len);
+}
+
+#endif
@@ -11,6 +11,7 @@ Paul Licameli split from AudacityProject.cpp
 #include "ProjectFileIO.h"
 
 #include <atomic>
+#include <deque>
 #include <sqlite3.h>
 #include <wx/crt.h>
 #include <wx/frame.h>
@@ -28,13 +29,13 @@ Paul Licameli split from AudacityProject.cpp
 #include "Tags.h"
 #include "TempDirectory.h"
 #include "ViewInfo.h"
+#include "WaveClip.h"
 #include "WaveTrack.h"
 #include "widgets/AudacityMessageBox.h"
 #include "widgets/ErrorDialog.h"
 #include "widgets/NumericTextCtrl.h"
 #include "widgets/ProgressDialog.h"
 #include "wxFileNameWrapper.h"
-#include "xml/XMLFileReader.h"
 
 #undef NO_SHM
 #if !defined(__WXMSW__)
@@ -70,7 +71,14 @@ static const int ProjectFileID = PACK('A', 'U', 'D', 'Y');
 // Note that this is NOT the "schema_version" that SQLite maintains. The value
 // specified here is stored in the "user_version" field of the SQLite database
 // header.
-static const int ProjectFileVersion = PACK(3, 0, 0, 0);
+//
+// New files get the base version, which every 3.0 build reads.  A file is
+// raised to ProjectFileVersion only when it first uses a feature that older
+// builds would misread; see ExtensionsVersion.
+static const int BaseProjectFileVersion = PACK(3, 0, 0, 0);
+static const int ProjectFileVersion = PACK(3, 1, 0, 0);
+
+const int ProjectFileIO::ExtensionsVersion = ProjectFileVersion;
 
 // Navigation:
 //
@@ -85,6 +93,11 @@ static const char *ProjectFileSchema =
    //
    // See the CMakeList.txt for the SQLite lib for more
    // settings.
+   //
+   // auto_vacuum must come first, before anything writes the file.  It lets
+   // free pages be returned to the file system in place, a few at a time,
+   // rather than by copying the whole database.
+   "PRAGMA <schema>.auto_vacuum = INCREMENTAL;"
    "PRAGMA <schema>.application_id = %d;"
    "PRAGMA <schema>.user_version = %d;"
    ""
@@ -120,6 +133,11 @@ static const char *ProjectFileSchema =
    // There is no limit to document blob size.
    // dict will be smallish, with an entry for each 
    // kind of field.
+   //
+   // Incremental autosaves instead write the row with id 2, in which doc is
+   // not XML, but the list of the 64 bit hashes of the fragments in
+   // autosavefragments that make up the document, in order.  Files with
+   // that row have at least ProjectFileIO::ExtensionsVersion.
    "CREATE TABLE IF NOT EXISTS <schema>.autosave"
    "("
    "  id                   INTEGER PRIMARY KEY,"
@@ -127,6 +145,18 @@ static const char *ProjectFileSchema =
    "  doc                  BLOB"
    ");"
    ""
+   // CREATE SQL autosavefragments
+   // Pieces of the binary autosave document, using the dictionary of the
+   // autosave row with id 2:  the start of the project, each clip of each
+   // wave track, the rest of each track, and the end.  hash is computed from
+   // doc, so a fragment is written only when its contents change; rows no
+   // longer listed by the autosave row are deleted.
+   "CREATE TABLE IF NOT EXISTS <schema>.autosavefragments"
+   "("
+   "  hash                 INTEGER PRIMARY KEY,"
+   "  doc                  BLOB"
+   ");"
+   ""
    // CREATE SQL sampleblocks
    // 'samples' are fixed size blocks of int16, int32 or float32 numbers.
    // The blocks may be partially empty.
@@ -134,11 +164,18 @@ static const char *ProjectFileSchema =
    // provided in the project blob.
    // 
    // sampleformat specifies the format of the samples stored.
+   // Its low 24 bits are the sampleFormat.  If the next 8 bits are nonzero,
+   // they identify a SampleBlockCodec that compressed 'samples', and then
+   // bits 32 to 63 give the number of samples.  Uncompressed rows are as
+   // they always were.
    //
    // blockID is a 64 bit number.
    //
    // Rows are immutable -- never updated after addition, but may be
-   // deleted.
+   // deleted.  The one exception:  rows added in a batch, as by importing,
+   // may at first have null summin to summary64k, which are updated before
+   // the batch ends.  A row left so, as by a crash, is summarized again
+   // when loaded.
    //
    // summin to summary64K are summaries at 3 distance scales.
    "CREATE TABLE IF NOT EXISTS <schema>.sampleblocks"
@@ -151,6 +188,20 @@ static const char *ProjectFileSchema =
    "  summary256           BLOB,"
    "  summary64k           BLOB,"
    "  samples              BLOB"
+   ");"
+   ""
+   // CREATE SQL summaries
+   // Summaries of sample blocks at the levels of SummaryDivisors that
+   // sampleblocks lacks, each an array of min, max, rms float triples.
+   // They are derived data, added when first needed for display, and may
+   // be missing; rows are deleted with their blocks.  Files from before the
+   // table existed get it when summaries are first stored in them.
+   "CREATE TABLE IF NOT EXISTS <schema>.summaries"
+   "("
+   "  blockid              INTEGER,"
+   "  divisor              INTEGER,"
+   "  summary              BLOB,"
+   "  PRIMARY KEY (blockid, divisor)"
    ");";
 
 // This singleton handles initialization/shutdown of the SQLite library.
@@ -477,6 +528,14 @@ void ProjectFileIO::UseConnection(Connection &&conn, const FilePath &filePath)
    SetFileName(filePath);
 }
 
+// Project files from before incremental autosave lack this table
+static const char *AutoSaveFragmentsTable =
+   "CREATE TABLE IF NOT EXISTS autosavefragments"
+   "("
+   "  hash                 INTEGER PRIMARY KEY,"
+   "  doc                  BLOB"
+   ");";
+
 static int ExecCallback(void *data, int cols, char **vals, char **names)
 {
    auto &cb = *static_cast<const ProjectFileIO::ExecCB *>(data);
@@ -650,10 +709,12 @@ bool ProjectFileIO::CheckVersion()
    }
    
    // Project file is older than ours, ask the user if it's okay to
-   // upgrade.
-   if (version < ProjectFileVersion)
+   // upgrade.  Files of the base version need no upgrade to be read, and
+   // are raised only as they use newer features.
+   if (version < BaseProjectFileVersion)
    {
-      return UpgradeSchema();
+      if (!UpgradeSchema())
+         return false;
    }
 
    return true;
@@ -664,7 +725,7 @@ bool ProjectFileIO::InstallSchema(sqlite3 *db, const char *schema /* = "main" */
    int rc;
 
    wxString sql;
-   sql.Printf(ProjectFileSchema, ProjectFileID, ProjectFileVersion);
+   sql.Printf(ProjectFileSchema, ProjectFileID, BaseProjectFileVersion);
    sql.Replace("<schema>", schema);
 
    rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
@@ -676,6 +737,21 @@ bool ProjectFileIO::InstallSchema(sqlite3 *db, const char *schema /* = "main" */
       return false;
    }
 
+   // A database already in WAL mode has written its header, so auto_vacuum
+   // takes effect only after rebuilding, which is cheap while it's empty
+   wxString result;
+   sql.Printf("PRAGMA %s.auto_vacuum;", schema);
+   if (GetValue(sql, result) && result != wxT("2"))
+   {
+      sql.Printf("VACUUM %s;", schema);
+      if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+      {
+         // Not fatal; the file can still be compacted by copying
+         wxLogDebug(wxT("Unable to enable incremental vacuum: %s"),
+            sqlite3_errmsg(db));
+      }
+   }
+
    return true;
 }
 
@@ -761,6 +837,15 @@ bool ProjectFileIO::DeleteBlocks(const BlockIDs &blockids, bool complement)
 
    // Mark the project recovered if we deleted any rows
    int changes = sqlite3_changes(db);
+
+   // Also delete summaries of the deleted blocks; it doesn't matter if the
+   // table is missing
+   if (changes > 0)
+      sqlite3_exec(db,
+         "DELETE FROM summaries WHERE blockid NOT IN"
+         "  (SELECT blockid FROM sampleblocks);",
+         nullptr, nullptr, nullptr);
+
    if (changes > 0)
    {
       wxLogInfo(XO("Total orphan blocks deleted %d").Translation(), changes);
@@ -814,6 +899,9 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
    WriteXMLHeader(doc);
    WriteXML(doc, false, tracks.empty() ? nullptr : tracks[0]);
 
+   // Pending reads would prevent detaching the destination afterwards
+   pConn->CloseBlobs();
+
    auto db = DB();
    Connection destConn = nullptr;
    bool success = false;
@@ -888,6 +976,23 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
       return false;
    }
 
+   // The copy may have compressed blocks, so keep any newer version
+   {
+      wxString version;
+      if (GetValue("PRAGMA main.user_version;", version) &&
+          wxStrtol<char **>(version, nullptr, 10) > BaseProjectFileVersion)
+      {
+         sql.Printf("PRAGMA outbound.user_version = %s;", version);
+         if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+         {
+            SetDBError(
+               XO("Unable to initialize the project file")
+            );
+            return false;
+         }
+      }
+   }
+
    {
       // Ensure statement gets cleaned up
       sqlite3_stmt *stmt = nullptr;
@@ -1246,6 +1351,14 @@ void ProjectFileIO::Compact(
    // at project close time will still occur.
    mHadUnused = true;
 
+   // Files that reclaim free pages incrementally are compacted in place,
+   // which costs little more than deleting the unused blocks
+   if ((force || !IsTemporary()) && GetConnection().IsIncremental())
+   {
+      mWasCompacted = CompactInPlace(tracks, force);
+      return;
+   }
+
    // If forcing compaction, bypass inspection.
    if (!force)
    {
@@ -1329,6 +1442,79 @@ void ProjectFileIO::Compact(
    return;
 }
 
+bool ProjectFileIO::CompactInPlace(
+   const std::vector<const TrackList *> &tracks, bool force)
+{
+   auto &conn = GetConnection();
+
+   // Delete the blocks that none of the tracks use; their pages become free.
+   // Without any tracks, there is nothing to tell which blocks are unused.
+   if (!tracks.empty())
+   {
+      SampleBlockIDSet active;
+      for (auto pTracks : tracks)
+         if (pTracks)
+            InspectBlocks( *pTracks, {}, &active );
+
+      // This isn't recovery of orphans, as in LoadProject()
+      const auto recovered = mRecovered;
+      const bool deleted = DeleteBlocks(active, true);
+      mRecovered = recovered;
+      if (!deleted)
+      {
+         return false;
+      }
+   }
+
+   if (!force)
+   {
+      // Closing:  the autosave document may use blocks of states that were
+      // not saved and were just deleted, so the file must reopen at its
+      // saved state.  Reclaim one slice of space; the background compaction
+      // reclaims the rest when the project is next open.
+      if (!AutoSaveDelete())
+      {
+         return false;
+      }
+
+      conn.CompactSlice(conn.GetCompactionSlicePages());
+      return true;
+   }
+
+   // Requested by the user, so reclaim everything now, showing progress
+   const auto slice = conn.GetCompactionSlicePages();
+   auto remaining = conn.CompactSlice(slice);
+   if (remaining < 0)
+   {
+      return false;
+   }
+
+   {
+      /* i18n-hint: This title appears on a dialog that indicates the progress
+         in doing something.*/
+      ProgressDialog progress(XO("Progress"), XO("Compacting project"),
+         pdlgHideStopButton);
+      const wxLongLong_t total = remaining;
+      while (remaining > 0)
+      {
+         remaining = conn.CompactSlice(slice);
+         if (remaining < 0)
+         {
+            return false;
+         }
+         progress.Update(total - remaining, total);
+      }
+   }
+
+   // Move the truncation of the file out of the write-ahead log, so that
+   // the file shrinks now
+   conn.CloseBlobs();
+   sqlite3_wal_checkpoint_v2(
+      DB(), nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+
+   return true;
+}
+
 bool ProjectFileIO::WasCompacted()
 {
    return mWasCompacted;
@@ -1478,6 +1664,11 @@ bool ProjectFileIO::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
          settings.SetSnapTo(wxString(value) == wxT("on") ? true : false);
       }
 
+      else if (!wxStrcmp(attr, wxT("compressblocks")))
+      {
+         settings.SetCompressSampleBlocks(wxString(value) == wxT("on"));
+      }
+
       else if (!wxStrcmp(attr, wxT("selectionformat")))
       {
          settings.SetSelectionFormat(
@@ -1594,15 +1785,29 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
                              bool recording /* = false */,
                              const TrackList *tracks /* = nullptr */)
 // may throw
+{
+   //TIMER_START( "AudacityProject::WriteXML", xml_writer_timer );
+
+   WriteXMLStart(xmlFile);
+
+   VisitTracksToSave(recording, tracks, [&](const Track &track)
+   {
+      track.WriteXML(xmlFile);
+   });
+
+   xmlFile.EndTag(wxT("project"));
+
+   //TIMER_STOP( xml_writer_timer );
+}
+
+void ProjectFileIO::WriteXMLStart(XMLWriter &xmlFile) const
+// may throw
 {
    auto &proj = mProject;
-   auto &tracklist = tracks ? *tracks : TrackList::Get(proj);
    auto &viewInfo = ViewInfo::Get(proj);
    auto &tags = Tags::Get(proj);
    const auto &settings = ProjectSettings::Get(proj);
 
-   //TIMER_START( "AudacityProject::WriteXML", xml_writer_timer );
-
    xmlFile.StartTag(wxT("project"));
    xmlFile.WriteAttr(wxT("xmlns"), wxT("http://audacity.sourceforge.net/xml/"));
 
@@ -1612,6 +1817,8 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
    viewInfo.WriteXMLAttributes(xmlFile);
    xmlFile.WriteAttr(wxT("rate"), settings.GetRate());
    xmlFile.WriteAttr(wxT("snapto"), settings.GetSnapTo() ? wxT("on") : wxT("off"));
+   if (settings.GetCompressSampleBlocks())
+      xmlFile.WriteAttr(wxT("compressblocks"), wxT("on"));
    xmlFile.WriteAttr(wxT("selectionformat"),
                      settings.GetSelectionFormat().Internal());
    xmlFile.WriteAttr(wxT("frequencyformat"),
@@ -1620,8 +1827,13 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
                      settings.GetBandwidthSelectionFormatName().Internal());
 
    tags.WriteXML(xmlFile);
+}
+
+void ProjectFileIO::VisitTracksToSave(bool recording, const TrackList *tracks,
+   const std::function<void(const Track &)> &visitor) const
+{
+   auto &tracklist = tracks ? *tracks : TrackList::Get(mProject);
 
-   unsigned int ndx = 0;
    tracklist.Any().Visit([&](const Track *t)
    {
       auto useTrack = t;
@@ -1639,22 +1851,108 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
          // when pushing.  Don't auto-save it.
          return;
       }
-      useTrack->WriteXML(xmlFile);
+      visitor(*useTrack);
    });
+}
 
-   xmlFile.EndTag(wxT("project"));
-
-   //TIMER_STOP( xml_writer_timer );
+// 64 bit FNV-1a; a collision among the fragments of one project is
+// vanishingly unlikely
+static long long HashFragment(const wxMemoryBuffer &buffer)
+{
+   unsigned long long hash = 14695981039346656037ULL;
+   auto bytes = static_cast<const unsigned char *>(buffer.GetData());
+   for (size_t ii = 0, len = buffer.GetDataLen(); ii < len; ++ii)
+   {
+      hash ^= bytes[ii];
+      hash *= 1099511628211ULL;
+   }
+   return static_cast<long long>(hash);
 }
 
 bool ProjectFileIO::AutoSave(bool recording)
 {
-   ProjectSerializer autosave;
-   WriteXMLHeader(autosave);
-   WriteXML(autosave, recording);
+   // Serialize the start of the project, each clip of each wave track, the
+   // rest of each track, and the end separately, so that only the fragments
+   // that changed since the last autosave need to be written.  The binary
+   // format has no nesting state, so the fragments may simply be
+   // concatenated when loading.
+   //
+   // Clips hold nearly all of the document.  An edit typically touches few
+   // of them, and recording grows only the recording clips; the others are
+   // found unchanged by comparison with copies that share their sample
+   // blocks, and neither serialized nor hashed again.
+   std::deque<ProjectSerializer> pieces;
+   std::vector<AutoSaveFragment> fragments;
+   decltype(mAutoSaveClips) clips;
+
+   auto endPiece = [&]
+   {
+      const wxMemoryBuffer &data = pieces.back().GetData();
+      if (data.GetDataLen() > 0)
+      {
+         fragments.push_back({ data, HashFragment(data) });
+      }
+   };
+
+   auto writeClip = [&](const WaveClip &clip) -> XMLWriter &
+   {
+      endPiece();
+
+      auto iter = mAutoSaveClips.find(&clip);
+      if (iter == mAutoSaveClips.end() ||
+          !iter->second.pCopy->IsSameAs(clip))
+      {
+         ProjectSerializer serializer(64 * 1024);
+         clip.WriteXML(serializer);
+         const wxMemoryBuffer &data = serializer.GetData();
+         iter = clips.emplace(&clip, AutoSaveClip{
+            std::make_unique<WaveClip>(
+               clip, clip.GetSequence()->GetFactory(), true),
+            { data, HashFragment(data) }
+         }).first;
+      }
+      else
+      {
+         iter = clips.emplace(std::move(*iter)).first;
+      }
+      fragments.push_back(iter->second.fragment);
+
+      pieces.emplace_back(1024);
+      return pieces.back();
+   };
+
+   pieces.emplace_back(4 * 1024);
+   WriteXMLHeader(pieces.back());
+   WriteXMLStart(pieces.back());
+   endPiece();
+
+   VisitTracksToSave(recording, nullptr, [&](const Track &track)
+   {
+      pieces.emplace_back(4 * 1024);
+      if (auto pWaveTrack = dynamic_cast<const WaveTrack *>(&track))
+      {
+         pWaveTrack->WriteXML(pieces.back(), writeClip);
+      }
+      else
+      {
+         track.WriteXML(pieces.back());
+      }
+      endPiece();
+   });
+
+   pieces.emplace_back(16);
+   pieces.back().EndTag(wxT("project"));
+   endPiece();
+
+   // Forget the clips that are gone, releasing their sample blocks
+   mAutoSaveClips.swap(clips);
 
-   if (WriteDoc("autosave", autosave))
+   if (WriteAutoSaveFragments(pieces.front().GetDict(), fragments))
    {
+      // Also store what drawing computed meanwhile
+      WaveTrackFactory::Get( mProject ).GetSampleBlockFactory()
+         ->StoreDeferred();
+
       mModified = true;
       return true;
    }
@@ -1671,7 +1969,11 @@ bool ProjectFileIO::AutoSaveDelete(sqlite3 *db /* = nullptr */)
       db = DB();
    }
 
-   rc = sqlite3_exec(db, "DELETE FROM autosave;", nullptr, nullptr, nullptr);
+   wxString sql = AutoSaveFragmentsTable;
+   sql += "DELETE FROM autosave;"
+          "DELETE FROM autosavefragments;";
+
+   rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
    if (rc != SQLITE_OK)
    {
       SetDBError(
@@ -1744,6 +2046,265 @@ bool ProjectFileIO::WriteDoc(const char *table,
    return true;
 }
 
+bool ProjectFileIO::WriteAutoSaveFragments(const wxMemoryBuffer &dict,
+   const std::vector<AutoSaveFragment> &fragments)
+{
+   auto db = DB();
+   int rc;
+
+   // All or nothing, so that the list never names a missing fragment
+   TransactionScope trans(GetConnection(), "AutoSave");
+
+   // Builds that know only the complete autosave document would not see
+   // these rows, and would open the project without recovering it; make them
+   // refuse the file instead
+   if (!GetConnection().RequireVersion(ExtensionsVersion))
+   {
+      SetDBError(
+         XO("Failed to update the project file.")
+      );
+      return false;
+   }
+
+   // Also remove any complete document written by an older version
+   wxString setup = AutoSaveFragmentsTable;
+   setup += "DELETE FROM autosave WHERE id = 1;";
+   rc = sqlite3_exec(db, setup, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Failed to update the project file.\nThe following command failed:\n\n%s").Format(setup)
+      );
+      return false;
+   }
+
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]
+   {
+      if (stmt)
+      {
+         sqlite3_finalize(stmt);
+      }
+   });
+
+   const char *sql = nullptr;
+   auto prepare = [&](const char *newsql)
+   {
+      if (stmt)
+      {
+         sqlite3_finalize(stmt);
+         stmt = nullptr;
+      }
+
+      sql = newsql;
+      rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+      if (rc != SQLITE_OK)
+      {
+         SetDBError(
+            XO("Unable to prepare project file command:\n\n%s").Format(sql)
+         );
+         return false;
+      }
+      return true;
+   };
+
+   auto failed = [&]
+   {
+      SetDBError(
+         XO("Failed to update the project file.\nThe following command failed:\n\n%s").Format(sql)
+      );
+      return false;
+   };
+
+   // Store the fragments not already present.  The hash depends only on the
+   // bytes, so a row that is already there holds exactly the same bytes.
+   if (!prepare("INSERT OR IGNORE INTO autosavefragments(hash, doc) VALUES(?1, ?2);"))
+   {
+      return false;
+   }
+
+   std::unordered_set<long long> current;
+   wxMemoryBuffer list;
+   for (const auto &fragment : fragments)
+   {
+      const wxMemoryBuffer &data = fragment.data;
+      const auto hash = fragment.hash;
+      current.insert(hash);
+      list.AppendData(&hash, sizeof(hash));
+
+      // Bind statement parameters
+      // Might return SQL_MISUSE which means it's our mistake that we violated
+      // preconditions; should return SQL_OK which is 0
+      if (sqlite3_bind_int64(stmt, 1, hash) ||
+          sqlite3_bind_blob(stmt, 2, data.GetData(), data.GetDataLen(), SQLITE_STATIC))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      rc = sqlite3_step(stmt);
+      if (rc != SQLITE_DONE)
+      {
+         return failed();
+      }
+
+      sqlite3_reset(stmt);
+   }
+
+   // Find the fragments that no longer belong to the document
+   if (!prepare("SELECT hash FROM autosavefragments;"))
+   {
+      return false;
+   }
+
+   std::vector<long long> stale;
+   while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+   {
+      const auto hash = sqlite3_column_int64(stmt, 0);
+      if (current.count(hash) == 0)
+      {
+         stale.push_back(hash);
+      }
+   }
+   if (rc != SQLITE_DONE)
+   {
+      return failed();
+   }
+
+   if (!prepare("DELETE FROM autosavefragments WHERE hash = ?1;"))
+   {
+      return false;
+   }
+
+   for (auto hash : stale)
+   {
+      if (sqlite3_bind_int64(stmt, 1, hash))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      rc = sqlite3_step(stmt);
+      if (rc != SQLITE_DONE)
+      {
+         return failed();
+      }
+
+      sqlite3_reset(stmt);
+   }
+
+   // Finally the dictionary and the list of fragments
+   if (!prepare("INSERT INTO autosave(id, dict, doc) VALUES(2, ?1, ?2)"
+                "       ON CONFLICT(id) DO UPDATE SET dict = ?1, doc = ?2;"))
+   {
+      return false;
+   }
+
+   if (sqlite3_bind_blob(stmt, 1, dict.GetData(), dict.GetDataLen(), SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 2, list.GetData(), list.GetDataLen(), SQLITE_STATIC))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   rc = sqlite3_step(stmt);
+   if (rc != SQLITE_DONE)
+   {
+      return failed();
+   }
+
+   trans.Commit();
+
+   return true;
+}
+
+bool ProjectFileIO::GetAutoSaveFragments(wxMemoryBuffer &buffer)
+{
+   auto db = DB();
+   int rc;
+
+   buffer.Clear();
+
+   wxString result;
+   if (!GetValue("SELECT Count(*) FROM sqlite_master WHERE type='table' AND name='autosavefragments';", result))
+   {
+      return false;
+   }
+
+   if (wxStrtol<char **>(result, nullptr, 10) == 0)
+   {
+      return true;
+   }
+
+   wxMemoryBuffer dict, list;
+   if (!GetBlob("SELECT dict FROM autosave WHERE id = 2;", dict) ||
+       !GetBlob("SELECT doc FROM autosave WHERE id = 2;", list))
+   {
+      return false;
+   }
+
+   if (dict.GetDataLen() == 0)
+   {
+      return true;
+   }
+
+   const char *sql = "SELECT doc FROM autosavefragments WHERE hash = ?1;";
+
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]
+   {
+      if (stmt)
+      {
+         sqlite3_finalize(stmt);
+      }
+   });
+
+   rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Unable to prepare project file command:\n\n%s").Format(sql)
+      );
+      return false;
+   }
+
+   buffer.AppendData(dict.GetData(), dict.GetDataLen());
+
+   auto hashes = static_cast<const char *>(list.GetData());
+   for (size_t offset = 0;
+        offset + sizeof(long long) <= list.GetDataLen();
+        offset += sizeof(long long))
+   {
+      long long hash;
+      memcpy(&hash, hashes + offset, sizeof(hash));
+
+      if (sqlite3_bind_int64(stmt, 1, hash))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      rc = sqlite3_step(stmt);
+      if (rc == SQLITE_DONE)
+      {
+         buffer.Clear();
+         SetError(XO("Some autosave information is missing from the project file"));
+         return false;
+      }
+
+      if (rc != SQLITE_ROW)
+      {
+         buffer.Clear();
+         SetDBError(
+            XO("Failed to retrieve data from the project file.\nThe following command failed:\n\n%s").Format(sql)
+         );
+         return false;
+      }
+
+      buffer.AppendData(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
+
+      sqlite3_reset(stmt);
+   }
+
+   return true;
+}
+
 bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
 {
    bool success = false;
@@ -1764,12 +2325,19 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
       return false;
    }
 
-   wxString project;
    wxMemoryBuffer buffer;
    bool usedAutosave = true;
 
-   // Get the autosave doc, if any
+   // Get the autosave doc, if any, preferring the incremental one
+   if (!ignoreAutosave &&
+       !GetAutoSaveFragments(buffer))
+   {
+      // Error already set
+      return false;
+   }
+
    if (!ignoreAutosave &&
+       buffer.GetDataLen() == 0 &&
        !GetBlob("SELECT dict || doc FROM autosave WHERE id = 1;", buffer))
    {
       // Error already set
@@ -1797,23 +2365,14 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
    }
    else
    {
-      project = ProjectSerializer::Decode(buffer);
-      if (project.empty())
-      {
-         SetError(XO("Unable to decode project document"));
-
-         return false;
-      }
-
-      XMLFileReader xmlFile;
-
-      // Load 'er up
-      success = xmlFile.ParseString(this, project);
+      // Load 'er up, straight from the binary document
+      TranslatableString error;
+      success = ProjectSerializer::Decode(buffer, this, error);
       if (!success)
       {
          SetError(
             XO("Unable to parse project information."),
-            xmlFile.GetErrorStr()
+            error
          );
          return false;
       }
@@ -1868,6 +2427,9 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
 
 bool ProjectFileIO::UpdateSaved(const TrackList *tracks)
 {
+   WaveTrackFactory::Get( mProject ).GetSampleBlockFactory()
+      ->StoreDeferred();
+
    ProjectSerializer doc;
    WriteXMLHeader(doc);
    WriteXML(doc, false, tracks);
@@ -2100,6 +2662,10 @@ bool ProjectFileIO::OpenProject()
 
 bool ProjectFileIO::CloseProject()
 {
+   // Release the sample blocks of the last autosave while the database is
+   // still open
+   mAutoSaveClips.clear();
+
    auto &currConn = CurrConn();
    if (!currConn)
    {
@@ -2290,7 +2856,28 @@ int64_t ProjectFileIO::GetTotalUsage()
    auto pConn = CurrConn().get();
    if (!pConn)
       return 0;
-   return GetDiskUsage(*pConn, 0);
+
+   // Count the same bytes that SqliteSampleBlock::GetSpaceUsage() records for
+   // each block.  SQLite answers length() of a blob from the record header,
+   // without reading the blob's overflow pages.
+   sqlite3_stmt *stmt =
+      pConn->Prepare(DBConnection::GetTotalBlockBytes,
+         "SELECT total(length(samples) + length(summary256) + length(summary64k))"
+         "  FROM sampleblocks;");
+   if (stmt == nullptr || sqlite3_step(stmt) != SQLITE_ROW)
+   {
+      if (stmt)
+         sqlite3_reset(stmt);
+      return 0;
+   }
+
+   int64_t total = sqlite3_column_int64(stmt, 0);
+
+   // All done with the statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   return total;
 }
 
 //
@@ -12,8 +12,11 @@ Paul Licameli split from AudacityProject.h
 #define __AUDACITY_PROJECT_FILE_IO__
 
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
+#include <wx/buffer.h> // member variables
+
 #include "ClientData.h" // to inherit
 #include "Prefs.h" // to inherit
 #include "xml/XMLTagHandler.h" // to inherit
@@ -28,7 +31,9 @@ class DBConnection;
 struct DBConnectionErrors;
 class ProjectSerializer;
 class SqliteSampleBlock;
+class Track;
 class TrackList;
+class WaveClip;
 class WaveTrack;
 
 using WaveTrackArray = std::vector < std::shared_ptr < WaveTrack > >;
@@ -66,6 +71,11 @@ public:
    static ProjectFileIO &Get( AudacityProject &project );
    static const ProjectFileIO &Get( const AudacityProject &project );
 
+   //! The file version that compressed sample blocks and incremental autosave
+   //! need; builds that read only older versions refuse such files rather
+   //! than misread them.  See DBConnection::RequireVersion().
+   static const int ExtensionsVersion;
+
    explicit ProjectFileIO( AudacityProject &project );
 
    ProjectFileIO( const ProjectFileIO & ) PROHIBITED;
@@ -111,7 +121,9 @@ public:
    int64_t GetTotalUsage();
 
    // Return the bytes used for the given block using the connection to a
-   // specific database. This is the workhorse for the above 3 methods.
+   // specific database, by walking the raw b-tree pages.  The other usage
+   // methods instead count the sizes of samples and summaries recorded when
+   // blocks are written or loaded, which needs no page reads.
    static int64_t GetDiskUsage(DBConnection &conn, SampleBlockID blockid);
 
    // Displays an error dialog with a button that offers help
@@ -205,6 +217,11 @@ private:
    void WriteXMLHeader(XMLWriter &xmlFile) const;
    void WriteXML(XMLWriter &xmlFile, bool recording = false,
       const TrackList *tracks = nullptr) /* not override */;
+   //! Write the start tag of the project, its attributes, and the tags
+   void WriteXMLStart(XMLWriter &xmlFile) const;
+   //! Visit the tracks that WriteXML would write, in order
+   void VisitTracksToSave(bool recording, const TrackList *tracks,
+      const std::function<void(const Track &)> &visitor) const;
 
    // XMLTagHandler callback methods
    bool HandleXMLTag(const wxChar *tag, const wxChar **attrs) override;
@@ -240,6 +257,10 @@ private:
    bool GetValue(const char *sql, wxString &value);
    bool GetBlob(const char *sql, wxMemoryBuffer &buffer);
 
+   //! Reassemble the autosave document from its fragments, if any
+   /*! Leaves buffer empty if there are none */
+   bool GetAutoSaveFragments(wxMemoryBuffer &buffer);
+
    bool CheckVersion();
    bool InstallSchema(sqlite3 *db, const char *schema = "main");
    bool UpgradeSchema();
@@ -247,6 +268,17 @@ private:
    // Write project or autosave XML (binary) documents
    bool WriteDoc(const char *table, const ProjectSerializer &autosave, const char *schema = "main");
 
+   //! A piece of the autosave document, and the hash of its bytes
+   struct AutoSaveFragment
+   {
+      wxMemoryBuffer data;
+      long long hash;
+   };
+
+   //! Write the autosave document as fragments, skipping those already stored
+   bool WriteAutoSaveFragments(const wxMemoryBuffer &dict,
+      const std::vector<AutoSaveFragment> &fragments);
+
    // Application defined function to verify blockid exists is in set of blockids
    static void InSet(sqlite3_context *context, int argc, sqlite3_value **argv);
 
@@ -272,6 +304,11 @@ private:
        int errorCode = -1);
 
    bool ShouldCompact(const std::vector<const TrackList *> &tracks);
+   //! Delete unused blocks and reclaim their space without copying the file
+   /*! When not forced, reclaims only a limited amount now, leaving the rest
+       to be reclaimed in the background */
+   bool CompactInPlace(
+      const std::vector<const TrackList *> &tracks, bool force);
 
    // Gets values from SQLite B-tree structures
    static unsigned int get2(const unsigned char *ptr);
@@ -307,6 +344,17 @@ private:
    Connection mPrevConn;
    FilePath mPrevFileName;
    bool mPrevTemporary;
+
+   //! A clip as of the last autosave, sharing its sample blocks, and the
+   //! fragment that was written for it
+   struct AutoSaveClip
+   {
+      std::unique_ptr<WaveClip> pCopy;
+      AutoSaveFragment fragment;
+   };
+   //! The clips of the last autosave, which are not serialized again while
+   //! they are unchanged
+   std::unordered_map<const WaveClip*, AutoSaveClip> mAutoSaveClips;
 };
 
 class wxTopLevelWindow;
@@ -1283,6 +1283,30 @@ bool ProjectFileManager::Import(
    return true;
 }
 
+void ProjectFileManager::ImportFiles(
+   const FilePaths &fileNames, bool addToHistory /* = true */)
+{
+   auto &project = mProject;
+   Importer::Get().ImportFiles( project, fileNames,
+      [&]( Importer::FileResult &result ){
+         // Merge the tags decoded with the file, as Import() does
+         auto newTags = Tags::Get( project ).Duplicate();
+         if (result.pTags)
+            newTags->Merge( *result.pTags );
+         Tags::Set( project, newTags );
+
+         if (addToHistory)
+            FileHistory::Global().Append(result.fileName);
+
+         // PRL: Undo history is incremented inside this:
+         AddImportedTracks(result.fileName, std::move(result.tracks));
+      },
+      [&]( const FilePath &fileName ){
+         Import(fileName, addToHistory);
+      }
+   );
+}
+
 #include "Clipboard.h"
 #include "ShuttleGui.h"
 #include "widgets/HelpSystem.h"
@@ -95,6 +95,10 @@ public:
    bool Import(const FilePath &fileName,
                bool addToHistory = true);
 
+   //! Import several files, decoding some of them at once
+   void ImportFiles(const FilePaths &fileNames,
+                    bool addToHistory = true);
+
    void Compact();
 
    void AddImportedTracks(const FilePath &fileName,
@@ -328,14 +328,21 @@ public:
             ProjectWindow::Get( *mProject ).HandleResize(); // Adjust scrollers for NEW track sizes.
          } );
 
+         // Import runs of files between MIDI files together
+         auto &projectFileManager = ProjectFileManager::Get( *mProject );
+         FilePaths names;
          for (const auto &name : sortednames) {
 #ifdef USE_MIDI
-            if (FileNames::IsMidi(name))
+            if (FileNames::IsMidi(name)) {
+               projectFileManager.ImportFiles(names);
+               names.clear();
                DoImportMIDI( *mProject, name );
+            }
             else
 #endif
-               ProjectFileManager::Get( *mProject ).Import(name);
+               names.push_back(name);
          }
+         projectFileManager.ImportFiles(names);
 
          auto &window = ProjectWindow::Get( *mProject );
          window.ZoomAfterImport(nullptr);
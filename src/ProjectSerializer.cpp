@@ -16,9 +16,12 @@
 #include "Audacity.h"
 #include "ProjectSerializer.h"
 
+#include "Internat.h"
+
 #include <algorithm>
 #include <cstdint>
 #include <mutex>
+#include <vector>
 #include <wx/ustring.h>
 
 ///
@@ -382,12 +385,234 @@ bool ProjectSerializer::DictChanged() const
    return mDictChanged;
 }
 
-// See ProjectFileIO::LoadProject() for explanation of the blockids arg
-wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
+namespace {
+
+//! Drop the characters that XMLWriter::XMLEsc() drops, so that handlers see
+//! what they would see after parsing the XML text:  controls other than tab,
+//! newline and return, unpaired surrogates, and U+FFFE and U+FFFF
+wxString Normalize(const wxString &value)
 {
-   wxMemoryInputStream in(buffer.GetData(), buffer.GetDataLen());
+   const auto dropped = [](wxUChar c) {
+      return (c < 0x20 && c != 0x09 && c != 0x0A && c != 0x0D) ||
+         c == 0xFFFE || c == 0xFFFF;
+   };
+   const auto surrogate = [](wxUChar c) {
+      return c >= 0xD800 && c <= 0xDFFF;
+   };
 
-   XMLStringWriter out;
+   // Usually nothing is dropped, and the string need not be copied
+   const auto len = value.length();
+   size_t ii = 0;
+   for (; ii < len; ++ii) {
+      const wxUChar c = value.GetChar(ii);
+      if (dropped(c) || surrogate(c))
+         break;
+   }
+   if (ii == len)
+      return value;
+
+   wxString result = value.Left(ii);
+   for (; ii < len; ++ii) {
+      const wxUChar c = value.GetChar(ii);
+      if (dropped(c))
+         continue;
+      if (surrogate(c)) {
+         // Only UTF-16 strings pair surrogates
+         const wxUChar c2 = ii + 1 < len ? value.GetChar(ii + 1) : 0;
+         if (sizeof(c) == 2 && c <= 0xDBFF && c2 >= 0xDC00 && c2 <= 0xDFFF) {
+            result += c;
+            result += c2;
+            ++ii;
+         }
+         continue;
+      }
+      result += c;
+   }
+   return result;
+}
+
+//! Receives a decoded document and dispatches it to tag handlers, just as
+//! XMLFileReader does for the callbacks of expat, but without XML text
+class HandlerDispatcher
+{
+public:
+   explicit HandlerDispatcher(XMLTagHandler *baseHandler)
+      : mBaseHandler{ baseHandler }
+   {
+      mHandlers.reserve(128);
+   }
+
+   void StartTag(const wxString &name)
+   {
+      Flush();
+      if (mHandlers.empty() && mRootSeen)
+      {
+         // Junk after the document element
+         Fail(XO("tag \"%s\" after the document element").Format(name));
+      }
+      mTag = name;
+      mPending = true;
+   }
+
+   void EndTag(const wxString &name)
+   {
+      Flush();
+      if (mHandlers.empty())
+      {
+         Fail(XO("unmatched end tag \"%s\"").Format(name));
+         return;
+      }
+      if (XMLTagHandler *const handler = mHandlers.back())
+         handler->HandleXMLEndTag(name.wx_str());
+      mHandlers.pop_back();
+   }
+
+   // Values are formatted just as XMLWriter would write them
+   void WriteAttr(const wxString &name, const wxString &value)
+   {
+      mAttrs.push_back(name);
+      mAttrs.push_back(Normalize(value));
+   }
+   void WriteAttr(const wxString &name, int value)
+   {
+      WriteAttr(name, wxString::Format(wxT("%d"), value));
+   }
+   void WriteAttr(const wxString &name, bool value)
+   {
+      WriteAttr(name, wxString::Format(wxT("%d"), value));
+   }
+   void WriteAttr(const wxString &name, long value)
+   {
+      WriteAttr(name, wxString::Format(wxT("%ld"), value));
+   }
+   void WriteAttr(const wxString &name, long long value)
+   {
+      WriteAttr(name, wxString::Format(wxT("%lld"), value));
+   }
+   void WriteAttr(const wxString &name, size_t value)
+   {
+      WriteAttr(name, wxString::Format(wxT("%lld"), (long long) value));
+   }
+   void WriteAttr(const wxString &name, float value, int digits)
+   {
+      WriteAttr(name, Internat::ToString(value, digits));
+   }
+   void WriteAttr(const wxString &name, double value, int digits)
+   {
+      WriteAttr(name, Internat::ToString(value, digits));
+   }
+
+   void WriteData(const wxString &value)
+   {
+      Flush();
+      if (!mHandlers.empty())
+         if (XMLTagHandler *const handler = mHandlers.back())
+            handler->HandleXMLContent(Normalize(value));
+   }
+
+   void Write(const wxString &)
+   {
+      // Raw text is only the prolog, before the document element; there is
+      // no parser here for anything else
+      if (mPending || mRootSeen)
+         Fail(XO("text inside the document element"));
+   }
+
+   //! Where the next item begins, in bytes from the start of the document
+   void SetOffset(long long offset) { mOffset = offset; }
+
+   //! Record the first error, at the offset of the item being decoded
+   void Fail(const TranslatableString &what)
+   {
+      if (mError.empty())
+         mError = XO("Error: %s at offset %lld").Format(what, mOffset);
+   }
+
+   //! @return whether the document was complete and the base handler
+   //! accepted it
+   bool Finish()
+   {
+      Flush();
+      if (!mRootSeen)
+         Fail(XO("no document element"));
+      else if (!mHandlers.empty())
+         Fail(XO("document ends inside a tag"));
+      return mError.empty() && mBaseHandler;
+   }
+
+   //! What was wrong, if Finish() returned false
+   const TranslatableString &GetError() const { return mError; }
+
+private:
+   void Flush()
+   {
+      if (!mPending)
+         return;
+      mPending = false;
+
+      // Names and values alternate, then a null, as HandleXMLTag expects
+      mAttrPtrs.clear();
+      for (const auto &str : mAttrs)
+         mAttrPtrs.push_back(str.wx_str());
+      mAttrPtrs.push_back(nullptr);
+
+      if (mHandlers.empty()) {
+         mRootSeen = true;
+         mHandlers.push_back(mBaseHandler);
+      }
+      else {
+         if (XMLTagHandler *const handler = mHandlers.back())
+            mHandlers.push_back(handler->HandleXMLChild(mTag.wx_str()));
+         else
+            mHandlers.push_back(nullptr);
+      }
+
+      if (XMLTagHandler *& handler = mHandlers.back()) {
+         if (!handler->HandleXMLTag(mTag.wx_str(), mAttrPtrs.data())) {
+            handler = nullptr;
+            // As for XMLFileReader, only the document element must be
+            // accepted
+            if (mHandlers.size() == 1) {
+               mBaseHandler = nullptr;
+               Fail(XO("tag \"%s\" or its attributes were rejected")
+                  .Format(mTag));
+            }
+         }
+      }
+
+      mAttrs.clear();
+   }
+
+   XMLTagHandler *mBaseHandler;
+   std::vector<XMLTagHandler*> mHandlers;
+
+   // The tag not yet dispatched, because attributes may follow
+   wxString mTag;
+   std::vector<wxString> mAttrs;
+   std::vector<const wxChar *> mAttrPtrs;
+   bool mPending{ false };
+   bool mRootSeen{ false };
+   long long mOffset{ 0 };
+   TranslatableString mError;
+};
+
+// Tell the writer where in the document the next item begins, if it cares
+template< typename Writer >
+void SetOffset(Writer &, long long)
+{
+}
+
+void SetOffset(HandlerDispatcher &out, long long offset)
+{
+   out.SetOffset(offset);
+}
+
+// Walk the document, calling the methods of XMLWriter on out (which need
+// not be an XMLWriter).  Returns false if the document is corrupt.
+template< typename Writer >
+bool DecodeTo(const wxMemoryBuffer &buffer, Writer &out)
+{
+   wxMemoryInputStream in(buffer.GetData(), buffer.GetDataLen());
 
    std::vector<char> bytes;
    IdMap mIds;
@@ -444,6 +669,8 @@ wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
       {
          UShort id;
 
+         SetOffset(out, in.TellI());
+
          switch (in.GetC())
          {
             case FT_Push:
@@ -592,8 +819,36 @@ wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
    {
       // Document was corrupt, or platform differences in size or endianness
       // were not well canonicalized
+      return false;
+   }
+
+   return true;
+}
+
+}
+
+wxString ProjectSerializer::Decode(const wxMemoryBuffer &buffer)
+{
+   XMLStringWriter out;
+
+   if (!DecodeTo(buffer, out))
+   {
       return {};
    }
 
    return out;
 }
+
+bool ProjectSerializer::Decode(const wxMemoryBuffer &buffer,
+   XMLTagHandler *baseHandler, TranslatableString &error)
+{
+   HandlerDispatcher out{ baseHandler };
+
+   if (!DecodeTo(buffer, out))
+      out.Fail(XO("corrupt document"));
+   if (out.Finish())
+      return true;
+
+   error = out.GetError();
+   return false;
+}
@@ -19,6 +19,8 @@
 #include <unordered_map>
 #include "audacity/Types.h"
 
+class TranslatableString;
+
 // From SampleBlock.h
 using SampleBlockID = long long;
 
@@ -68,6 +70,15 @@ public:
    // Returns empty string if decoding fails
    static wxString Decode(const wxMemoryBuffer &buffer);
 
+   // Decodes straight into tag handlers, as XMLFileReader::ParseString()
+   // would after the other Decode(), but without making and parsing text.
+   // Handlers see the values that parsing would give them.
+   // Returns false if decoding fails or the base handler rejects its tag;
+   // then error says what was wrong and where, as
+   // XMLFileReader::GetErrorStr() would.
+   static bool Decode(const wxMemoryBuffer &buffer, XMLTagHandler *baseHandler,
+      TranslatableString &error);
+
 private:
    void WriteName(const wxString & name);
 
@@ -77,6 +77,8 @@ ProjectSettings::ProjectSettings(AudacityProject &project)
       gPrefs->Flush();
    }
    gPrefs->Read(wxT("/GUI/SyncLockTracks"), &mIsSyncLocked, false);
+   mCompressSampleBlocks =
+      gPrefs->ReadBool(wxT("/FileFormats/CompressSampleBlocks"), false);
 
    bool multiToolActive = false;
    gPrefs->Read(wxT("/GUI/ToolBars/Tools/MultiToolActive"), &multiToolActive);
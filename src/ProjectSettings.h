@@ -85,6 +85,11 @@ public:
    void SetSnapTo(int snap);
    int GetSnapTo() const;
 
+   // Lossless compression of sample blocks written from now on
+
+   void SetCompressSampleBlocks(bool flag) { mCompressSampleBlocks = flag; }
+   bool GetCompressSampleBlocks() const { return mCompressSampleBlocks; }
+
    // Current tool
 
    void SetTool(int tool) { mCurrentTool = tool; }
@@ -143,6 +148,8 @@ private:
    bool mTracksFitVerticallyZoomed{ false };  //lda
    bool mShowId3Dialog{ true }; //lda
    bool mIsSyncLocked{ false };
+   // Atomic because sample blocks may be made in worker threads
+   std::atomic<bool> mCompressSampleBlocks{ false };
    bool mEmptyCanBeDirty;
    bool mShowSplashScreen;
 };
@@ -7,6 +7,7 @@ SampleBlock.cpp
 **********************************************************************/
 
 #include "Audacity.h"
+#include "AudacityException.h"
 #include "InconsistencyException.h"
 #include "SampleBlock.h"
 #include "SampleFormat.h"
@@ -68,6 +69,26 @@ SampleBlockPtr SampleBlockFactory::CreateFromXML(
    return result;
 }
 
+SampleBlockBatch::SampleBlockBatch( const SampleBlockFactoryPtr &pFactory )
+   : mpFactory{ pFactory }
+{
+   if (mpFactory)
+      mpFactory->BeginBatch();
+}
+
+SampleBlockBatch::~SampleBlockBatch()
+{
+   if (mpFactory)
+      // Don't throw from a destructor; a failure to store is reported later
+      GuardedCall( [this]{ mpFactory->EndBatch(); } );
+}
+
+void SampleBlockBatch::Flush()
+{
+   if (mpFactory)
+      mpFactory->FlushBatch();
+}
+
 SampleBlock::~SampleBlock() = default;
 
 size_t SampleBlock::GetSamples(samplePtr dest,
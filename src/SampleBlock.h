@@ -36,6 +36,13 @@ public:
    float RMS = 0;
 };
 
+//! Ratios of samples to frames of the summary levels that blocks offer
+/*! Each frame holds min, max and rms.  Levels are ascending, each 16 times
+    coarser than the one before, so that a display can always use a level
+    with between one and sixteen frames per pixel column.  256 and 65536 are
+    stored with the samples; the others are computed on first use. */
+static constexpr size_t SummaryDivisors[] = { 16, 256, 4096, 65536 };
+
 class SqliteSampleBlockFactory;
 
 ///\brief Abstract class allows access to contents of a block of sound samples,
@@ -65,6 +72,10 @@ public:
    //! Non-throwing, should fill with zeroes on failure
    virtual bool
       GetSummary64k(float *dest, size_t frameoffset, size_t numframes) = 0;
+   //! Non-throwing, should fill with zeroes on failure
+   /*! @param divisor one of SummaryDivisors */
+   virtual bool GetSummary(size_t divisor,
+      float *dest, size_t frameoffset, size_t numframes) = 0;
 
    /// Gets extreme values for the specified region
    // If !mayThrow and there is an error, ignores it and returns zeroes.
@@ -142,6 +153,27 @@ public:
    virtual BlockDeletionCallback SetBlockDeletionCallback(
       BlockDeletionCallback callback ) = 0;
 
+   //! Permit the factory to group the storing of blocks created after this,
+   //! for speed, until the matching EndBatch(); calls may nest
+   virtual void BeginBatch() = 0;
+
+   //! Finish storing all blocks created since the outermost BeginBatch()
+   /*! May throw on failure to store */
+   virtual void EndBatch() = 0;
+
+   //! Store the blocks of the batch so far, if enough have accumulated, and
+   //! continue it
+   /*! Blocks that other threads create store nothing until the thread that
+       began the batch calls this, as it should periodically while it waits
+       for them.  May throw on failure to store */
+   virtual void FlushBatch() = 0;
+
+   //! Store what the factory kept back rather than write at an inconvenient
+   //! time, as when drawing; call on the main thread, when the project is
+   //! written anyway
+   /*! Non-throwing; what can't be stored now is kept, or computed again */
+   virtual void StoreDeferred() = 0;
+
 protected:
    // The override should throw more informative exceptions on error than the
    // default InconsistencyException thrown by Create
@@ -162,4 +194,23 @@ protected:
       const wxChar **attrs) = 0;
 };
 
+//! RAII for SampleBlockFactory::BeginBatch() and EndBatch()
+/*! Use it around long sequences of block creations, as in importing, that
+    are not already within a TransactionScope */
+class SampleBlockBatch
+{
+public:
+   explicit SampleBlockBatch( const SampleBlockFactoryPtr &pFactory );
+   ~SampleBlockBatch();
+
+   SampleBlockBatch( const SampleBlockBatch& ) = delete;
+   SampleBlockBatch &operator=( const SampleBlockBatch& ) = delete;
+
+   //! See SampleBlockFactory::FlushBatch()
+   void Flush();
+
+private:
+   SampleBlockFactoryPtr mpFactory;
+};
+
 #endif
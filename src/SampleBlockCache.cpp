@@ -0,0 +1,112 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCache.cpp
+@brief Implements SampleBlockCache
+
+**********************************************************************/
+
+#include "SampleBlockCache.h"
+
+SampleBlockCache::SampleBlockCache(size_t budget)
+{
+   mStatistics.budget = budget;
+}
+
+SampleBlockCache::~SampleBlockCache() = default;
+
+auto SampleBlockCache::Find(SampleBlockID id) -> ContentsPtr
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   auto iter = mIndex.find(id);
+   if (iter == mIndex.end())
+   {
+      ++mStatistics.misses;
+      return {};
+   }
+
+   // Move to the front without invalidating the iterator in the index
+   mEntries.splice(mEntries.begin(), mEntries, iter->second);
+   ++mStatistics.hits;
+
+   return iter->second->second;
+}
+
+void SampleBlockCache::Insert(SampleBlockID id, ContentsPtr pContents)
+{
+   if (!pContents)
+      return;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   const auto bytes = pContents->bytes;
+   if (bytes > mStatistics.budget)
+      return;
+
+   auto iter = mIndex.find(id);
+   if (iter != mIndex.end())
+   {
+      // Another thread may have read the same block concurrently; keep the
+      // newer copy, which is identical
+      mStatistics.bytes -= iter->second->second->bytes;
+      mEntries.erase(iter->second);
+      mIndex.erase(iter);
+   }
+
+   Trim(mStatistics.budget - bytes);
+
+   mEntries.emplace_front(id, std::move(pContents));
+   mIndex.emplace(id, mEntries.begin());
+   mStatistics.bytes += bytes;
+}
+
+void SampleBlockCache::Erase(SampleBlockID id)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   auto iter = mIndex.find(id);
+   if (iter != mIndex.end())
+   {
+      mStatistics.bytes -= iter->second->second->bytes;
+      mEntries.erase(iter->second);
+      mIndex.erase(iter);
+   }
+}
+
+void SampleBlockCache::Clear()
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   mEntries.clear();
+   mIndex.clear();
+   mStatistics.bytes = 0;
+}
+
+void SampleBlockCache::SetBudget(size_t budget)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   mStatistics.budget = budget;
+   Trim(budget);
+}
+
+auto SampleBlockCache::GetStatistics() const -> Statistics
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+
+   return mStatistics;
+}
+
+void SampleBlockCache::Trim(size_t budget)
+{
+   while (!mEntries.empty() && mStatistics.bytes > budget)
+   {
+      auto &entry = mEntries.back();
+      mStatistics.bytes -= entry.second->bytes;
+      mIndex.erase(entry.first);
+      mEntries.pop_back();
+      ++mStatistics.evictions;
+   }
+}
@@ -0,0 +1,91 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCache.h
+@brief Declare SampleBlockCache, a bounded cache of sample block contents
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_CACHE__
+#define __AUDACITY_SAMPLE_BLOCK_CACHE__
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "MemoryX.h"
+
+// From SampleBlock.h
+using SampleBlockID = long long;
+
+///\brief Thread-safe cache of the stored bytes of sample blocks, limited by
+/// a total byte budget, discarding the least recently used blocks first
+/*! Playback, redrawing and effect previews tend to read the same blocks
+    repeatedly within a short time; this spares them repeated round trips to
+    the database.  Contents are immutable once inserted and are shared with
+    readers, so that a reader may copy from them without holding the lock even
+    while the entry is evicted. */
+class SampleBlockCache
+{
+public:
+   //! Bytes of one sample block, in the format in which it is stored
+   struct Contents
+   {
+      ArrayOf<char> data;
+      size_t bytes{ 0 };
+   };
+   using ContentsPtr = std::shared_ptr<const Contents>;
+
+   struct Statistics
+   {
+      unsigned long long hits{ 0 };
+      unsigned long long misses{ 0 };
+      unsigned long long evictions{ 0 };
+      size_t bytes{ 0 };
+      size_t budget{ 0 };
+   };
+
+   //! Default budget in bytes, if no preference overrides it
+   static constexpr size_t DefaultBudget = 64 * 1024 * 1024;
+
+   explicit SampleBlockCache(size_t budget = DefaultBudget);
+   ~SampleBlockCache();
+
+   SampleBlockCache(const SampleBlockCache &) PROHIBITED;
+   SampleBlockCache &operator=(const SampleBlockCache &) PROHIBITED;
+
+   //! Find contents and make them most recently used, counting a hit or miss
+   /*! @return null if not cached */
+   ContentsPtr Find(SampleBlockID id);
+
+   //! Store contents as most recently used, evicting others to fit the budget
+   /*! Contents larger than the whole budget are not stored */
+   void Insert(SampleBlockID id, ContentsPtr pContents);
+
+   //! Forget any contents for the block, which is being deleted
+   void Erase(SampleBlockID id);
+
+   void Clear();
+
+   //! Change the budget, evicting as needed
+   void SetBudget(size_t budget);
+
+   Statistics GetStatistics() const;
+
+private:
+   //! Requires the lock to be held
+   void Trim(size_t budget);
+
+   using Entry = std::pair<SampleBlockID, ContentsPtr>;
+   //! Most recently used first
+   using EntryList = std::list<Entry>;
+
+   mutable std::mutex mMutex;
+   EntryList mEntries;
+   std::unordered_map<SampleBlockID, EntryList::iterator> mIndex;
+   Statistics mStatistics;
+};
+
+#endif
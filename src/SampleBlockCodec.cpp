@@ -0,0 +1,297 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCodec.cpp
+@brief Implements SampleBlockCodec using the FLAC library when available
+
+**********************************************************************/
+
+#include "Audacity.h" // for USE_* macros
+#include "SampleBlockCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#ifdef USE_LIBFLAC
+#include "FLAC++/decoder.h"
+#include "FLAC++/encoder.h"
+
+namespace {
+
+// Any legal rate will do; the stream is never played as such
+enum : unsigned { FlacRate = 48000, FlacLevel = 5 };
+
+//! Find the smallest integer resolution that represents all samples exactly
+/*! @return 16 or 24 bits, or 0 if there is none */
+unsigned BitsPerSample(constSamplePtr src, sampleFormat format, size_t len)
+{
+   switch (format) {
+   case int16Sample:
+      return 16;
+   case int24Sample: {
+      auto samples = reinterpret_cast<const int *>(src);
+      for (size_t ii = 0; ii < len; ++ii)
+         if (samples[ii] < -(1 << 23) || samples[ii] >= (1 << 23))
+            return 0;
+      return 24;
+   }
+   case floatSample: {
+      // Such floats come from integer sources, or are produced by
+      // dithering to integer formats and then converting back
+      auto samples = reinterpret_cast<const float *>(src);
+      for (unsigned bits : { 16u, 24u }) {
+         const double scale = 1 << (bits - 1);
+         bool exact = true;
+         for (size_t ii = 0; exact && ii < len; ++ii) {
+            const float sample = samples[ii];
+            const double scaled = sample * scale;
+            // Rejects NaN and infinities too; also reject negative zero,
+            // which would come back positive
+            exact = scaled >= -scale && scaled < scale &&
+               scaled == std::floor(scaled) &&
+               !(sample == 0 && std::signbit(sample));
+         }
+         if (exact)
+            return bits;
+      }
+      return 0;
+   }
+   default:
+      return 0;
+   }
+}
+
+class MemoryEncoder final : public FLAC::Encoder::Stream
+{
+public:
+   explicit MemoryEncoder(size_t limit) : mLimit{ limit } {}
+
+   std::vector<char> mBytes;
+   bool mOverflow{ false };
+
+protected:
+   ::FLAC__StreamEncoderWriteStatus write_callback(
+      const FLAC__byte buffer[], size_t bytes,
+      unsigned, unsigned) override
+   {
+      if (mBytes.size() + bytes >= mLimit) {
+         // No gain; give up early
+         mOverflow = true;
+         return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+      }
+      mBytes.insert(mBytes.end(),
+         reinterpret_cast<const char*>(buffer),
+         reinterpret_cast<const char*>(buffer) + bytes);
+      return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+   }
+
+private:
+   const size_t mLimit;
+};
+
+class MemoryDecoder final : public FLAC::Decoder::Stream
+{
+public:
+   MemoryDecoder(const void *src, size_t srcBytes,
+      sampleFormat format, size_t numsamples, samplePtr dest)
+      : mSrc{ static_cast<const FLAC__byte*>(src) }
+      , mSrcBytes{ srcBytes }
+      , mFormat{ format }
+      , mNumSamples{ numsamples }
+      , mDest{ dest }
+   {}
+
+   size_t mDecoded{ 0 };
+   bool mError{ false };
+
+protected:
+   ::FLAC__StreamDecoderReadStatus read_callback(
+      FLAC__byte buffer[], size_t *bytes) override
+   {
+      if (mPosition >= mSrcBytes) {
+         *bytes = 0;
+         return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+      }
+      *bytes = std::min(*bytes, mSrcBytes - mPosition);
+      memcpy(buffer, mSrc + mPosition, *bytes);
+      mPosition += *bytes;
+      return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+   }
+
+   ::FLAC__StreamDecoderWriteStatus write_callback(
+      const ::FLAC__Frame *frame, const FLAC__int32 * const buffer[]) override
+   {
+      const size_t len = frame->header.blocksize;
+      if (frame->header.channels != 1 || mDecoded + len > mNumSamples) {
+         mError = true;
+         return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+      }
+
+      const auto samples = buffer[0];
+      switch (mFormat) {
+      case int16Sample: {
+         auto dest = reinterpret_cast<short *>(mDest) + mDecoded;
+         for (size_t ii = 0; ii < len; ++ii)
+            dest[ii] = static_cast<short>(samples[ii]);
+         break;
+      }
+      case int24Sample: {
+         auto dest = reinterpret_cast<int *>(mDest) + mDecoded;
+         std::copy(samples, samples + len, dest);
+         break;
+      }
+      case floatSample: {
+         auto dest = reinterpret_cast<float *>(mDest) + mDecoded;
+         const float scale =
+            1.0f / (1 << (frame->header.bits_per_sample - 1));
+         for (size_t ii = 0; ii < len; ++ii)
+            dest[ii] = samples[ii] * scale;
+         break;
+      }
+      default:
+         mError = true;
+         return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+      }
+
+      mDecoded += len;
+      return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+   }
+
+   void error_callback(::FLAC__StreamDecoderErrorStatus) override
+   {
+      mError = true;
+   }
+
+private:
+   const FLAC__byte *const mSrc;
+   const size_t mSrcBytes;
+   size_t mPosition{ 0 };
+   const sampleFormat mFormat;
+   const size_t mNumSamples;
+   const samplePtr mDest;
+};
+
+bool FlacEncode(constSamplePtr src, sampleFormat format, size_t numsamples,
+   ArrayOf<char> &dest, size_t &destBytes)
+{
+   const auto bits = BitsPerSample(src, format, numsamples);
+   if (bits == 0 || numsamples == 0)
+      return false;
+
+   MemoryEncoder encoder{ numsamples * SAMPLE_SIZE(format) };
+   encoder.set_channels(1);
+   encoder.set_bits_per_sample(bits);
+   encoder.set_sample_rate(FlacRate);
+   encoder.set_compression_level(FlacLevel);
+   encoder.set_total_samples_estimate(numsamples);
+   if (encoder.init() != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+      return false;
+
+   // Convert to 32 bit integers in pieces
+   enum : size_t { Chunk = 4096 };
+   FLAC__int32 buffer[Chunk];
+   bool ok = true;
+   for (size_t done = 0; ok && done < numsamples; done += Chunk) {
+      const auto len = std::min<size_t>(Chunk, numsamples - done);
+      switch (format) {
+      case int16Sample: {
+         auto samples = reinterpret_cast<const short *>(src) + done;
+         std::copy(samples, samples + len, buffer);
+         break;
+      }
+      case int24Sample: {
+         auto samples = reinterpret_cast<const int *>(src) + done;
+         std::copy(samples, samples + len, buffer);
+         break;
+      }
+      default: {
+         auto samples = reinterpret_cast<const float *>(src) + done;
+         const double scale = 1 << (bits - 1);
+         for (size_t ii = 0; ii < len; ++ii)
+            buffer[ii] = static_cast<FLAC__int32>(samples[ii] * scale);
+         break;
+      }
+      }
+      ok = encoder.process_interleaved(buffer, len);
+   }
+
+   ok = encoder.finish() && ok && !encoder.mOverflow;
+   if (!ok)
+      return false;
+
+   destBytes = encoder.mBytes.size();
+   dest.reinit(destBytes);
+   memcpy(dest.get(), encoder.mBytes.data(), destBytes);
+   return true;
+}
+
+bool FlacDecode(const void *src, size_t srcBytes,
+   sampleFormat format, size_t numsamples, samplePtr dest)
+{
+   MemoryDecoder decoder{ src, srcBytes, format, numsamples, dest };
+   decoder.set_md5_checking(false);
+   if (decoder.init() != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+      return false;
+
+   auto ok = decoder.process_until_end_of_stream();
+   decoder.finish();
+   return ok && !decoder.mError && decoder.mDecoded == numsamples;
+}
+
+}
+#endif
+
+namespace SampleBlockCodec
+{
+
+bool IsAvailable(Codec codec)
+{
+   switch (codec) {
+   case Raw:
+      return true;
+#ifdef USE_LIBFLAC
+   case Flac:
+      return true;
+#endif
+   default:
+      return false;
+   }
+}
+
+bool Encode(Codec codec,
+   constSamplePtr src, sampleFormat format, size_t numsamples,
+   ArrayOf<char> &dest, size_t &destBytes)
+{
+   switch (codec) {
+#ifdef USE_LIBFLAC
+   case Flac:
+      return FlacEncode(src, format, numsamples, dest, destBytes);
+#endif
+   default:
+      return false;
+   }
+}
+
+bool Decode(Codec codec,
+   const void *src, size_t srcBytes,
+   sampleFormat format, size_t numsamples, samplePtr dest)
+{
+   switch (codec) {
+   case Raw:
+      if (srcBytes != numsamples * SAMPLE_SIZE(format))
+         return false;
+      memcpy(dest, src, srcBytes);
+      return true;
+#ifdef USE_LIBFLAC
+   case Flac:
+      return FlacDecode(src, srcBytes, format, numsamples, dest);
+#endif
+   default:
+      return false;
+   }
+}
+
+}
@@ -0,0 +1,45 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCodec.h
+@brief Lossless encodings of the samples of a sample block
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_CODEC__
+#define __AUDACITY_SAMPLE_BLOCK_CODEC__
+
+#include "MemoryX.h"
+#include "SampleFormat.h"
+
+namespace SampleBlockCodec
+{
+   //! Identifies how the samples of a block are stored.
+   /*! These values are persistent in project files; never change them */
+   enum Codec : unsigned char
+   {
+      Raw = 0,  //!< Samples as they are in memory
+      Flac = 1, //!< A FLAC stream of one channel, with 16 or 24 bits
+   };
+
+   //! Whether this build can encode and decode with the codec
+   bool IsAvailable(Codec codec);
+
+   //! Try to encode samples losslessly
+   /*! Float samples can be encoded only if every sample is exactly a 16 or
+       24 bit integer value.
+       @return false if the codec is unavailable, can't represent the samples
+       exactly, or wouldn't save space; then dest is unchanged */
+   bool Encode(Codec codec,
+      constSamplePtr src, sampleFormat format, size_t numsamples,
+      ArrayOf<char> &dest, size_t &destBytes);
+
+   //! Decode exactly numsamples samples in the given format
+   /*! @return false if the codec is unavailable or the data are corrupt */
+   bool Decode(Codec codec,
+      const void *src, size_t srcBytes,
+      sampleFormat format, size_t numsamples, samplePtr dest);
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleStatistics.cpp
+@brief Implements SampleStatistics with SSE2 and AVX2 kernels on x86
+
+**********************************************************************/
+
+#include "SampleStatistics.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "CpuFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#define SAMPLE_STATISTICS_X86
+#include <immintrin.h>
+#endif
+
+// GCC and clang compile intrinsics of instruction sets beyond the baseline
+// only in functions so marked; the functions are called only when the
+// machine has them
+#if defined(__GNUC__)
+#define SAMPLE_STATISTICS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SAMPLE_STATISTICS_TARGET(isa)
+#endif
+
+namespace {
+
+// Squares are summed in single precision over runs of at most this many
+// samples in each lane, then added in double precision
+enum : size_t { RunLength = 1024 };
+
+// Scale factor of CopySamples from int16 to float, and its square; both
+// are powers of two, so scaling is exact
+constexpr float Int16Scale = 1.0f / (1 << 15);
+constexpr double Int16SquareScale = 1.0 / (1 << 30);
+
+void AccumulateScalar(const float *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   float lo = min, hi = max;
+   double sum = 0;
+   for (size_t ii = 0; ii < len; ++ii) {
+      const float v = samples[ii];
+      if (v < lo)
+         lo = v;
+      if (v > hi)
+         hi = v;
+      sum += (double) v * v;
+   }
+   min = lo, max = hi;
+   sumsq += sum;
+}
+
+void AccumulateScalar(const short *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   int lo = 32767, hi = -32768;
+   double sum = 0;
+   for (size_t ii = 0; ii < len; ++ii) {
+      const int v = samples[ii];
+      lo = std::min(lo, v);
+      hi = std::max(hi, v);
+      sum += (double) v * v;
+   }
+   if (len > 0) {
+      min = std::min(min, lo * Int16Scale);
+      max = std::max(max, hi * Int16Scale);
+      sumsq += sum * Int16SquareScale;
+   }
+}
+
+void AccumulateFramesScalar(const float *frames, size_t count,
+   float &min, float &max, double &sumsq)
+{
+   float lo = min, hi = max;
+   double sum = 0;
+   for (size_t ii = 0; ii < count; ++ii, frames += 3) {
+      if (frames[0] < lo)
+         lo = frames[0];
+      if (frames[1] > hi)
+         hi = frames[1];
+      sum += (double) frames[2] * frames[2];
+   }
+   min = lo, max = hi;
+   sumsq += sum;
+}
+
+#ifdef SAMPLE_STATISTICS_X86
+
+// Fold the lanes into the results, in the same way as the scalar loop
+void Reduce(const float *los, const float *his, size_t lanes,
+   float &min, float &max)
+{
+   for (size_t ii = 0; ii < lanes; ++ii) {
+      if (los[ii] < min)
+         min = los[ii];
+      if (his[ii] > max)
+         max = his[ii];
+   }
+}
+
+// Note that _mm_min_ps(v, lo) is lo when v is NaN, as in the scalar loop
+
+SAMPLE_STATISTICS_TARGET("sse2")
+void AccumulateSSE2(const float *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   const size_t whole = len & ~size_t(3);
+   if (whole > 0) {
+      __m128 lo = _mm_set1_ps(min), hi = _mm_set1_ps(max);
+      __m128d sum = _mm_setzero_pd();
+      for (size_t ii = 0; ii < whole;) {
+         __m128 squares = _mm_setzero_ps();
+         for (const auto stop = std::min(whole, ii + RunLength);
+              ii < stop; ii += 4) {
+            const __m128 v = _mm_loadu_ps(samples + ii);
+            lo = _mm_min_ps(v, lo);
+            hi = _mm_max_ps(v, hi);
+            squares = _mm_add_ps(squares, _mm_mul_ps(v, v));
+         }
+         sum = _mm_add_pd(sum, _mm_cvtps_pd(squares));
+         sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(squares, squares)));
+      }
+      float los[4], his[4];
+      double sums[2];
+      _mm_storeu_ps(los, lo);
+      _mm_storeu_ps(his, hi);
+      _mm_storeu_pd(sums, sum);
+      Reduce(los, his, 4, min, max);
+      sumsq += sums[0] + sums[1];
+   }
+   AccumulateScalar(samples + whole, len - whole, min, max, sumsq);
+}
+
+SAMPLE_STATISTICS_TARGET("sse2")
+void AccumulateSSE2(const short *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   const size_t whole = len & ~size_t(7);
+   if (whole > 0) {
+      // Extremes are found among the integers, and squares are summed of
+      // the unscaled values, which are exact in single precision
+      __m128i lo = _mm_set1_epi16(32767), hi = _mm_set1_epi16(-32768);
+      __m128d sum = _mm_setzero_pd();
+      for (size_t ii = 0; ii < whole;) {
+         __m128 squares = _mm_setzero_ps();
+         for (const auto stop = std::min(whole, ii + RunLength);
+              ii < stop; ii += 8) {
+            const __m128i v = _mm_loadu_si128(
+               reinterpret_cast<const __m128i *>(samples + ii));
+            lo = _mm_min_epi16(v, lo);
+            hi = _mm_max_epi16(v, hi);
+            // Sign-extend to 32 bits
+            const __m128 v0 =
+               _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+            const __m128 v1 =
+               _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+            squares = _mm_add_ps(squares, _mm_mul_ps(v0, v0));
+            squares = _mm_add_ps(squares, _mm_mul_ps(v1, v1));
+         }
+         sum = _mm_add_pd(sum, _mm_cvtps_pd(squares));
+         sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(squares, squares)));
+      }
+      short los[8], his[8];
+      double sums[2];
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(los), lo);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(his), hi);
+      _mm_storeu_pd(sums, sum);
+      min = std::min(min, *std::min_element(los, los + 8) * Int16Scale);
+      max = std::max(max, *std::max_element(his, his + 8) * Int16Scale);
+      sumsq += (sums[0] + sums[1]) * Int16SquareScale;
+   }
+   AccumulateScalar(samples + whole, len - whole, min, max, sumsq);
+}
+
+SAMPLE_STATISTICS_TARGET("sse2")
+void AccumulateFramesSSE2(const float *frames, size_t count,
+   float &min, float &max, double &sumsq)
+{
+   // Four frames at a time, in three loads
+   const size_t whole = count & ~size_t(3);
+   if (whole > 0) {
+      __m128 lo = _mm_set1_ps(min), hi = _mm_set1_ps(max);
+      __m128d sum = _mm_setzero_pd();
+      for (size_t ii = 0; ii < whole; ii += 4) {
+         const float *p = frames + 3 * ii;
+         // a = m0 M0 r0 m1, b = M1 r1 m2 M2, c = r2 m3 M3 r3
+         const __m128 a = _mm_loadu_ps(p);
+         const __m128 b = _mm_loadu_ps(p + 4);
+         const __m128 c = _mm_loadu_ps(p + 8);
+         const __m128 mins = _mm_shuffle_ps(a,
+            _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)),
+            _MM_SHUFFLE(2, 0, 3, 0));
+         const __m128 maxes = _mm_shuffle_ps(
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+            _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+            _MM_SHUFFLE(2, 0, 2, 0));
+         const __m128 rms = _mm_shuffle_ps(
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+            _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+            _MM_SHUFFLE(2, 0, 2, 0));
+         lo = _mm_min_ps(mins, lo);
+         hi = _mm_max_ps(maxes, hi);
+         const __m128 squares = _mm_mul_ps(rms, rms);
+         sum = _mm_add_pd(sum, _mm_cvtps_pd(squares));
+         sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(squares, squares)));
+      }
+      float los[4], his[4];
+      double sums[2];
+      _mm_storeu_ps(los, lo);
+      _mm_storeu_ps(his, hi);
+      _mm_storeu_pd(sums, sum);
+      Reduce(los, his, 4, min, max);
+      sumsq += sums[0] + sums[1];
+   }
+   AccumulateFramesScalar(frames + 3 * whole, count - whole, min, max, sumsq);
+}
+
+SAMPLE_STATISTICS_TARGET("avx2")
+void AccumulateAVX2(const float *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   const size_t whole = len & ~size_t(7);
+   if (whole > 0) {
+      __m256 lo = _mm256_set1_ps(min), hi = _mm256_set1_ps(max);
+      __m256d sum = _mm256_setzero_pd();
+      for (size_t ii = 0; ii < whole;) {
+         __m256 squares = _mm256_setzero_ps();
+         for (const auto stop = std::min(whole, ii + RunLength);
+              ii < stop; ii += 8) {
+            const __m256 v = _mm256_loadu_ps(samples + ii);
+            lo = _mm256_min_ps(v, lo);
+            hi = _mm256_max_ps(v, hi);
+            squares = _mm256_add_ps(squares, _mm256_mul_ps(v, v));
+         }
+         sum = _mm256_add_pd(sum,
+            _mm256_cvtps_pd(_mm256_castps256_ps128(squares)));
+         sum = _mm256_add_pd(sum,
+            _mm256_cvtps_pd(_mm256_extractf128_ps(squares, 1)));
+      }
+      float los[8], his[8];
+      double sums[4];
+      _mm256_storeu_ps(los, lo);
+      _mm256_storeu_ps(his, hi);
+      _mm256_storeu_pd(sums, sum);
+      Reduce(los, his, 8, min, max);
+      sumsq += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+   }
+   AccumulateSSE2(samples + whole, len - whole, min, max, sumsq);
+}
+
+SAMPLE_STATISTICS_TARGET("avx2")
+void AccumulateAVX2(const short *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   const size_t whole = len & ~size_t(15);
+   if (whole > 0) {
+      __m256i lo = _mm256_set1_epi16(32767), hi = _mm256_set1_epi16(-32768);
+      __m256d sum = _mm256_setzero_pd();
+      for (size_t ii = 0; ii < whole;) {
+         __m256 squares = _mm256_setzero_ps();
+         for (const auto stop = std::min(whole, ii + RunLength);
+              ii < stop; ii += 16) {
+            const __m256i v = _mm256_loadu_si256(
+               reinterpret_cast<const __m256i *>(samples + ii));
+            lo = _mm256_min_epi16(v, lo);
+            hi = _mm256_max_epi16(v, hi);
+            const __m256 v0 = _mm256_cvtepi32_ps(
+               _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+            const __m256 v1 = _mm256_cvtepi32_ps(
+               _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+            squares = _mm256_add_ps(squares, _mm256_mul_ps(v0, v0));
+            squares = _mm256_add_ps(squares, _mm256_mul_ps(v1, v1));
+         }
+         sum = _mm256_add_pd(sum,
+            _mm256_cvtps_pd(_mm256_castps256_ps128(squares)));
+         sum = _mm256_add_pd(sum,
+            _mm256_cvtps_pd(_mm256_extractf128_ps(squares, 1)));
+      }
+      short los[16], his[16];
+      double sums[4];
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(los), lo);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(his), hi);
+      _mm256_storeu_pd(sums, sum);
+      min = std::min(min, *std::min_element(los, los + 16) * Int16Scale);
+      max = std::max(max, *std::max_element(his, his + 16) * Int16Scale);
+      sumsq += ((sums[0] + sums[1]) + (sums[2] + sums[3])) * Int16SquareScale;
+   }
+   AccumulateSSE2(samples + whole, len - whole, min, max, sumsq);
+}
+
+#endif
+
+struct Kernels
+{
+   void (*accumulateFloat)(const float *, size_t, float &, float &, double &);
+   void (*accumulateInt16)(const short *, size_t, float &, float &, double &);
+   void (*accumulateFrames)(const float *, size_t, float &, float &, double &);
+   const char *name;
+};
+
+const Kernels sKernels[SampleStatistics::nKernels] = {
+   { AccumulateScalar, AccumulateScalar, AccumulateFramesScalar, "scalar" },
+#ifdef SAMPLE_STATISTICS_X86
+   { AccumulateSSE2, AccumulateSSE2, AccumulateFramesSSE2, "SSE2" },
+   // Frames are strided, so that wider loads gain little for them
+   { AccumulateAVX2, AccumulateAVX2, AccumulateFramesSSE2, "AVX2" },
+#else
+   { AccumulateScalar, AccumulateScalar, AccumulateFramesScalar, "SSE2" },
+   { AccumulateScalar, AccumulateScalar, AccumulateFramesScalar, "AVX2" },
+#endif
+};
+
+SampleStatistics::Kernel BestKernel()
+{
+   for (auto kernel : { SampleStatistics::AVX2, SampleStatistics::SSE2 })
+      if (SampleStatistics::IsAvailable(kernel))
+         return kernel;
+   return SampleStatistics::Scalar;
+}
+
+std::atomic<const Kernels *> &CurrentKernels()
+{
+   static std::atomic<const Kernels *> sCurrent{ &sKernels[BestKernel()] };
+   return sCurrent;
+}
+
+const Kernels &Current()
+{
+   return *CurrentKernels().load(std::memory_order_relaxed);
+}
+
+}
+
+namespace SampleStatistics
+{
+
+bool IsAvailable(Kernel kernel)
+{
+   switch (kernel) {
+   case Scalar:
+      return true;
+#ifdef SAMPLE_STATISTICS_X86
+   case SSE2:
+      return CpuFeatures::HasSSE2();
+   case AVX2:
+      return CpuFeatures::HasSSE2() && CpuFeatures::HasAVX2();
+#endif
+   default:
+      return false;
+   }
+}
+
+const char *GetName(Kernel kernel)
+{
+   return sKernels[kernel].name;
+}
+
+Kernel GetKernel()
+{
+   return static_cast<Kernel>(&Current() - sKernels);
+}
+
+void SetKernel(Kernel kernel)
+{
+   if (IsAvailable(kernel))
+      CurrentKernels().store(&sKernels[kernel], std::memory_order_relaxed);
+}
+
+void Accumulate(const float *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   Current().accumulateFloat(samples, len, min, max, sumsq);
+}
+
+void Accumulate(const short *samples, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   Current().accumulateInt16(samples, len, min, max, sumsq);
+}
+
+void AccumulateFrames(const float *frames, size_t count,
+   float &min, float &max, double &sumsq)
+{
+   Current().accumulateFrames(frames, count, min, max, sumsq);
+}
+
+}
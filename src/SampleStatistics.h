@@ -0,0 +1,54 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleStatistics.h
+@brief Extremes and sums of squares of runs of samples, for summaries
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_STATISTICS__
+#define __AUDACITY_SAMPLE_STATISTICS__
+
+#include <cstddef>
+
+//! Accumulate the minimum, maximum and sum of squares of runs of samples
+/*! The kernel that does the work is chosen at run time for the instruction
+    sets of the machine.  Each finds exactly the extremes that comparisons
+    of one sample at a time would find, ignoring NaNs; sums of squares may
+    differ by rounding. */
+namespace SampleStatistics
+{
+   enum Kernel
+   {
+      Scalar,
+      SSE2,
+      AVX2,
+      nKernels
+   };
+
+   //! Whether this build and machine can run the kernel
+   bool IsAvailable(Kernel kernel);
+   const char *GetName(Kernel kernel);
+
+   //! The kernel in use, by default the best available
+   Kernel GetKernel();
+   //! Use another kernel, as for comparisons
+   /*! @pre IsAvailable(kernel) */
+   void SetKernel(Kernel kernel);
+
+   //! Accumulate float samples
+   void Accumulate(const float *samples, size_t len,
+      float &min, float &max, double &sumsq);
+
+   //! Accumulate 16 bit samples, scaled as CopySamples converts them to float
+   void Accumulate(const short *samples, size_t len,
+      float &min, float &max, double &sumsq);
+
+   //! Accumulate summary frames, which are triples of min, max and rms
+   /*! Adds the squares of the rms values, unweighted, to sumsq */
+   void AccumulateFrames(const float *frames, size_t count,
+      float &min, float &max, double &sumsq);
+}
+
+#endif
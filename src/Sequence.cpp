@@ -41,6 +41,7 @@
 #include <wx/log.h>
 
 #include "SampleBlock.h"
+#include "SampleStatistics.h"
 #include "InconsistencyException.h"
 #include "widgets/AudacityMessageBox.h"
 
@@ -73,6 +74,18 @@ Sequence::~Sequence()
 {
 }
 
+bool Sequence::IsSameAs(const Sequence &other) const
+{
+   if (mpFactory != other.mpFactory ||
+       mSampleFormat != other.mSampleFormat ||
+       mNumSamples != other.mNumSamples ||
+       mMinSamples != other.mMinSamples ||
+       mMaxSamples != other.mMaxSamples)
+      return false;
+
+   return mBlock.IsSameAs(other.mBlock);
+}
+
 size_t Sequence::GetMaxBlockSize() const
 {
    return mMaxSamples;
@@ -85,8 +98,8 @@ size_t Sequence::GetIdealBlockSize() const
 
 bool Sequence::CloseLock()
 {
-   for (unsigned int i = 0; i < mBlock.size(); i++)
-      mBlock[i].sb->CloseLock();
+   for (const auto &block : mBlock)
+      block.sb->CloseLock();
 
    return true;
 }
@@ -140,6 +153,10 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format,
       // no change
       return false;
 
+   // Commit appended samples while they are still in the old format
+   Flush();
+   DiscardTail();
+
    if (mBlock.size() == 0)
    {
       mSampleFormat = format;
@@ -165,10 +182,6 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format,
    } );
 
    BlockArray newBlockArray;
-   // Use the ratio of old to NEW mMaxSamples to make a reasonable guess
-   // at allocation.
-   newBlockArray.reserve
-      (1 + mBlock.size() * ((float)oldMaxSamples / (float)mMaxSamples));
 
    {
       size_t oldSize = oldMaxSamples;
@@ -176,9 +189,8 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format,
       size_t newSize = oldMaxSamples;
       SampleBuffer bufferNew(newSize, format);
 
-      for (size_t i = 0, nn = mBlock.size(); i < nn; i++)
+      for (const auto &oldSeqBlock : mBlock)
       {
-         SeqBlock &oldSeqBlock = mBlock[i];
          const auto &oldBlockFile = oldSeqBlock.sb;
          const auto len = oldBlockFile->GetSampleCount();
          ensureSampleBufferSize(bufferOld, oldFormat, oldSize, len);
@@ -211,7 +223,8 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format,
 
    // Commit the changes to block file array
    CommitChangesIfConsistent
-      (newBlockArray, mNumSamples, wxT("Sequence::ConvertToSampleFormat()"));
+      (newBlockArray, mNumSamples, wxT("Sequence::ConvertToSampleFormat()"),
+       0, newBlockArray.size());
 
    // Commit the other changes
    bSuccess = true;
@@ -242,8 +255,8 @@ std::pair<float, float> Sequence::GetMinMax(
    // this is very fast because we have the min/max of every entire block
    // already in memory.
 
-   for (unsigned b = block0 + 1; b < block1; ++b) {
-      auto results = mBlock[b].sb->GetMinMaxRMS(mayThrow);
+   for (auto iter = mBlock.At(block0 + 1); iter.Index() < block1; ++iter) {
+      auto results = iter->sb->GetMinMaxRMS(mayThrow);
 
       if (results.min < min)
          min = results.min;
@@ -317,9 +330,8 @@ float Sequence::GetRMS(sampleCount start, sampleCount len, bool mayThrow) const
    // First calculate the rms of the blocks in the middle of this region;
    // this is very fast because we have the rms of every entire block
    // already in memory.
-   for (unsigned b = block0 + 1; b < block1; b++) {
-      const SeqBlock &theBlock = mBlock[b];
-      const auto &sb = theBlock.sb;
+   for (auto iter = mBlock.At(block0 + 1); iter.Index() < block1; ++iter) {
+      const auto &sb = iter->sb;
       auto results = sb->GetMinMaxRMS(mayThrow);
 
       const auto fileLen = sb->GetSampleCount();
@@ -393,8 +405,6 @@ std::unique_ptr<Sequence> Sequence::Copy( const SampleBlockFactoryPtr &pFactory,
    wxUnusedVar(numBlocks);
    wxASSERT(b0 <= b1);
 
-   dest->mBlock.reserve(b1 - b0 + 1);
-
    auto bufferSize = mMaxSamples;
    SampleBuffer buffer(bufferSize, mSampleFormat);
 
@@ -418,10 +428,16 @@ std::unique_ptr<Sequence> Sequence::Copy( const SampleBlockFactoryPtr &pFactory,
       --b0;
 
    // If there are blocks in the middle, use the blocks whole
-   for (int bb = b0 + 1; bb < b1; ++bb)
-      AppendBlock(pUseFactory, mSampleFormat,
-         dest->mBlock, dest->mNumSamples, mBlock[bb]);
-      // Increase ref count or duplicate file
+   if (!pUseFactory) {
+      // Share them all at once
+      dest->mBlock.Append(mBlock.Slice(b0 + 1, b1));
+      dest->mNumSamples = dest->mBlock.GetNumSamples();
+   }
+   else
+      for (auto iter = mBlock.At(b0 + 1); (int)iter.Index() < b1; ++iter)
+         AppendBlock(pUseFactory, mSampleFormat,
+            dest->mBlock, dest->mNumSamples, *iter);
+         // Duplicate file
 
    // Do the last block
    if (b1 > b0) {
@@ -528,21 +544,28 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
       // Build and swap a copy so there is a strong exception safety guarantee
       BlockArray newBlock{ mBlock };
       sampleCount samples = mNumSamples;
-      for (unsigned int i = 0; i < srcNumBlocks; i++)
-         // AppendBlock may throw for limited disk space, if pasting from
-         // one project into another.
-         AppendBlock(pUseFactory, mSampleFormat,
-            newBlock, samples, srcBlock[i]);
+      if (!pUseFactory) {
+         // Share all of the blocks at once
+         newBlock.Append(srcBlock);
+         samples += addedLen;
+      }
+      else
+         for (const auto &block : srcBlock)
+            // AppendBlock may throw for limited disk space, if pasting from
+            // one project into another.
+            AppendBlock(pUseFactory, mSampleFormat,
+               newBlock, samples, block);
 
       CommitChangesIfConsistent
-         (newBlock, samples, wxT("Paste branch one"));
+         (newBlock, samples, wxT("Paste branch one"),
+          numBlocks, newBlock.size());
       return;
    }
 
    const int b = (s == mNumSamples) ? mBlock.size() - 1 : FindBlock(s);
    wxASSERT((b >= 0) && (b < (int)numBlocks));
-   SeqBlock *const pBlock = &mBlock[b];
-   const auto length = pBlock->sb->GetSampleCount();
+   const SeqBlock block = mBlock[b];
+   const auto length = block.sb->GetSampleCount();
    const auto largerBlockLen = addedLen + length;
    // PRL: when insertion point is the first sample of a block,
    // and the following test fails, perhaps we could test
@@ -551,7 +574,6 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
       // Special case: we can fit all of the NEW samples inside of
       // one block!
 
-      SeqBlock &block = *pBlock;
       // largerBlockLen is not more than mMaxSamples...
       SampleBuffer buffer(largerBlockLen.as_size_t(), mSampleFormat);
 
@@ -567,23 +589,23 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
            splitPoint, length - splitPoint, true);
 
       // largerBlockLen is not more than mMaxSamples...
-      block.sb = mpFactory->Create(
+      auto sb = mpFactory->Create(
          buffer.ptr(),
          largerBlockLen.as_size_t(),
          mSampleFormat);
 
       // Don't make a duplicate array.  We can still give Strong-guarantee
-      // if we modify only one block in place.
+      // if we modify only one block in place.  The starts of the following
+      // blocks are implied and need no change.
+      mBlock.Replace(b, sb);
 
       // use No-fail-guarantee in remaining steps
-      for (unsigned int i = b + 1; i < numBlocks; i++)
-         mBlock[i].start += addedLen;
-
       mNumSamples += addedLen;
 
       // This consistency check won't throw, it asserts.
       // Proof that we kept consistency is not hard.
-      ConsistencyCheck(wxT("Paste branch two"), false);
+      ConsistencyCheck(mBlock, mMaxSamples, b, b + 1, mNumSamples,
+         wxT("Paste branch two"), false);
       return;
    }
 
@@ -591,16 +613,13 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
    // it's simplest to just lump all the data together
    // into one big block along with the split block,
    // then resplit it all
-   BlockArray newBlock;
-   newBlock.reserve(numBlocks + srcNumBlocks + 2);
-   newBlock.insert(newBlock.end(), mBlock.begin(), mBlock.begin() + b);
+   BlockArray newBlock = mBlock.Slice(0, b);
 
-   SeqBlock &splitBlock = mBlock[b];
+   const SeqBlock &splitBlock = block;
    auto splitLen = splitBlock.sb->GetSampleCount();
    // s lies within splitBlock
    auto splitPoint = ( s - splitBlock.start ).as_size_t();
 
-   unsigned int i;
    if (srcNumBlocks <= 4) {
 
       // addedLen is at most four times maximum block size
@@ -646,12 +665,15 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
       Blockify(*mpFactory, mMaxSamples, mSampleFormat,
                newBlock, splitBlock.start, sampleBuffer.ptr(), leftLen);
 
-      for (i = 2; i < srcNumBlocks - 2; i++) {
-         const SeqBlock &block = srcBlock[i];
-         auto sb = ShareOrCopySampleBlock(
-            pUseFactory, mSampleFormat, block.sb );
-         newBlock.push_back(SeqBlock(sb, block.start + s));
-      }
+      if (!pUseFactory)
+         newBlock.Append(srcBlock.Slice(2, srcNumBlocks - 2));
+      else
+         for (auto iter = srcBlock.At(2);
+              iter.Index() < srcNumBlocks - 2; ++iter) {
+            auto sb = ShareOrCopySampleBlock(
+               pUseFactory, mSampleFormat, iter->sb );
+            newBlock.push_back(SeqBlock(sb, iter->start + s));
+         }
 
       auto lastStart = penultimate.start;
       src->Get(srcNumBlocks - 2, sampleBuffer.ptr(), mSampleFormat,
@@ -663,13 +685,14 @@ void Sequence::Paste(sampleCount s, const Sequence *src)
                newBlock, s + lastStart, sampleBuffer.ptr(), rightLen);
    }
 
-   // Copy remaining blocks to NEW block array and
+   // Share remaining blocks into NEW block array and
    // swap the NEW block array in for the old
-   for (i = b + 1; i < numBlocks; i++)
-      newBlock.push_back(mBlock[i].Plus(addedLen));
+   const auto changedEnd = newBlock.size();
+   newBlock.Append(mBlock.Slice(b + 1, numBlocks));
 
    CommitChangesIfConsistent
-      (newBlock, mNumSamples + addedLen, wxT("Paste branch three"));
+      (newBlock, mNumSamples + addedLen, wxT("Paste branch three"),
+       b, changedEnd);
 }
 
 /*! @excsafety{Strong} */
@@ -699,11 +722,6 @@ void Sequence::InsertSilence(sampleCount s0, sampleCount len)
 
    sampleCount pos = 0;
 
-   // Could nBlocks overflow a size_t?  Not very likely.  You need perhaps
-   // 2 ^ 52 samples which is over 3000 years at 44.1 kHz.
-   auto nBlocks = (len + idealSamples - 1) / idealSamples;
-   sTrack.mBlock.reserve(nBlocks.as_size_t());
-
    if (len >= idealSamples) {
       auto silentFile = factory.CreateSilent(
          idealSamples,
@@ -827,6 +845,22 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
          }
       }
 
+      // The start is implied by the lengths of the preceding blocks
+      const auto numSamples = mBlock.GetNumSamples();
+      if (wb.start != numSamples)
+      {
+         wxLogWarning(
+            wxT("Gap detected in project file.\n")
+            wxT("   Start (%s) for block file %lld is not one sample past end of previous block (%s).\n")
+            wxT("   Moving start so blocks are contiguous."),
+            // PRL:  Why bother with Internat when the above is just wxT?
+            Internat::ToString(wb.start.as_double(), 0),
+            wb.sb->GetBlockID(),
+            Internat::ToString(numSamples.as_double(), 0));
+         wb.start = numSamples;
+         mErrorOpening = true;
+      }
+
       mBlock.push_back(wb);
 
       return true;
@@ -908,26 +942,9 @@ void Sequence::HandleXMLEndTag(const wxChar *tag)
 
    // Make sure that the sequence is valid.
 
-   // Make sure that start times and lengths are consistent
-   sampleCount numSamples = 0;
-   for (unsigned b = 0, nn = mBlock.size(); b < nn;  b++)
-   {
-      SeqBlock &block = mBlock[b];
-      if (block.start != numSamples)
-      {
-         wxLogWarning(
-            wxT("Gap detected in project file.\n")
-            wxT("   Start (%s) for block file %lld is not one sample past end of previous block (%s).\n")
-            wxT("   Moving start so blocks are contiguous."),
-            // PRL:  Why bother with Internat when the above is just wxT?
-            Internat::ToString(block.start.as_double(), 0),
-            block.sb->GetBlockID(),
-            Internat::ToString(numSamples.as_double(), 0));
-         block.start = numSamples;
-         mErrorOpening = true;
-      }
-      numSamples += block.sb->GetSampleCount();
-   }
+   // Starts of blocks were already made contiguous; make sure that the
+   // total length is consistent
+   const auto numSamples = mBlock.GetNumSamples();
 
    if (mNumSamples != numSamples)
    {
@@ -955,17 +972,13 @@ XMLTagHandler *Sequence::HandleXMLChild(const wxChar *tag)
 void Sequence::WriteXML(XMLWriter &xmlFile) const
 // may throw
 {
-   unsigned int b;
-
    xmlFile.StartTag(wxT("sequence"));
 
    xmlFile.WriteAttr(wxT("maxsamples"), mMaxSamples);
    xmlFile.WriteAttr(wxT("sampleformat"), (size_t)mSampleFormat);
    xmlFile.WriteAttr(wxT("numsamples"), mNumSamples.as_long_long() );
 
-   for (b = 0; b < mBlock.size(); b++) {
-      const SeqBlock &bb = mBlock[b];
-
+   for (const auto &bb : mBlock) {
       // See http://bugzilla.audacityteam.org/show_bug.cgi?id=451.
       if (bb.sb->GetSampleCount() > mMaxSamples)
       {
@@ -1003,44 +1016,13 @@ int Sequence::FindBlock(sampleCount pos) const
    if (pos == 0)
       return 0;
 
-   int numBlocks = mBlock.size();
+   const int rval = mBlock.FindBlock(pos);
 
-   size_t lo = 0, hi = numBlocks, guess;
-   sampleCount loSamples = 0, hiSamples = mNumSamples;
-
-   while (true) {
-      //this is not a binary search, but a
-      //dictionary search where we guess something smarter than the binary division
-      //of the unsearched area, since samples are usually proportional to block file number.
-      const double frac = (pos - loSamples).as_double() /
-         (hiSamples - loSamples).as_double();
-      guess = std::min(hi - 1, lo + size_t(frac * (hi - lo)));
-      const SeqBlock &block = mBlock[guess];
-
-      wxASSERT(block.sb->GetSampleCount() > 0);
-      wxASSERT(lo <= guess && guess < hi && lo < hi);
-
-      if (pos < block.start) {
-         wxASSERT(lo != guess);
-         hi = guess;
-         hiSamples = block.start;
-      }
-      else {
-         const sampleCount nextStart = block.start + block.sb->GetSampleCount();
-         if (pos < nextStart)
-            break;
-         else {
-            wxASSERT(guess < hi - 1);
-            lo = guess + 1;
-            loSamples = nextStart;
-         }
-      }
-   }
-
-   const int rval = guess;
-   wxASSERT(rval >= 0 && rval < numBlocks &&
-            pos >= mBlock[rval].start &&
-            pos < mBlock[rval].start + mBlock[rval].sb->GetSampleCount());
+#ifdef VERY_SLOW_CHECKING
+   const SeqBlock block = mBlock[rval];
+   wxASSERT(pos >= block.start &&
+            pos < block.start + block.sb->GetSampleCount());
+#endif
 
    return rval;
 }
@@ -1089,8 +1071,8 @@ bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
    sampleCount start, size_t len, bool mayThrow) const
 {
    bool result = true;
-   while (len) {
-      const SeqBlock &block = mBlock[b];
+   for (auto iter = mBlock.At(b); len; ++iter) {
+      const SeqBlock &block = *iter;
       // start is in block
       const auto bstart = (start - block.start).as_size_t();
       // bstart is not more than block length
@@ -1101,7 +1083,6 @@ bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
 
       len -= blen;
       buffer += (blen * SAMPLE_SIZE(format));
-      b++;
       start += blen;
    }
    return result;
@@ -1129,18 +1110,18 @@ void Sequence::SetSamples(constSamplePtr buffer, sampleFormat format,
    }
 
    int b = FindBlock(start);
-   BlockArray newBlock;
-   std::copy( mBlock.begin(), mBlock.begin() + b, std::back_inserter(newBlock) );
+   const auto changedBegin = b;
+   BlockArray newBlock = mBlock.Slice(0, b);
 
-   while (len > 0
+   for (auto iter = mBlock.At(b); len > 0
       // Redundant termination condition,
       // but it guards against infinite loop in case of inconsistencies
       // (too-small files, not yet seen?)
       // that cause the loop to make no progress because blen == 0
-      && b < (int)size
+      && b < (int)size;
+      ++iter
    ) {
-      newBlock.push_back( mBlock[b] );
-      SeqBlock &block = newBlock.back();
+      SeqBlock block = *iter;
       // start is within block
       const auto bstart = ( start - block.start ).as_size_t();
       const auto fileLength = block.sb->GetSampleCount();
@@ -1203,6 +1184,8 @@ void Sequence::SetSamples(constSamplePtr buffer, sampleFormat format,
             block.sb = factory.CreateSilent(fileLength, mSampleFormat);
       }
 
+      newBlock.push_back( block );
+
       // blen might be zero for inconsistent Sequence...
       if( buffer )
          buffer += (blen * SAMPLE_SIZE(format));
@@ -1214,9 +1197,11 @@ void Sequence::SetSamples(constSamplePtr buffer, sampleFormat format,
       b++;
    }
 
-   std::copy( mBlock.begin() + b, mBlock.end(), std::back_inserter(newBlock) );
+   const auto changedEnd = newBlock.size();
+   newBlock.Append( mBlock.Slice( b, size ) );
 
-   CommitChangesIfConsistent( newBlock, mNumSamples, wxT("SetSamples") );
+   CommitChangesIfConsistent( newBlock, mNumSamples, wxT("SetSamples"),
+      changedBegin, changedEnd );
 }
 
 namespace {
@@ -1225,34 +1210,16 @@ struct MinMaxSumsq
 {
    MinMaxSumsq(const float *pv, int count, int divisor)
    {
-      min = FLT_MAX, max = -FLT_MAX, sumsq = 0.0f;
-      while (count--) {
-         float v;
-         switch (divisor) {
-         default:
-         case 1:
-            // array holds samples
-            v = *pv++;
-            if (v < min)
-               min = v;
-            if (v > max)
-               max = v;
-            sumsq += v * v;
-            break;
-         case 256:
-         case 65536:
-            // array holds triples of min, max, and rms values
-            v = *pv++;
-            if (v < min)
-               min = v;
-            v = *pv++;
-            if (v > max)
-               max = v;
-            v = *pv++;
-            sumsq += v * v;
-            break;
-         }
-      }
+      min = FLT_MAX, max = -FLT_MAX;
+      double sum = 0.0;
+      if (divisor == 1)
+         // array holds samples
+         SampleStatistics::Accumulate(pv, count, min, max, sum);
+      else
+         // array holds triples of min, max, and rms values of one of the
+         // SummaryDivisors levels
+         SampleStatistics::AccumulateFrames(pv, count, min, max, sum);
+      sumsq = sum;
    }
 
    float min;
@@ -1290,7 +1257,8 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
    // not more than once
    unsigned nBlocks = mBlock.size();
    const unsigned int block0 = FindBlock(s0);
-   for (unsigned int b = block0; b < nBlocks; ++b) {
+   auto iter = mBlock.At(block0);
+   for (unsigned int b = block0; b < nBlocks; ++b, ++iter) {
       if (b > block0)
          srcX = nextSrcX;
       if (srcX >= s1)
@@ -1298,7 +1266,7 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
 
       // Find the range of sample values for this block that
       // are in the display.
-      const SeqBlock &seqBlock = mBlock[b];
+      const SeqBlock &seqBlock = *iter;
       const auto start = seqBlock.start;
       nextSrcX = std::min(s1, start + seqBlock.sb->GetSampleCount());
 
@@ -1331,13 +1299,14 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
       if (nextPixel == len)
          whereNext = s1;
 
-      // Decide the summary level
+      // Decide the summary level:  the coarsest that still has at least one
+      // frame for each pixel column
       const double samplesPerPixel =
          (whereNext - whereNow).as_double() / (nextPixel - pixel);
-      const int divisor =
-           (samplesPerPixel >= 65536) ? 65536
-         : (samplesPerPixel >= 256) ? 256
-         : 1;
+      int divisor = 1;
+      for (auto levelDivisor : SummaryDivisors)
+         if (samplesPerPixel >= levelDivisor)
+            divisor = levelDivisor;
 
       int blockStatus = b;
 
@@ -1364,26 +1333,15 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
       }
 
       // Read from the block file or its summary
-      switch (divisor) {
-      default:
-      case 1:
+      if (divisor == 1)
          // Read samples
          // no-throw for display operations!
          Read((samplePtr)temp.get(), floatSample, seqBlock, startPosition, num, false);
-         break;
-      case 256:
-         // Read triples
-         // Ignore the return value.
-         // This function fills with zeroes if read fails
-         seqBlock.sb->GetSummary256(temp.get(), startPosition, num);
-         break;
-      case 65536:
+      else
          // Read triples
          // Ignore the return value.
          // This function fills with zeroes if read fails
-         seqBlock.sb->GetSummary64k(temp.get(), startPosition, num);
-         break;
-      }
+         seqBlock.sb->GetSummary(divisor, temp.get(), startPosition, num);
       
       auto filePosition = startPosition;
 
@@ -1491,7 +1449,7 @@ void Sequence::AppendSharedBlock(const SeqBlock::SampleBlockPtr &pBlock)
       THROW_INCONSISTENCY_EXCEPTION;
 
    BlockArray newBlock;
-   newBlock.emplace_back( pBlock, mNumSamples );
+   newBlock.push_back( SeqBlock( pBlock, mNumSamples ) );
    auto newNumSamples = mNumSamples + len;
 
    AppendBlocksIfConsistent(newBlock, false,
@@ -1531,20 +1489,24 @@ SeqBlock::SampleBlockPtr Sequence::DoAppend(
 
    // If the last block is not full, we need to add samples to it
    int numBlocks = mBlock.size();
-   SeqBlock *pLastBlock;
-   decltype(pLastBlock->sb->GetSampleCount()) length;
+   SeqBlock lastBlock;
+   size_t length;
    size_t bufferSize = mMaxSamples;
    SampleBuffer buffer2(bufferSize, mSampleFormat);
    bool replaceLast = false;
    if (coalesce &&
        numBlocks > 0 &&
        (length =
-        (pLastBlock = &mBlock.back())->sb->GetSampleCount()) < mMinSamples) {
+        (lastBlock = mBlock.back()).sb->GetSampleCount()) < mMinSamples) {
       // Enlarge a sub-minimum block at the end
-      const SeqBlock &lastBlock = *pLastBlock;
       const auto addLen = std::min(mMaxSamples - length, len);
 
-      Read(buffer2.ptr(), mSampleFormat, lastBlock, 0, length, true);
+      CheckTail();
+      if (mpTailBlock && mTailLen == mTailCommitted)
+         // The open tail holds the samples already
+         memcpy(buffer2.ptr(), mTail.ptr(), length * SAMPLE_SIZE(mSampleFormat));
+      else
+         Read(buffer2.ptr(), mSampleFormat, lastBlock, 0, length, true);
 
       CopySamples(buffer,
                   format,
@@ -1604,6 +1566,142 @@ SeqBlock::SampleBlockPtr Sequence::DoAppend(
    return result;
 }
 
+/*! @excsafety{Partial}
+ -- Some prefix (maybe none) of the buffer is appended,
+and no content already committed is lost. */
+bool Sequence::AppendBuffered(constSamplePtr buffer, sampleFormat format,
+   size_t len, unsigned int stride)
+{
+   bool result = false;
+
+   if (len == 0)
+      return result;
+
+   // Quick check to make sure that it doesn't overflow
+   if (Overflows(mNumSamples.as_double() + GetAppendBufferLen() + len))
+      THROW_INCONSISTENCY_EXCEPTION;
+
+   if (!mTail.ptr())
+      mTail.Allocate(mMaxSamples, mSampleFormat);
+
+   CheckTail();
+   if (mTailLen == 0 && !mBlock.empty()) {
+      // Open a sub-minimum last block as the tail.  This reads it back only
+      // if it was not made by this tail.
+      const auto lastBlock = mBlock.back();
+      const auto length = lastBlock.sb->GetSampleCount();
+      if (length < mMinSamples) {
+         Read(mTail.ptr(), mSampleFormat, lastBlock, 0, length, true);
+         mTailLen = mTailCommitted = length;
+         mpTailBlock = lastBlock.sb;
+      }
+   }
+
+   if (mTailLen == 0 && stride == 1 && format == mSampleFormat &&
+       len >= mMaxSamples) {
+      // Make whole blocks directly from the buffer, not copying through the
+      // tail
+      const auto nBlocks = len / mMaxSamples;
+      const auto blockBytes = mMaxSamples * SAMPLE_SIZE(mSampleFormat);
+      BlockArray newBlock;
+      auto newNumSamples = mNumSamples;
+      for (size_t ii = 0; ii < nBlocks; ++ii) {
+         newBlock.push_back(SeqBlock(
+            mpFactory->Create(buffer, mMaxSamples, mSampleFormat),
+            newNumSamples));
+         buffer += blockBytes;
+         newNumSamples += mMaxSamples;
+      }
+      // use Strong-guarantee
+      AppendBlocksIfConsistent(newBlock, false,
+                               newNumSamples, wxT("Append"));
+      len -= nBlocks * mMaxSamples;
+      result = true;
+   }
+
+   while (len) {
+      // use No-fail-guarantee for the copy
+      const auto toCopy = std::min(len, mMaxSamples - mTailLen);
+      CopySamples(buffer, format,
+         mTail.ptr() + mTailLen * SAMPLE_SIZE(mSampleFormat), mSampleFormat,
+         toCopy,
+         true, // high quality
+         stride);
+      mTailLen += toCopy;
+      buffer += toCopy * SAMPLE_SIZE(format) * stride;
+      len -= toCopy;
+
+      if (mTailLen == mMaxSamples) {
+         // use Strong-guarantee
+         CommitTail();
+         result = true;
+      }
+   }
+
+   return result;
+}
+
+/*! @excsafety{Partial}
+-- The appended samples are committed, or else discarded; no previously
+committed contents are lost. */
+void Sequence::Flush()
+{
+   CheckTail();
+   if (mTailLen > mTailCommitted) {
+      auto cleanup = finally( [&] {
+         // Discard the uncommitted samples even in case of failure, so as not
+         // to leave the sequence in an un-flushed state
+         if (mTailLen > mTailCommitted)
+            DiscardTail();
+      } );
+      CommitTail();
+   }
+}
+
+void Sequence::CheckTail()
+{
+   if (mpTailBlock && (mBlock.empty() || mBlock.back().sb != mpTailBlock)) {
+      // Other edits replaced the block; keep only the uncommitted samples
+      const auto sampleSize = SAMPLE_SIZE(mSampleFormat);
+      memmove(mTail.ptr(), mTail.ptr() + mTailCommitted * sampleSize,
+         (mTailLen - mTailCommitted) * sampleSize);
+      mTailLen -= mTailCommitted;
+      mTailCommitted = 0;
+      mpTailBlock.reset();
+   }
+}
+
+/*! @excsafety{Strong} */
+void Sequence::CommitTail()
+{
+   auto pBlock = mpFactory->Create(mTail.ptr(), mTailLen, mSampleFormat);
+
+   const bool replaceLast = (mpTailBlock != nullptr);
+   const auto newNumSamples = mNumSamples - mTailCommitted + mTailLen;
+   BlockArray newBlock;
+   newBlock.push_back(SeqBlock(pBlock, mNumSamples - mTailCommitted));
+   AppendBlocksIfConsistent(newBlock, replaceLast,
+                            newNumSamples, wxT("Append"));
+
+   // use No-fail-guarantee for the rest
+   if (mTailLen < mMinSamples) {
+      // Keep the samples, to grow the block again at the next append
+      mTailCommitted = mTailLen;
+      mpTailBlock = pBlock;
+   }
+   else {
+      mTailLen = mTailCommitted = 0;
+      mpTailBlock.reset();
+   }
+}
+
+void Sequence::DiscardTail()
+{
+   mTail.Free();
+   mTailLen = mTailCommitted = 0;
+   mpTailBlock.reset();
+}
+
 void Sequence::Blockify(SampleBlockFactory &factory,
                         size_t mMaxSamples, sampleFormat mSampleFormat,
                         BlockArray &list, sampleCount start,
@@ -1613,7 +1711,6 @@ void Sequence::Blockify(SampleBlockFactory &factory,
       return;
 
    auto num = (len + (mMaxSamples - 1)) / mMaxSamples;
-   list.reserve(list.size() + num);
 
    for (decltype(num) i = 0; i < num; i++) {
       SeqBlock b;
@@ -1647,8 +1744,8 @@ void Sequence::Delete(sampleCount start, sampleCount len)
 
    auto sampleSize = SAMPLE_SIZE(mSampleFormat);
 
-   SeqBlock *pBlock;
-   decltype(pBlock->sb->GetSampleCount()) length;
+   SeqBlock b;
+   size_t length;
 
    // One buffer for reuse in various branches here
    SampleBuffer scratch;
@@ -1659,8 +1756,7 @@ void Sequence::Delete(sampleCount start, sampleCount len)
    // block and the resulting length is not too small, perform the
    // deletion within this block:
    if (b0 == b1 &&
-       (length = (pBlock = &mBlock[b0])->sb->GetSampleCount()) - len >= mMinSamples) {
-      SeqBlock &b = *pBlock;
+       (length = (b = mBlock[b0]).sb->GetSampleCount()) - len >= mMinSamples) {
       // start is within block
       auto pos = ( start - b.start ).as_size_t();
 
@@ -1681,32 +1777,27 @@ void Sequence::Delete(sampleCount start, sampleCount len)
            // is not more than the length of the block
            ( pos + len ).as_size_t(), newLen - pos, true);
 
-      b.sb = factory.Create(scratch.ptr(), newLen, mSampleFormat);
+      auto sb = factory.Create(scratch.ptr(), newLen, mSampleFormat);
 
       // Don't make a duplicate array.  We can still give Strong-guarantee
-      // if we modify only one block in place.
+      // if we modify only one block in place.  The starts of the following
+      // blocks are implied and need no change.
+      mBlock.Replace(b0, sb);
 
       // use No-fail-guarantee in remaining steps
-
-      for (unsigned int j = b0 + 1; j < numBlocks; j++)
-         mBlock[j].start -= len;
-
       mNumSamples -= len;
 
       // This consistency check won't throw, it asserts.
       // Proof that we kept consistency is not hard.
-      ConsistencyCheck(wxT("Delete - branch one"), false);
+      ConsistencyCheck(mBlock, mMaxSamples, b0, b0 + 1, mNumSamples,
+         wxT("Delete - branch one"), false);
       return;
    }
 
-   // Create a NEW array of blocks
-   BlockArray newBlock;
-   newBlock.reserve(numBlocks - (b1 - b0) + 2);
-
-   // Copy the blocks before the deletion point over to
-   // the NEW array
-   newBlock.insert(newBlock.end(), mBlock.begin(), mBlock.begin() + b0);
-   unsigned int i;
+   // Create a NEW array of blocks, sharing the blocks before the
+   // deletion point
+   BlockArray newBlock = mBlock.Slice(0, b0);
+   auto changedBegin = b0;
 
    // First grab the samples in block b0 before the deletion point
    // into preBuffer.  If this is enough samples for its own block,
@@ -1741,6 +1832,7 @@ void Sequence::Delete(sampleCount start, sampleCount len)
               preBlock, 0, preBufferLen, true);
 
          newBlock.pop_back();
+         --changedBegin;
          Blockify(*mpFactory, mMaxSamples, mSampleFormat,
                   newBlock, prepreBlock.start, scratch.ptr(), sum);
       }
@@ -1773,7 +1865,7 @@ void Sequence::Delete(sampleCount start, sampleCount len)
 
          newBlock.push_back(SeqBlock(file, start));
       } else {
-         SeqBlock &postpostBlock = mBlock[b1 + 1];
+         const SeqBlock &postpostBlock = mBlock[b1 + 1];
          const auto postpostLen = postpostBlock.sb->GetSampleCount();
          const auto sum = postpostLen + postBufferLen;
 
@@ -1796,21 +1888,23 @@ void Sequence::Delete(sampleCount start, sampleCount len)
       // right on the end of a block.
    }
 
-   // Copy the remaining blocks over from the old array
-   for (i = b1 + 1; i < numBlocks; i++)
-      newBlock.push_back(mBlock[i].Plus(-len));
+   // Share the remaining blocks from the old array
+   const auto changedEnd = newBlock.size();
+   newBlock.Append(mBlock.Slice(b1 + 1, numBlocks));
 
    CommitChangesIfConsistent
-      (newBlock, mNumSamples - len, wxT("Delete - branch two"));
+      (newBlock, mNumSamples - len, wxT("Delete - branch two"),
+       changedBegin, changedEnd);
 }
 
 void Sequence::ConsistencyCheck(const wxChar *whereStr, bool mayThrow) const
 {
-   ConsistencyCheck(mBlock, mMaxSamples, 0, mNumSamples, whereStr, mayThrow);
+   ConsistencyCheck(mBlock, mMaxSamples, 0, mBlock.size(), mNumSamples,
+      whereStr, mayThrow);
 }
 
 void Sequence::ConsistencyCheck
-   (const BlockArray &mBlock, size_t maxSamples, size_t from,
+   (const BlockArray &mBlock, size_t maxSamples, size_t from, size_t to,
     sampleCount mNumSamples, const wxChar *whereStr,
     bool WXUNUSED(mayThrow))
 {
@@ -1818,29 +1912,22 @@ void Sequence::ConsistencyCheck
    // gives a little more discrimination
    Optional<InconsistencyException> ex;
 
-   unsigned int numBlocks = mBlock.size();
-
-   unsigned int i;
-   sampleCount pos = from < numBlocks ? mBlock[from].start : mNumSamples;
-   if ( from == 0 && pos != 0 )
+   // Starts of blocks are implied by the lengths, and can't be inconsistent;
+   // so only the total, and the lengths of blocks that are new, need checking
+   if ( mBlock.GetNumSamples() != mNumSamples )
       ex.emplace( CONSTRUCT_INCONSISTENCY_EXCEPTION );
 
-   for (i = from; !ex && i < numBlocks; i++) {
-      const SeqBlock &seqBlock = mBlock[i];
-      if (pos != seqBlock.start)
-         ex.emplace( CONSTRUCT_INCONSISTENCY_EXCEPTION );
-
+   for (auto iter = mBlock.At(from), end = mBlock.At(to);
+        !ex && iter != end; ++iter) {
+      const SeqBlock &seqBlock = *iter;
       if ( seqBlock.sb ) {
          const auto length = seqBlock.sb->GetSampleCount();
          if (length > maxSamples)
             ex.emplace( CONSTRUCT_INCONSISTENCY_EXCEPTION );
-         pos += length;
       }
       else
          ex.emplace( CONSTRUCT_INCONSISTENCY_EXCEPTION );
    }
-   if ( !ex && pos != mNumSamples )
-      ex.emplace( CONSTRUCT_INCONSISTENCY_EXCEPTION );
 
    if ( ex )
    {
@@ -1861,9 +1948,10 @@ void Sequence::ConsistencyCheck
 }
 
 void Sequence::CommitChangesIfConsistent
-   (BlockArray &newBlock, sampleCount numSamples, const wxChar *whereStr)
+   (BlockArray &newBlock, sampleCount numSamples, const wxChar *whereStr,
+    size_t from, size_t to)
 {
-   ConsistencyCheck( newBlock, mMaxSamples, 0, numSamples, whereStr ); // may throw
+   ConsistencyCheck( newBlock, mMaxSamples, from, to, numSamples, whereStr ); // may throw
 
    // now commit
    // use No-fail-guarantee
@@ -1882,50 +1970,36 @@ void Sequence::AppendBlocksIfConsistent
    if (additionalBlocks.empty())
       return;
 
-   bool tmpValid = false;
-   SeqBlock tmp;
+   // Copying is cheap, and leaves this unchanged if anything throws
+   BlockArray newBlock{ mBlock };
+   if ( replaceLast && ! newBlock.empty() )
+      newBlock.pop_back();
 
-   if ( replaceLast && ! mBlock.empty() ) {
-      tmp = mBlock.back(), tmpValid = true;
-      mBlock.pop_back();
-   }
-
-   auto prevSize = mBlock.size();
-
-   bool consistent = false;
-   auto cleanup = finally( [&] {
-      if ( !consistent ) {
-         mBlock.resize( prevSize );
-         if ( tmpValid )
-            mBlock.push_back( tmp );
-      }
-   } );
-
-   std::copy( additionalBlocks.begin(), additionalBlocks.end(),
-              std::back_inserter( mBlock ) );
+   const auto prevSize = newBlock.size();
+   newBlock.Append( additionalBlocks );
 
    // Check consistency only of the blocks that were added,
    // avoiding quadratic time for repeated checking of repeating appends
-   ConsistencyCheck( mBlock, mMaxSamples, prevSize, numSamples, whereStr ); // may throw
+   ConsistencyCheck( newBlock, mMaxSamples, prevSize, newBlock.size(),
+      numSamples, whereStr ); // may throw
 
    // now commit
    // use No-fail-guarantee
 
+   mBlock.swap(newBlock);
    mNumSamples = numSamples;
-   consistent = true;
 }
 
 void Sequence::DebugPrintf
    (const BlockArray &mBlock, sampleCount mNumSamples, wxString *dest)
 {
-   unsigned int i;
+   unsigned int i = 0;
    decltype(mNumSamples) pos = 0;
 
-   for (i = 0; i < mBlock.size(); i++) {
-      const SeqBlock &seqBlock = mBlock[i];
+   for (const auto &seqBlock : mBlock) {
       *dest += wxString::Format
          (wxT("   Block %3u: start %8lld, len %8lld, refs %ld, id %lld"),
-          i,
+          i++,
           seqBlock.start.as_long_long(),
           seqBlock.sb ? (long long) seqBlock.sb->GetSampleCount() : 0,
           seqBlock.sb ? seqBlock.sb.use_count() : 0,
@@ -14,6 +14,7 @@
 #include <vector>
 #include <functional>
 
+#include "BlockArray.h"
 #include "SampleFormat.h"
 #include "xml/XMLTagHandler.h"
 
@@ -23,29 +24,6 @@ class SampleBlock;
 class SampleBlockFactory;
 using SampleBlockFactoryPtr = std::shared_ptr<SampleBlockFactory>;
 
-// This is an internal data structure!  For advanced use only.
-class SeqBlock {
- public:
-   using SampleBlockPtr = std::shared_ptr<SampleBlock>;
-   SampleBlockPtr sb;
-   ///the sample in the global wavetrack that this block starts at.
-   sampleCount start;
-
-   SeqBlock()
-      : sb{}, start(0)
-   {}
-
-   SeqBlock(const SampleBlockPtr &sb_, sampleCount start_)
-      : sb(sb_), start(start_)
-   {}
-
-   // Construct a SeqBlock with changed start, same file
-   SeqBlock Plus(sampleCount delta) const
-   {
-      return SeqBlock(sb, start + delta);
-   }
-};
-class BlockArray : public std::vector<SeqBlock> {};
 using BlockPtrArray = std::vector<SeqBlock*>; // non-owning pointers
 
 class PROFILE_DLL_API Sequence final : public XMLTagHandler{
@@ -67,6 +45,11 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    Sequence(const Sequence &orig, const SampleBlockFactoryPtr &pFactory);
 
    Sequence( const Sequence& ) = delete;
+
+   //! Whether a copy of this sequence would be the same as other
+   /*! Sample blocks are compared by identity, not by contents */
+   bool IsSameAs(const Sequence &other) const;
+
    Sequence& operator= (const Sequence&) PROHIBITED;
 
    ~Sequence();
@@ -110,12 +93,32 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
       constSamplePtr buffer, sampleFormat format, size_t len);
    //! Append a complete block, not coalescing
    void AppendSharedBlock(const SeqBlock::SampleBlockPtr &pBlock);
+
+   //! Accumulate samples in an open tail block kept in memory
+   /*! The tail is committed to the factory only when it fills, or on Flush.
+       A sub-minimum last block is taken into the tail and grown, without
+       reading it back if the previous Flush made it.  Whole blocks of
+       samples in the sequence's format, without stride, go directly to the
+       factory when the tail is empty.
+       You must call Flush after the last AppendBuffered.
+       @return whether any block was committed */
+   bool AppendBuffered(constSamplePtr buffer, sampleFormat format,
+      size_t len, unsigned int stride = 1);
+   //! Commit samples of the open tail block that are not yet in a block
+   void Flush();
+   //! Number of samples appended but not yet committed
+   /*! They follow the first GetNumSamples() samples */
+   size_t GetAppendBufferLen() const { return mTailLen - mTailCommitted; }
+   //! The samples appended but not yet committed, in the sequence's format
+   constSamplePtr GetAppendBuffer() const
+   { return mTail.ptr() + mTailCommitted * SAMPLE_SIZE(mSampleFormat); }
+
    void Delete(sampleCount start, sampleCount len);
 
    void SetSilence(sampleCount s0, sampleCount len);
    void InsertSilence(sampleCount s0, sampleCount len);
 
-   const SampleBlockFactoryPtr &GetFactory() { return mpFactory; }
+   const SampleBlockFactoryPtr &GetFactory() const { return mpFactory; }
 
    //
    // XMLTagHandler callback methods for loading and saving
@@ -198,6 +201,15 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
 
    bool          mErrorOpening{ false };
 
+   //! Samples of the open tail block, in mSampleFormat
+   /*! The first mTailCommitted of them are those of mpTailBlock, the last
+       block of mBlock, which is kept here so that appends can grow it
+       without reading it back */
+   SampleBuffer  mTail;
+   size_t        mTailLen{ 0 };
+   size_t        mTailCommitted{ 0 };
+   SeqBlock::SampleBlockPtr mpTailBlock;
+
    //
    // Private methods
    //
@@ -207,6 +219,12 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    SeqBlock::SampleBlockPtr DoAppend(
       constSamplePtr buffer, sampleFormat format, size_t len, bool coalesce);
 
+   //! Forget the committed part of the tail if other edits replaced its block
+   void CheckTail();
+   //! Write the tail as a block, replacing mpTailBlock if there is one
+   void CommitTail();
+   void DiscardTail();
+
    static void AppendBlock(SampleBlockFactory *pFactory, sampleFormat format,
                            BlockArray &blocks,
                            sampleCount &numSamples,
@@ -253,8 +271,10 @@ public:
       (const BlockArray &block, sampleCount numSamples, wxString *dest);
 
 private:
+   // Checks the total length, but only the blocks in [from, to), so that
+   // edits need not check the blocks they share unchanged
    static void ConsistencyCheck
-      (const BlockArray &block, size_t maxSamples, size_t from,
+      (const BlockArray &block, size_t maxSamples, size_t from, size_t to,
        sampleCount numSamples, const wxChar *whereStr,
        bool mayThrow = true);
 
@@ -262,8 +282,10 @@ private:
    // They either throw because final consistency check fails, or swap the
    // changed contents into place.
 
+   // Blocks in [from, to) of newBlock are the new ones
    void CommitChangesIfConsistent
-      (BlockArray &newBlock, sampleCount numSamples, const wxChar *whereStr);
+      (BlockArray &newBlock, sampleCount numSamples, const wxChar *whereStr,
+       size_t from, size_t to);
 
    void AppendBlocksIfConsistent
       (BlockArray &additionalBlocks, bool replaceLast,
@@ -0,0 +1,145 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SqliteBlobCache.cpp
+@brief Implements SqliteBlobCache
+
+**********************************************************************/
+
+#include "SqliteBlobCache.h"
+
+#include <algorithm>
+
+#include <sqlite3.h>
+
+SqliteBlobCache::SqliteBlobCache() = default;
+
+SqliteBlobCache::~SqliteBlobCache()
+{
+   Clear();
+}
+
+int SqliteBlobCache::Read(int id, sqlite3 *db,
+   const char *table, const char *column,
+   long long rowid, void *dest, size_t offset, size_t &bytes)
+{
+   Handle *pHandle = nullptr;
+   std::unique_lock<std::mutex> lock;
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      auto &pEntry = mHandles[Index(id, std::this_thread::get_id(), db)];
+      if (!pEntry)
+         pEntry = std::make_unique<Handle>();
+      pHandle = pEntry.get();
+      lock = std::unique_lock<std::mutex>(pHandle->mutex);
+   }
+
+   auto &handle = *pHandle;
+   int rc = SQLITE_OK;
+   // A handle expires when its row is updated or replaced, and then reads
+   // with it fail with SQLITE_ABORT; but a fresh handle reads the row again,
+   // so try once more before failing
+   for (int attempt = 0;; ++attempt)
+   {
+      if (handle.pBlob && handle.rowid != rowid)
+      {
+         rc = sqlite3_blob_reopen(handle.pBlob, rowid);
+         if (rc == SQLITE_OK)
+            handle.rowid = rowid;
+         else
+         {
+            // The row may be newer than the handle's read transaction, or
+            // gone; try again with a fresh handle, which starts a new one
+            sqlite3_blob_close(handle.pBlob);
+            handle.pBlob = nullptr;
+         }
+      }
+
+      if (!handle.pBlob)
+      {
+         rc = sqlite3_blob_open(db, "main", table, column, rowid, 0, &handle.pBlob);
+         if (rc != SQLITE_OK)
+         {
+            sqlite3_blob_close(handle.pBlob);
+            handle.pBlob = nullptr;
+            return rc;
+         }
+         handle.rowid = rowid;
+      }
+
+      const size_t size = sqlite3_blob_bytes(handle.pBlob);
+      auto readOffset = std::min(offset, size);
+      auto readBytes = std::min(bytes, size - readOffset);
+
+      rc = readBytes > 0
+         ? sqlite3_blob_read(handle.pBlob, dest, (int) readBytes, (int) readOffset)
+         : SQLITE_OK;
+      if (rc == SQLITE_OK)
+      {
+         bytes = readBytes;
+         return rc;
+      }
+
+      sqlite3_blob_close(handle.pBlob);
+      handle.pBlob = nullptr;
+      // Perhaps the row was deleted since the handle was moved to it
+      if (rc != SQLITE_ABORT || attempt > 0)
+         return rc;
+   }
+}
+
+void SqliteBlobCache::CloseAll()
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   for (auto &entry : mHandles)
+   {
+      auto &handle = *entry.second;
+      std::lock_guard<std::mutex> handleGuard(handle.mutex);
+      // No need to check return code.
+      sqlite3_blob_close(handle.pBlob);
+      handle.pBlob = nullptr;
+   }
+}
+
+void SqliteBlobCache::CloseForThread(sqlite3 *db)
+{
+   const auto id = std::this_thread::get_id();
+   std::lock_guard<std::mutex> guard(mMutex);
+   for (auto &entry : mHandles)
+   {
+      if (std::get<1>(entry.first) != id || std::get<2>(entry.first) != db)
+         continue;
+      auto &handle = *entry.second;
+      std::lock_guard<std::mutex> handleGuard(handle.mutex);
+      sqlite3_blob_close(handle.pBlob);
+      handle.pBlob = nullptr;
+   }
+}
+
+void SqliteBlobCache::ForgetThread(std::thread::id id)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   for (auto iter = mHandles.begin(); iter != mHandles.end();)
+   {
+      if (std::get<1>(iter->first) == id)
+      {
+         auto &handle = *iter->second;
+         {
+            std::lock_guard<std::mutex> handleGuard(handle.mutex);
+            sqlite3_blob_close(handle.pBlob);
+            handle.pBlob = nullptr;
+         }
+         iter = mHandles.erase(iter);
+      }
+      else
+         ++iter;
+   }
+}
+
+void SqliteBlobCache::Clear()
+{
+   CloseAll();
+   std::lock_guard<std::mutex> guard(mMutex);
+   mHandles.clear();
+}
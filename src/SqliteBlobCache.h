@@ -0,0 +1,76 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SqliteBlobCache.h
+@brief Incremental I/O handles for reading parts of blobs
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SQLITE_BLOB_CACHE__
+#define __AUDACITY_SQLITE_BLOB_CACHE__
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+struct sqlite3;
+struct sqlite3_blob;
+
+//! Blob handles kept open for each kind of blob, thread and connection
+/*! Moving a handle to another row is much cheaper than opening one.  But an
+    open handle holds a read transaction on its connection, so that other
+    statements of the connection see the database as it was when the handle
+    opened, and the write-ahead log can't be reset.  Close the handles to end
+    those transactions; they reopen when next used. */
+class SqliteBlobCache
+{
+public:
+   SqliteBlobCache();
+   ~SqliteBlobCache();
+
+   SqliteBlobCache( const SqliteBlobCache& ) = delete;
+   SqliteBlobCache &operator=( const SqliteBlobCache& ) = delete;
+
+   //! Read part of a blob, with the calling thread's handle for the id and
+   //! connection, moved to the given row as needed
+   /*! Reads that extend past the end of the blob are shortened.  A handle
+       that can't move to the row is replaced, so rows committed since it
+       opened can be read.
+       @param bytes in: bytes wanted; out: bytes read
+       @return an SQLite result code, SQLITE_OK for success */
+   int Read(int id, sqlite3 *db, const char *table, const char *column,
+      long long rowid, void *dest, size_t offset, size_t &bytes);
+
+   //! Close all of the handles; other threads may be reading
+   void CloseAll();
+
+   //! Close the calling thread's handles on the connection, so that its next
+   //! statements see everything committed
+   void CloseForThread(sqlite3 *db);
+
+   //! Close and forget the handles of a thread that has ended
+   void ForgetThread(std::thread::id id);
+
+   //! Close and forget all of the handles; no thread may be reading
+   void Clear();
+
+private:
+   struct Handle
+   {
+      //! Contended only by CloseAll() and CloseForThread()
+      std::mutex mutex;
+      sqlite3_blob *pBlob{ nullptr };
+      long long rowid{ 0 };
+   };
+
+   //! Guards the map, but not the handles, which are used outside of it
+   std::mutex mMutex;
+   using Index = std::tuple<int, std::thread::id, sqlite3 *>;
+   std::map<Index, std::unique_ptr<Handle>> mHandles;
+};
+
+#endif
@@ -8,18 +8,42 @@ Paul Licameli -- split from SampleBlock.cpp and SampleBlock.h
 
 **********************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <float.h>
+#include <thread>
 #include <sqlite3.h>
 
 #include "DBConnection.h"
+#include "Prefs.h"
+#include "Project.h"
 #include "ProjectFileIO.h"
+#include "ProjectSettings.h"
+#include "SampleBlockCache.h"
+#include "SampleBlockCodec.h"
 #include "SampleFormat.h"
+#include "SampleStatistics.h"
 #include "xml/XMLTagHandler.h"
 
 #include "SampleBlock.h" // to inherit
 
 class SqliteSampleBlockFactory;
 
+// Project files from before the summary levels were added lack this table.
+// It is added only in a savepoint that stores summaries, so that merely
+// opening or viewing a project never changes its schema.
+static const char *SummariesTable =
+   "CREATE TABLE IF NOT EXISTS summaries"
+   "("
+   "  blockid              INTEGER,"
+   "  divisor              INTEGER,"
+   "  summary              BLOB,"
+   "  PRIMARY KEY (blockid, divisor)"
+   ");";
+
 ///\brief Implementation of @ref SampleBlock using Sqlite database
 class SqliteSampleBlock final : public SampleBlock
 {
@@ -36,7 +60,50 @@ public:
 
    //! Numbers of bytes needed for 256 and for 64k summaries
    using Sizes = std::pair< size_t, size_t >;
-   void Commit(Sizes sizes);
+
+   //! Summaries of samples, as the row of a block stores them
+   struct Summary
+   {
+      ArrayOf<char> summary256;
+      ArrayOf<char> summary64k;
+      double sumMin{ 0.0 };
+      double sumMax{ 0.0 };
+      double sumRms{ 0.0 };
+   };
+
+   //! Summary of a block whose row was inserted or found without one, to be
+   //! computed by a worker thread of the factory, or by the first reader to
+   //! need it, and stored by the thread that owns the batch, or else by
+   //! SampleBlockFactory::StoreDeferred()
+   struct PendingSummary
+   {
+      std::mutex mutex;
+      //! Set, with mutex held, when summary is complete
+      std::atomic<bool> done{ false };
+      //! Set, with mutex held, when the block is destroyed first
+      bool cancelled{ false };
+      //! Set, with mutex held, when the update of the row has committed;
+      //! until then, summary keeps the arrays
+      bool stored{ false };
+
+      SampleBlockID blockID{ 0 };
+      sampleFormat format{ floatSample };
+      size_t count{ 0 };
+      Sizes sizes;
+      //! Keeps the samples until summarized, even if the cache evicts them
+      SampleBlockCache::ContentsPtr pSamples;
+
+      Summary summary;
+   };
+
+   //! Compute the summary, unless done or cancelled; touches no database
+   /*! @param samples used if pending has no samples of its own */
+   static void CompleteSummary(
+      PendingSummary &pending, constSamplePtr samples = nullptr);
+
+   //! @param pSummary if null, the row is inserted without summaries, and
+   //! the factory's workers compute them later
+   void Commit(Sizes sizes, const Summary *pSummary);
 
    void Delete();
 
@@ -51,6 +118,8 @@ public:
 
    bool GetSummary256(float *dest, size_t frameoffset, size_t numframes) override;
    bool GetSummary64k(float *dest, size_t frameoffset, size_t numframes) override;
+   bool GetSummary(size_t divisor,
+      float *dest, size_t frameoffset, size_t numframes) override;
    double GetSumMin() const;
    double GetSumMax() const;
    double GetSumRms() const;
@@ -67,24 +136,82 @@ public:
 private:
    bool IsSilent() const { return mBlockID <= 0; }
    void Load(SampleBlockID sbid);
-   bool GetSummary(float *dest,
-                   size_t frameoffset,
-                   size_t numframes,
-                   DBConnection::StatementID id,
-                   const char *sql);
+   //! Summarize a row left without summaries when the program ended
+   void RecoverSummary();
+   //! Complete the pending summary, if there is one
+   /*! @return the summary, if it was pending, else null; only its scalars
+       may be used, because the arrays go when the row has them */
+   const Summary *GetCompletedSummary() const;
+   //! Complete the pending summary and copy frames of one of its arrays,
+   //! if the row does not have them yet
+   bool CopyUnstoredSummary(ArrayOf<char> Summary::*pArray, size_t bytes,
+      float *dest, size_t frameoffset, size_t numframes) const;
+   //! @pre pending.mutex is held
+   //! @return false if the update failed
+   static bool StoreSummary(DBConnection &connection,
+      const PendingSummary &pending);
+   //! Free the arrays, after the update of the row has committed
+   //! @pre pending.mutex is held
+   static void MarkStored(PendingSummary &pending);
+   bool GetStoredSummary(float *dest,
+                         size_t frameoffset,
+                         size_t numframes,
+                         DBConnection::StatementID id,
+                         const char *sql);
+   //! Read a level of summary that sampleblocks lacks, computing it first if
+   //! it is not kept yet, and leaving it to the factory to store later
+   bool GetDerivedSummary(size_t divisor,
+                          float *dest,
+                          size_t frameoffset,
+                          size_t numframes);
+   //! @return false if neither the factory nor the summaries table has the
+   //! level
+   bool ReadDerivedSummary(size_t divisor,
+                           float *dest,
+                           size_t frameoffset,
+                           size_t numframes);
+   //! Copy frames of a whole summary level, with the same clipping and zero
+   //! padding as GetBlob()
+   static void CopySummaryFrames(const float *summary, size_t frames,
+      float *dest, size_t frameoffset, size_t numframes);
+   //! Non-throwing
+   void DeleteDerivedSummaries();
    size_t GetBlob(void *dest,
                   sampleFormat destformat,
                   sqlite3_stmt *stmt,
                   sampleFormat srcformat,
                   size_t srcoffset,
                   size_t srcbytes);
+   //! Find the stored samples in the factory's cache, or read and cache them
+   /*! @param wanted bytes that the caller needs
+       @return null only if the block is uncompressed, and either too large
+       ever to be cached, or not cached and wanted is a small part of it */
+   SampleBlockCache::ContentsPtr GetCachedSamples(size_t wanted);
+   //! Read only the requested samples, by incremental blob I/O
+   size_t GetSamplesPart(samplePtr dest,
+                         sampleFormat destformat,
+                         size_t sampleoffset,
+                         size_t numsamples);
+   //! Read and decode all samples of a compressed block
+   void DecodeSamples(samplePtr dest);
 
    enum {
       fields = 3, /* min, max, rms */
       bytesPerFrame = fields * sizeof(float),
+      // Reads of at most this fraction of an uncached block read just the
+      // bytes they need, and don't fill the cache
+      partialReadFraction = 4,
    };
    Sizes SetSizes( size_t numsamples, sampleFormat srcformat );
-   void CalcSummary(Sizes sizes);
+   static void CalcSummary(Sizes sizes, constSamplePtr src,
+      sampleFormat format, size_t count, Summary &summary);
+
+   void GetSamplesMinMaxSumsq(size_t start, size_t len,
+      float &min, float &max, double &sumsq);
+   bool GetSummaryMinMaxSumsq(size_t frame0, size_t frame1,
+      float &min, float &max, double &sumsq);
+   bool GetSummary64kMinMaxSumsq(size_t frame0, size_t frame1,
+      float &min, float &max, double &sumsq);
 
 private:
    //! This must never be called for silent blocks
@@ -107,23 +234,62 @@ private:
    size_t mSampleBytes;
    size_t mSampleCount;
    sampleFormat mSampleFormat;
+   //! How the samples column is encoded
+   SampleBlockCodec::Codec mCodec{ SampleBlockCodec::Raw };
+
+   //! Bytes of samples and summaries in the database row, recorded when
+   //! the row is written or loaded, so that usage needs no page reads
+   size_t mSpaceUsage;
 
-   ArrayOf<char> mSummary256;
-   ArrayOf<char> mSummary64k;
    double mSumMin;
    double mSumMax;
    double mSumRms;
 
+   //! Non-null if the block was created or loaded without its summary;
+   //! then the sums above are not used
+   std::shared_ptr<PendingSummary> mpPending;
+
 #if defined(WORDS_BIGENDIAN)
 #error All sample block data is little endian...big endian not yet supported
 #endif
 };
 
+// The sampleformat column holds the format in the low 24 bits.  For
+// compressed rows, the codec follows, and then the sample count, which can't
+// be deduced from the length of the samples.  Files with such rows have at
+// least ProjectFileIO::ExtensionsVersion.
+static sqlite3_int64 PackFormat(
+   sampleFormat format, SampleBlockCodec::Codec codec, size_t count)
+{
+   if (codec == SampleBlockCodec::Raw)
+      return format;
+   return format |
+      (static_cast<sqlite3_int64>(codec) << 24) |
+      (static_cast<sqlite3_int64>(count) << 32);
+}
+
+static sampleFormat UnpackFormat(sqlite3_int64 stored)
+{
+   return static_cast<sampleFormat>(stored & 0xFFFFFF);
+}
+
+static SampleBlockCodec::Codec UnpackCodec(sqlite3_int64 stored)
+{
+   return static_cast<SampleBlockCodec::Codec>((stored >> 24) & 0xFF);
+}
+
+static size_t UnpackCount(sqlite3_int64 stored)
+{
+   return static_cast<size_t>(stored >> 32);
+}
+
 // Silent blocks use nonpositive id values to encode a length
 // and don't occupy any rows in the database; share blocks for repeatedly
 // used length values
 static std::map< SampleBlockID, std::shared_ptr<SqliteSampleBlock> >
    sSilentBlocks;
+// Blocks may be made on several threads at once, as by parallel import
+static std::mutex sSilentBlocksMutex;
 
 ///\brief Implementation of @ref SampleBlockFactory using Sqlite database
 class SqliteSampleBlockFactory final
@@ -152,29 +318,174 @@ public:
    BlockDeletionCallback SetBlockDeletionCallback(
       BlockDeletionCallback callback ) override;
 
+   void BeginBatch() override;
+   void EndBatch() override;
+   void FlushBatch() override;
+   void StoreDeferred() override;
+
 private:
    friend SqliteSampleBlock;
 
+   //! Called after a block row is inserted; may commit the open batch
+   void OnCommitted(size_t bytes);
+
+   //! Release and reopen the batch savepoint, if enough bytes or time have
+   //! accumulated, on the thread that began it
+   /*! @pre mBatchMutex is held */
+   void CycleBatch();
+
+   //! The codec for new blocks, as the project's settings choose
+   SampleBlockCodec::Codec GetCodec() const;
+
+   using PendingSummaries =
+      std::vector<std::shared_ptr<SqliteSampleBlock::PendingSummary>>;
+
+   //! Whether the summary of a new block may be left to the workers, which
+   //! is so only in a batch, and not when too many summaries are already
+   //! waiting
+   bool CanDeferSummary();
+   //! Queue the summary for the workers, and for storing in the batch
+   /*! @return false if the batch has ended meanwhile, and then the caller
+       must complete the summary and defer it */
+   bool EnqueueSummary(
+      const std::shared_ptr<SqliteSampleBlock::PendingSummary> &pPending);
+   //! Keep a completed summary for storing with the next batch commit or
+   //! StoreDeferred()
+   void DeferSummary(
+      const std::shared_ptr<SqliteSampleBlock::PendingSummary> &pPending);
+   //! Complete all queued summaries, helping the workers
+   void DrainSummaries();
+   //! Update the rows of the completed summaries, in the open savepoint;
+   //! with wait, complete all of them first
+   /*! @pre mBatchMutex is held, and there is no batch or this thread began
+       it
+       @return the summaries written, to be marked stored after commit */
+   PendingSummaries WriteSummaries(bool wait);
+   //! Free the arrays of summaries written in a savepoint that committed,
+   //! unless the connection is still in an outer transaction
+   void MarkSummariesStored(const PendingSummaries &written);
+   void SummaryThread();
+
+   //! Keep a level of summary computed for display, until it is stored
+   void DeferDerivedSummary(SampleBlockID id, size_t divisor,
+      Floats &&summary, size_t frames);
+   //! @return false if no level of summary is kept for the block
+   bool ReadDeferredSummary(SampleBlockID id, size_t divisor,
+      float *dest, size_t frameoffset, size_t numframes);
+   void ForgetDeferredSummaries(SampleBlockID id);
+   //! Insert the kept levels of summary, adding the table if it is missing
+   /*! @pre a savepoint is open, by this thread */
+   void StoreDerivedSummaries(DBConnection &connection);
+
+   const std::weak_ptr<AudacityProject> mwProject;
    const std::shared_ptr<ConnectionPtr> mppConnection;
 
+   // Recently read or written sample contents, shared by all threads
+   SampleBlockCache mCache;
+
+   // Set when the summaries table can't be written, as when the project file
+   // is read-only; then derived summaries are computed for each use and not
+   // kept
+   std::atomic<bool> mSummariesUnavailable{ false };
+   // Set when the summaries table is found missing, as in a project file from
+   // before it existed, and cleared when it is added
+   std::atomic<bool> mSummariesMissing{ false };
+
+   // Levels of summary computed for display, which are stored only with the
+   // next batch commit or StoreDeferred(), so that drawing never writes.
+   // Beyond the limit, more are computed again when next needed.
+   enum : size_t { MaxDeferredSummaryBytes = 16 * 1024 * 1024 };
+   struct DeferredSummary
+   {
+      Floats summary;
+      size_t frames;
+   };
+   std::mutex mDeferredMutex;
+   std::map<std::pair<SampleBlockID, size_t>, DeferredSummary>
+      mDeferredSummaries;
+   size_t mDeferredSummaryBytes{ 0 };
+
    // Track all blocks that this factory has created, but don't control
    // their lifetimes (so use weak_ptr)
    // (Must also use weak pointers because the blocks have shared pointers
    // to the factory and we can't have a leaky cycle of shared pointers)
    using AllBlocksMap =
       std::map< SampleBlockID, std::weak_ptr< SqliteSampleBlock > >;
+   std::mutex mAllBlocksMutex;
    AllBlocksMap mAllBlocks;
 
    BlockDeletionCallback mCallback;
+
+   // While batching, block insertions accumulate in a savepoint, which is
+   // released when enough bytes or time accumulate, and at the end
+   enum : size_t { BatchBytes = 16 * 1024 * 1024 };
+   static constexpr auto BatchInterval = std::chrono::seconds{ 1 };
+
+   std::mutex mBatchMutex;
+   int mBatchDepth{ 0 };
+   Optional<TransactionScope> mpBatchScope;
+   //! Only the thread that began the batch releases and reopens its savepoint
+   std::thread::id mBatchThread;
+   size_t mBatchPendingBytes{ 0 };
+   std::chrono::steady_clock::time_point mBatchLastCommit;
+
+   // Throughput of the outermost batch, for diagnosis
+   std::chrono::steady_clock::time_point mBatchStart;
+   unsigned long long mBatchBlocks{ 0 };
+   unsigned long long mBatchBytes{ 0 };
+   unsigned long long mBatchCommits{ 0 };
+
+   // Summaries of blocks made in a batch are computed by worker threads, so
+   // that importing threads need only insert the samples.  The workers do
+   // not use the database; the thread that owns the batch updates the rows
+   // within it, as it commits.  Each queued summary holds samples in memory;
+   // beyond the limit, the creating thread computes the summary itself.
+   enum : size_t { MaxQueuedSummaries = 64, MaxSummaryThreads = 8 };
+   std::mutex mSummaryMutex;
+   std::condition_variable mSummaryCondition;
+   std::condition_variable mSummaryIdleCondition;
+   std::deque<std::weak_ptr<SqliteSampleBlock::PendingSummary>> mSummaryQueue;
+   //! Summaries of the batch, queued or completed, and summaries recovered
+   //! when loading blocks, not yet written
+   std::vector<std::weak_ptr<SqliteSampleBlock::PendingSummary>>
+      mUnwrittenSummaries;
+   size_t mSummariesActive{ 0 };
+   bool mSummaryStop{ false };
+   std::vector<std::thread> mSummaryThreads;
+   std::atomic<unsigned long long> mSummariesDeferred{ 0 };
+   std::atomic<unsigned long long> mSummariesInline{ 0 };
 };
 
 SqliteSampleBlockFactory::SqliteSampleBlockFactory( AudacityProject &project )
-   : mppConnection{ ConnectionPtr::Get(project).shared_from_this() }
+   : mwProject{ project.shared_from_this() }
+   , mppConnection{ ConnectionPtr::Get(project).shared_from_this() }
+   , mCache{ static_cast<size_t>(
+      gPrefs->Read(wxT("/SampleBlockCache/SizeMB"),
+         static_cast<long>(SampleBlockCache::DefaultBudget >> 20))) << 20 }
 {
    
 }
 
-SqliteSampleBlockFactory::~SqliteSampleBlockFactory() = default;
+SqliteSampleBlockFactory::~SqliteSampleBlockFactory()
+{
+   wxASSERT(mBatchDepth == 0);
+
+   // The last batch stored all of its summaries, and the workers use nothing
+   // but the queue, which is empty
+   {
+      std::lock_guard<std::mutex> guard(mSummaryMutex);
+      mSummaryStop = true;
+   }
+   mSummaryCondition.notify_all();
+   for (auto &thread : mSummaryThreads)
+      thread.join();
+
+   auto stats = mCache.GetStatistics();
+   wxLogDebug(wxT("Sample block cache: %llu hits, %llu misses, %llu evictions"),
+      stats.hits, stats.misses, stats.evictions);
+   wxLogDebug(wxT("Block summaries: %llu deferred, %llu computed inline"),
+      mSummariesDeferred.load(), mSummariesInline.load());
+}
 
 SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
    constSamplePtr src, size_t numsamples, sampleFormat srcformat )
@@ -182,12 +493,14 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
    auto sb = std::make_shared<SqliteSampleBlock>(shared_from_this());
    sb->SetSamples(src, numsamples, srcformat);
    // block id has now been assigned
+   std::lock_guard<std::mutex> guard(mAllBlocksMutex);
    mAllBlocks[ sb->GetBlockID() ] = sb;
    return sb;
 }
 
 auto SqliteSampleBlockFactory::GetActiveBlockIDs() -> SampleBlockIDs
 {
+   std::lock_guard<std::mutex> guard(mAllBlocksMutex);
    SampleBlockIDs result;
    for (auto end = mAllBlocks.end(), it = mAllBlocks.begin(); it != end;) {
       if (it->second.expired())
@@ -205,6 +518,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateSilent(
    size_t numsamples, sampleFormat )
 {
    auto id = -static_cast< SampleBlockID >(numsamples);
+   std::lock_guard<std::mutex> guard(sSilentBlocksMutex);
    auto &result = sSilentBlocks[ id ];
    if ( !result ) {
       result = std::make_shared<SqliteSampleBlock>(nullptr);
@@ -248,6 +562,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
             sb = DoCreateSilent( -nValue, floatSample );
          }
          else {
+            std::lock_guard<std::mutex> guard(mAllBlocksMutex);
             // First see if this block id was previously loaded
             auto &wb = mAllBlocks[ nValue ];
             auto pb = wb.lock();
@@ -287,6 +602,427 @@ auto SqliteSampleBlockFactory::SetBlockDeletionCallback(
    return result;
 }
 
+void SqliteSampleBlockFactory::BeginBatch()
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   if (mBatchDepth++ > 0)
+      return;
+
+   mBatchStart = mBatchLastCommit = std::chrono::steady_clock::now();
+   mBatchThread = std::this_thread::get_id();
+   mBatchPendingBytes = 0;
+   mBatchBlocks = mBatchBytes = mBatchCommits = 0;
+
+   auto &pConnection = mppConnection->mpConnection;
+   if (pConnection)
+      // This may throw
+      mpBatchScope.emplace(*pConnection, "SampleBlockBatch");
+}
+
+void SqliteSampleBlockFactory::EndBatch()
+{
+   // Holding the lock keeps new summaries from being deferred meanwhile
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   wxASSERT(mBatchDepth > 0);
+   if (--mBatchDepth > 0)
+      return;
+
+   if (!mpBatchScope)
+      return;
+
+   // Let the rows committed at the end of the batch be complete
+   StoreDerivedSummaries(*mppConnection->mpConnection);
+   const auto written = WriteSummaries(true);
+
+   // Always commit, never roll back:  blocks made in the batch may still be
+   // in use, and any that are abandoned delete their own rows
+   auto failed = mpBatchScope->Commit();
+   mpBatchScope.reset();
+   ++mBatchCommits;
+   if (!failed)
+      MarkSummariesStored(written);
+
+   using namespace std::chrono;
+   const auto seconds =
+      duration<double>(steady_clock::now() - mBatchStart).count();
+   wxLogMessage(
+      wxT("Sample block batch: %llu blocks, %llu bytes in %llu commits, %.1f blocks/s"),
+      mBatchBlocks, mBatchBytes, mBatchCommits,
+      seconds > 0 ? mBatchBlocks / seconds : 0.0);
+
+   if (failed)
+      mppConnection->mpConnection->ThrowException(true);
+}
+
+void SqliteSampleBlockFactory::OnCommitted(size_t bytes)
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   if (!mpBatchScope)
+      return;
+
+   ++mBatchBlocks;
+   mBatchBytes += bytes;
+   mBatchPendingBytes += bytes;
+
+   CycleBatch();
+}
+
+void SqliteSampleBlockFactory::FlushBatch()
+{
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   if (!mpBatchScope)
+      return;
+
+   CycleBatch();
+}
+
+void SqliteSampleBlockFactory::CycleBatch()
+{
+   // Blocks created by other threads, as in parallel import, stay in the
+   // savepoint until the thread that began it calls FlushBatch(); that
+   // thread may have nested savepoints of its own, which releasing this one
+   // from another thread would release too
+   if (std::this_thread::get_id() != mBatchThread)
+      return;
+
+   const auto now = std::chrono::steady_clock::now();
+   if (mBatchPendingBytes < BatchBytes && now - mBatchLastCommit < BatchInterval)
+      return;
+
+   // Releasing the batch would also release savepoints nested in it, such
+   // as an effect's; wait until they end
+   auto &connection = *mppConnection->mpConnection;
+   if (connection.GetSavepointDepth() > 1)
+      return;
+
+   // Make the accumulated blocks durable, with the summaries completed so
+   // far, then continue in a new savepoint.  Hold the connection meanwhile,
+   // so that blocks inserted by other threads don't commit one by one.
+   // Commit() returns true if the savepoint could not be released.
+   const auto mutex = sqlite3_db_mutex(connection.DB());
+   sqlite3_mutex_enter(mutex);
+   auto cleanup = finally([&]{ sqlite3_mutex_leave(mutex); });
+
+   StoreDerivedSummaries(connection);
+   const auto written = WriteSummaries(false);
+   auto failed = mpBatchScope->Commit();
+   mpBatchScope.reset();
+   ++mBatchCommits;
+   if (failed)
+      connection.ThrowException(true);
+   MarkSummariesStored(written);
+
+   mpBatchScope.emplace(connection, "SampleBlockBatch");
+   mBatchPendingBytes = 0;
+   mBatchLastCommit = now;
+}
+
+SampleBlockCodec::Codec SqliteSampleBlockFactory::GetCodec() const
+{
+   auto pProject = mwProject.lock();
+   if (pProject &&
+       ProjectSettings::Get(*pProject).GetCompressSampleBlocks() &&
+       SampleBlockCodec::IsAvailable(SampleBlockCodec::Flac))
+      return SampleBlockCodec::Flac;
+   return SampleBlockCodec::Raw;
+}
+
+bool SqliteSampleBlockFactory::CanDeferSummary()
+{
+   {
+      std::lock_guard<std::mutex> guard(mBatchMutex);
+      if (!mpBatchScope)
+         return false;
+   }
+
+   std::lock_guard<std::mutex> guard(mSummaryMutex);
+   const bool result = mSummaryQueue.size() < MaxQueuedSummaries;
+   ++(result ? mSummariesDeferred : mSummariesInline);
+   return result;
+}
+
+bool SqliteSampleBlockFactory::EnqueueSummary(
+   const std::shared_ptr<SqliteSampleBlock::PendingSummary> &pPending)
+{
+   // The batch must stay open until the summary is written in it
+   std::lock_guard<std::mutex> batchGuard(mBatchMutex);
+   if (!mpBatchScope)
+      return false;
+
+   {
+      std::lock_guard<std::mutex> guard(mSummaryMutex);
+      if (mSummaryThreads.empty())
+      {
+         // Leave a core for the thread that creates the blocks
+         const auto cores = std::thread::hardware_concurrency();
+         const auto nThreads = std::max<size_t>(1,
+            std::min<size_t>(MaxSummaryThreads, cores > 1 ? cores - 1 : 1));
+         for (size_t i = 0; i < nThreads; ++i)
+            mSummaryThreads.emplace_back([this]{ SummaryThread(); });
+      }
+      mSummaryQueue.push_back(pPending);
+      mUnwrittenSummaries.push_back(pPending);
+   }
+   mSummaryCondition.notify_one();
+   return true;
+}
+
+void SqliteSampleBlockFactory::DrainSummaries()
+{
+   std::unique_lock<std::mutex> lock(mSummaryMutex);
+   while (!mSummaryQueue.empty())
+   {
+      auto pPending = mSummaryQueue.front().lock();
+      mSummaryQueue.pop_front();
+      if (!pPending)
+         continue;
+
+      lock.unlock();
+      SqliteSampleBlock::CompleteSummary(*pPending);
+      lock.lock();
+   }
+   mSummaryIdleCondition.wait(lock, [this]{ return mSummariesActive == 0; });
+}
+
+auto SqliteSampleBlockFactory::WriteSummaries(bool wait) -> PendingSummaries
+{
+   if (wait)
+      DrainSummaries();
+
+   // Take the completed summaries out of the list, and forget those of
+   // blocks already gone
+   PendingSummaries completed;
+   {
+      std::lock_guard<std::mutex> guard(mSummaryMutex);
+      auto &list = mUnwrittenSummaries;
+      list.erase(std::remove_if(list.begin(), list.end(),
+         [&](const std::weak_ptr<SqliteSampleBlock::PendingSummary> &wPending){
+            auto pPending = wPending.lock();
+            if (!pPending)
+               return true;
+            if (!pPending->done)
+               return false;
+            completed.push_back(std::move(pPending));
+            return true;
+         }), list.end());
+   }
+
+   // A summary that can't be written, as for a read-only file, stays in
+   // memory
+   PendingSummaries written;
+   auto &connection = *mppConnection->mpConnection;
+   for (auto &pPending : completed)
+   {
+      std::lock_guard<std::mutex> guard(pPending->mutex);
+      if (!pPending->cancelled &&
+          SqliteSampleBlock::StoreSummary(connection, *pPending))
+         written.push_back(pPending);
+   }
+   return written;
+}
+
+void SqliteSampleBlockFactory::MarkSummariesStored(
+   const PendingSummaries &written)
+{
+   // Within a transaction that might yet roll back, keep the arrays
+   if (written.empty() ||
+       !sqlite3_get_autocommit(mppConnection->mpConnection->DB()))
+      return;
+
+   for (auto &pPending : written)
+   {
+      std::lock_guard<std::mutex> guard(pPending->mutex);
+      SqliteSampleBlock::MarkStored(*pPending);
+   }
+}
+
+void SqliteSampleBlockFactory::StoreDeferred()
+{
+   auto &pConnection = mppConnection->mpConnection;
+   if (!pConnection)
+      return;
+   auto &connection = *pConnection;
+
+   std::lock_guard<std::mutex> guard(mBatchMutex);
+
+   // An open batch stores all of this when it commits
+   if (mpBatchScope)
+      return;
+
+   {
+      std::lock_guard<std::mutex> deferredGuard(mDeferredMutex);
+      std::lock_guard<std::mutex> summaryGuard(mSummaryMutex);
+      if (mDeferredSummaries.empty() && mUnwrittenSummaries.empty())
+         return;
+   }
+
+   // Failure to open the savepoint leaves everything kept for next time
+   try {
+      TransactionScope trans(connection, "StoreDeferred");
+      StoreDerivedSummaries(connection);
+      const auto written = WriteSummaries(false);
+      // Commit() returns true if the savepoint could not be released
+      if (!trans.Commit())
+         MarkSummariesStored(written);
+   }
+   catch ( const AudacityException & ) {
+   }
+}
+
+void SqliteSampleBlockFactory::DeferSummary(
+   const std::shared_ptr<SqliteSampleBlock::PendingSummary> &pPending)
+{
+   std::lock_guard<std::mutex> guard(mSummaryMutex);
+   mUnwrittenSummaries.push_back(pPending);
+}
+
+void SqliteSampleBlockFactory::DeferDerivedSummary(SampleBlockID id,
+   size_t divisor, Floats &&summary, size_t frames)
+{
+   if (mSummariesUnavailable)
+      return;
+
+   const auto bytes = frames * SqliteSampleBlock::bytesPerFrame;
+   std::lock_guard<std::mutex> guard(mDeferredMutex);
+   if (mDeferredSummaryBytes + bytes > MaxDeferredSummaryBytes)
+      return;
+
+   auto result = mDeferredSummaries.emplace(std::make_pair(id, divisor),
+      DeferredSummary{ std::move(summary), frames });
+   if (result.second)
+      mDeferredSummaryBytes += bytes;
+}
+
+bool SqliteSampleBlockFactory::ReadDeferredSummary(SampleBlockID id,
+   size_t divisor, float *dest, size_t frameoffset, size_t numframes)
+{
+   std::lock_guard<std::mutex> guard(mDeferredMutex);
+   auto iter = mDeferredSummaries.find(std::make_pair(id, divisor));
+   if (iter == mDeferredSummaries.end())
+      return false;
+
+   const auto &deferred = iter->second;
+   SqliteSampleBlock::CopySummaryFrames(deferred.summary.get(),
+      deferred.frames, dest, frameoffset, numframes);
+   return true;
+}
+
+void SqliteSampleBlockFactory::ForgetDeferredSummaries(SampleBlockID id)
+{
+   std::lock_guard<std::mutex> guard(mDeferredMutex);
+   auto first = mDeferredSummaries.lower_bound(std::make_pair(id, 0));
+   auto last = mDeferredSummaries.lower_bound(std::make_pair(id + 1, 0));
+   for (auto iter = first; iter != last; ++iter)
+      mDeferredSummaryBytes -=
+         iter->second.frames * SqliteSampleBlock::bytesPerFrame;
+   mDeferredSummaries.erase(first, last);
+}
+
+void SqliteSampleBlockFactory::StoreDerivedSummaries(DBConnection &connection)
+{
+   std::lock_guard<std::mutex> guard(mDeferredMutex);
+   if (mDeferredSummaries.empty())
+      return;
+
+   // The summaries are only a convenience, so failure is not an error; they
+   // will be computed again.  Stop trying only if the file is read-only.
+   auto giveUp = [&](int rc)
+   {
+      wxLogDebug(wxT("SqliteSampleBlockFactory::StoreDerivedSummaries - SQLITE error %s"),
+         sqlite3_errmsg(connection.DB()));
+      if ((rc & 0xff) == SQLITE_READONLY)
+         mSummariesUnavailable = true;
+      mDeferredSummaries.clear();
+      mDeferredSummaryBytes = 0;
+   };
+
+   int rc = sqlite3_exec(connection.DB(), SummariesTable,
+      nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      giveUp(rc);
+      return;
+   }
+   mSummariesMissing = false;
+
+   // Prepare and cache statement...automatically finalized at DB close
+   auto stmt = connection.TryPrepare(DBConnection::InsertSummary,
+      "INSERT OR REPLACE INTO summaries (blockid, divisor, summary)"
+      "                         VALUES(?1,?2,?3);", rc);
+   if (!stmt)
+   {
+      giveUp(rc);
+      return;
+   }
+
+   for (const auto &deferred : mDeferredSummaries)
+   {
+      // Bind statement parameters
+      // Might return SQLITE_MISUSE which means it's our mistake that we
+      // violated preconditions; should return SQL_OK which is 0
+      if (sqlite3_bind_int64(stmt, 1, deferred.first.first) ||
+          sqlite3_bind_int64(stmt, 2, deferred.first.second) ||
+          sqlite3_bind_blob(stmt, 3, deferred.second.summary.get(),
+             deferred.second.frames * SqliteSampleBlock::bytesPerFrame,
+             SQLITE_STATIC))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      rc = sqlite3_step(stmt);
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+
+      if (rc != SQLITE_DONE)
+      {
+         giveUp(rc);
+         return;
+      }
+   }
+
+   // The rows may yet roll back with the savepoint, and then the levels are
+   // only computed again
+   mDeferredSummaries.clear();
+   mDeferredSummaryBytes = 0;
+}
+
+void SqliteSampleBlockFactory::SummaryThread()
+{
+   std::unique_lock<std::mutex> lock(mSummaryMutex);
+   while (true)
+   {
+      mSummaryCondition.wait(lock,
+         [this]{ return mSummaryStop || !mSummaryQueue.empty(); });
+      if (mSummaryStop)
+         return;
+
+      // The block may be gone already, and then so are its samples
+      auto pPending = mSummaryQueue.front().lock();
+      mSummaryQueue.pop_front();
+      if (!pPending)
+         continue;
+
+      ++mSummariesActive;
+      lock.unlock();
+      try {
+         SqliteSampleBlock::CompleteSummary(*pPending);
+      }
+      catch (...) {
+         // As for lack of memory; the first reader of the summary tries again
+      }
+      pPending.reset();
+      lock.lock();
+      if (--mSummariesActive == 0)
+         mSummaryIdleCondition.notify_all();
+   }
+}
+
 SqliteSampleBlock::SqliteSampleBlock(
    const std::shared_ptr<SqliteSampleBlockFactory> &pFactory)
 :  mpFactory(pFactory)
@@ -294,6 +1030,7 @@ SqliteSampleBlock::SqliteSampleBlock(
    mSampleFormat = floatSample;
    mSampleBytes = 0;
    mSampleCount = 0;
+   mSpaceUsage = 0;
 
    mSumMin = 0.0;
    mSumMax = 0.0;
@@ -308,6 +1045,16 @@ SqliteSampleBlock::~SqliteSampleBlock()
          GuardedCall( [&]{ callback( *this ); } );
    }
 
+   if (mpFactory && !IsSilent())
+      mpFactory->mCache.Erase(mBlockID);
+
+   if (mpPending)
+   {
+      // Waits for a worker that is updating the row
+      std::lock_guard<std::mutex> guard(mpPending->mutex);
+      mpPending->cancelled = true;
+   }
+
    if (IsSilent()) {
       // The block object was constructed but failed to Load() or Commit().
       // Or it's a silent block with no row in the database.
@@ -380,16 +1127,160 @@ size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
       return numsamples;
    }
 
+   auto pContents =
+      GetCachedSamples(numsamples * SAMPLE_SIZE(mSampleFormat));
+   if (!pContents)
+      return GetSamplesPart(dest, destformat, sampleoffset, numsamples);
+
+   // Same clipping and zero padding as GetBlob() does
+   const auto size = SAMPLE_SIZE(mSampleFormat);
+   const auto srcoffset = std::min(sampleoffset * size, pContents->bytes);
+   const auto minbytes = std::min(numsamples * size, pContents->bytes - srcoffset);
+   const auto copied = minbytes / size;
+
+   CopySamples(pContents->data.get() + srcoffset,
+               mSampleFormat,
+               dest,
+               destformat,
+               copied);
+
+   if (copied < numsamples)
+      ClearSamples(dest, destformat, copied, numsamples - copied);
+
+   return numsamples;
+}
+
+SampleBlockCache::ContentsPtr SqliteSampleBlock::GetCachedSamples(
+   size_t wanted)
+{
+   auto &cache = mpFactory->mCache;
+   if (auto pContents = cache.Find(mBlockID))
+      return pContents;
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   // Compressed blocks can only be decoded whole, so always make contents
+   // for them, even if too large to cache
+   const auto raw = (mCodec == SampleBlockCodec::Raw);
+   if (raw && (mSampleBytes > cache.GetStatistics().budget ||
+               wanted <= mSampleBytes / partialReadFraction))
+      return {};
+
+   auto pContents = std::make_shared<SampleBlockCache::Contents>();
+   pContents->data.reinit(mSampleBytes);
+   pContents->bytes = mSampleBytes;
+
+   if (raw)
+   {
+      // Prepare and cache statement...automatically finalized at DB close
+      sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
+         "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
+
+      GetBlob(pContents->data.get(),
+              mSampleFormat,
+              stmt,
+              mSampleFormat,
+              0,
+              mSampleBytes);
+   }
+   else
+      DecodeSamples(pContents->data.get());
+
+   cache.Insert(mBlockID, pContents);
+   return pContents;
+}
+
+size_t SqliteSampleBlock::GetSamplesPart(samplePtr dest,
+                                         sampleFormat destformat,
+                                         size_t sampleoffset,
+                                         size_t numsamples)
+{
+   const auto size = SAMPLE_SIZE(mSampleFormat);
+
+   // Read directly into the destination when no conversion is needed
+   SampleBuffer buffer;
+   auto src = dest;
+   if (destformat != mSampleFormat)
+      src = buffer.Allocate(numsamples, mSampleFormat).ptr();
+
+   size_t bytes = numsamples * size;
+   if (!Conn()->ReadBlob(DBConnection::SamplesBlob,
+      "sampleblocks", "samples", mBlockID, src, sampleoffset * size, bytes))
+   {
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( false );
+   }
+
+   // Same clipping and zero padding as GetBlob() does
+   const auto copied = bytes / size;
+   if (src != dest)
+      CopySamples(src, mSampleFormat, dest, destformat, copied);
+
+   if (copied < numsamples)
+      ClearSamples(dest, destformat, copied, numsamples - copied);
+
+   return numsamples;
+}
+
+void SqliteSampleBlock::DecodeSamples(samplePtr dest)
+{
+   int rc;
+
+   wxASSERT(!IsSilent());
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
       "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
 
-   return GetBlob(dest,
-                  destformat,
-                  stmt,
-                  mSampleFormat,
-                  sampleoffset * SAMPLE_SIZE(mSampleFormat),
-                  numsamples * SAMPLE_SIZE(mSampleFormat)) / SAMPLE_SIZE(mSampleFormat);
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_int64(stmt, 1, mBlockID))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Execute the statement
+   rc = sqlite3_step(stmt);
+   if (rc != SQLITE_ROW)
+   {
+      wxLogDebug(wxT("SqliteSampleBlock::DecodeSamples - SQLITE error %s"), sqlite3_errmsg(sqlite3_db_handle(stmt)));
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( false );
+   }
+
+   auto decoded = SampleBlockCodec::Decode(mCodec,
+      sqlite3_column_blob(stmt, 0),
+      (size_t) sqlite3_column_bytes(stmt, 0),
+      mSampleFormat,
+      mSampleCount,
+      dest);
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   if (!decoded)
+   {
+      wxLogDebug(wxT("SqliteSampleBlock::DecodeSamples - block %lld, codec %d"),
+         mBlockID, (int) mCodec);
+
+      throw SimpleMessageBoxException
+      {
+         XO("Failed to decode the samples of a compressed block"),
+         XO("Warning")
+      };
+   }
 }
 
 void SqliteSampleBlock::SetSamples(constSamplePtr src,
@@ -400,16 +1291,40 @@ void SqliteSampleBlock::SetSamples(constSamplePtr src,
    mSamples.reinit(mSampleBytes);
    memcpy(mSamples.get(), src, mSampleBytes);
 
-   CalcSummary( sizes );
+   // Leave the summary to the factory's workers, unless they are behind
+   if (mpFactory->CanDeferSummary())
+      Commit( sizes, nullptr );
+   else
+   {
+      Summary summary;
+      CalcSummary( sizes, mSamples.get(), mSampleFormat, mSampleCount, summary );
+      Commit( sizes, &summary );
+   }
+}
 
-   Commit( sizes );
+namespace {
+/// Copies frames of a summary held in memory, with the same clipping and
+/// zero padding as GetBlob() does
+void CopySummary(const ArrayOf<char> &summary, size_t bytes,
+   float *dest, size_t frameoffset, size_t numframes)
+{
+   const size_t bytesPerFrame = 3 * sizeof(float);
+   const auto srcoffset = std::min(frameoffset * bytesPerFrame, bytes);
+   const auto srcbytes = numframes * bytesPerFrame;
+   const auto minbytes = std::min(srcbytes, bytes - srcoffset);
+   memcpy(dest, summary.get() + srcoffset, minbytes);
+   memset((char *) dest + minbytes, 0, srcbytes - minbytes);
+}
 }
 
 bool SqliteSampleBlock::GetSummary256(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
 {
-   return GetSummary(dest, frameoffset, numframes, DBConnection::GetSummary256,
+   if (mpPending && CopyUnstoredSummary(&Summary::summary256,
+          mpPending->sizes.first, dest, frameoffset, numframes))
+      return true;
+   return GetStoredSummary(dest, frameoffset, numframes, DBConnection::GetSummary256,
       "SELECT summary256 FROM sampleblocks WHERE blockid = ?1;");
 }
 
@@ -417,15 +1332,18 @@ bool SqliteSampleBlock::GetSummary64k(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
 {
-   return GetSummary(dest, frameoffset, numframes, DBConnection::GetSummary64k,
+   if (mpPending && CopyUnstoredSummary(&Summary::summary64k,
+          mpPending->sizes.second, dest, frameoffset, numframes))
+      return true;
+   return GetStoredSummary(dest, frameoffset, numframes, DBConnection::GetSummary64k,
       "SELECT summary64k FROM sampleblocks WHERE blockid = ?1;");
 }
 
-bool SqliteSampleBlock::GetSummary(float *dest,
-                                   size_t frameoffset,
-                                   size_t numframes,
-                                   DBConnection::StatementID id,
-                                   const char *sql)
+bool SqliteSampleBlock::GetStoredSummary(float *dest,
+                                         size_t frameoffset,
+                                         size_t numframes,
+                                         DBConnection::StatementID id,
+                                         const char *sql)
 {
    // Non-throwing, it returns true for success
    bool silent = IsSilent();
@@ -452,24 +1370,367 @@ bool SqliteSampleBlock::GetSummary(float *dest,
    return silent;
 }
 
+bool SqliteSampleBlock::GetSummary(size_t divisor,
+                                   float *dest,
+                                   size_t frameoffset,
+                                   size_t numframes)
+{
+   switch (divisor)
+   {
+   case 256:
+      return GetSummary256(dest, frameoffset, numframes);
+   case 65536:
+      return GetSummary64k(dest, frameoffset, numframes);
+   default:
+      return GetDerivedSummary(divisor, dest, frameoffset, numframes);
+   }
+}
+
+namespace {
+/// Combines frames of a finer summary, or samples if finerDivisor is 1, into
+/// all the frames of a coarser summary
+void CoarsenSummary(const float *src, size_t finerDivisor,
+   size_t divisor, size_t sampleCount, float *dest)
+{
+   const auto stride = (finerDivisor == 1) ? 1 : 3;
+   const auto ratio = divisor / finerDivisor;
+   const auto finerFrames = (sampleCount + finerDivisor - 1) / finerDivisor;
+   const auto frames = (sampleCount + divisor - 1) / divisor;
+
+   for (size_t i = 0; i < frames; ++i)
+   {
+      float min = FLT_MAX;
+      float max = -FLT_MAX;
+      double sumsq = 0;
+
+      const auto first = i * ratio;
+      const auto last = std::min(finerFrames, first + ratio);
+      if (finerDivisor == 1)
+         SampleStatistics::Accumulate(src + first, last - first,
+            min, max, sumsq);
+      else
+      {
+         SampleStatistics::AccumulateFrames(src + first * stride,
+            last - first, min, max, sumsq);
+         sumsq *= finerDivisor;
+
+         // The rms of the last frame may be for fewer samples
+         const auto lastCount = sampleCount - (last - 1) * finerDivisor;
+         if (lastCount < finerDivisor)
+         {
+            const double rms = src[(last - 1) * stride + 2];
+            sumsq -= rms * rms * (finerDivisor - lastCount);
+         }
+      }
+
+      const auto count = std::min(divisor, sampleCount - i * divisor);
+      dest[i * 3] = min;
+      dest[i * 3 + 1] = max;
+      dest[i * 3 + 2] = (float) sqrt(sumsq / count);
+   }
+}
+}
+
+bool SqliteSampleBlock::GetDerivedSummary(size_t divisor,
+                                          float *dest,
+                                          size_t frameoffset,
+                                          size_t numframes)
+{
+   // Non-throwing, it returns true for success
+   bool silent = IsSilent();
+   if (!silent) {
+      try {
+         if (!mValid)
+            Load(mBlockID);
+
+         if (ReadDerivedSummary(divisor, dest, frameoffset, numframes))
+            return true;
+
+         // Compute the whole level once, from the stored 256 summary if it
+         // is fine enough, else from the samples
+         const size_t finerDivisor =
+            (divisor > 256 && divisor % 256 == 0) ? 256 : 1;
+         const auto frames = (mSampleCount + divisor - 1) / divisor;
+         Floats summary{ std::max<size_t>(1, frames) * fields };
+         if (finerDivisor == 256)
+         {
+            const auto frames256 = (mSampleCount + 255) / 256;
+            Floats summary256{ frames256 * fields };
+            if (!GetSummary256(summary256.get(), 0, frames256))
+               throw SimpleMessageBoxException{
+                  XO("Failed to read the summary of a block"), XO("Warning") };
+            CoarsenSummary(summary256.get(), finerDivisor,
+               divisor, mSampleCount, summary.get());
+         }
+         else
+         {
+            Floats samples{ mSampleCount };
+            DoGetSamples((samplePtr) samples.get(), floatSample,
+               0, mSampleCount);
+            CoarsenSummary(samples.get(), finerDivisor,
+               divisor, mSampleCount, summary.get());
+         }
+
+         CopySummaryFrames(summary.get(), frames,
+            dest, frameoffset, numframes);
+
+         // Drawing may come here, so leave the storing for later
+         mpFactory->DeferDerivedSummary(mBlockID, divisor,
+            std::move(summary), frames);
+         return true;
+      }
+      catch ( const AudacityException & ) {
+      }
+   }
+   memset(dest, 0, 3 * numframes * sizeof( float ));
+   // Return true for success only if we didn't catch
+   return silent;
+}
+
+namespace {
+// The summaries table is missing, as from a project from before it existed,
+// if statements using it can't be prepared.  Other failures, such as a busy
+// database, may pass.
+bool SummariesMissing(int prepareRc)
+{
+   return (prepareRc & 0xff) == SQLITE_ERROR;
+}
+}
+
+bool SqliteSampleBlock::ReadDerivedSummary(size_t divisor,
+                                           float *dest,
+                                           size_t frameoffset,
+                                           size_t numframes)
+{
+   if (mpFactory->ReadDeferredSummary(mBlockID, divisor,
+          dest, frameoffset, numframes))
+      return true;
+
+   if (mpFactory->mSummariesUnavailable || mpFactory->mSummariesMissing)
+      return false;
+
+   // Prepare and cache statement...automatically finalized at DB close
+   int rc;
+   auto stmt = Conn()->TryPrepare(DBConnection::GetSummary,
+      "SELECT summary FROM summaries WHERE blockid = ?1 AND divisor = ?2;", rc);
+   if (!stmt) {
+      if (SummariesMissing(rc))
+         mpFactory->mSummariesMissing = true;
+      return false;
+   }
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_int64(stmt, 1, mBlockID) ||
+       sqlite3_bind_int64(stmt, 2, divisor))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Execute the statement
+   const bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+   if (found)
+   {
+      // Same clipping and zero padding as GetBlob() does
+      auto src = (const char *) sqlite3_column_blob(stmt, 0);
+      const size_t blobbytes = sqlite3_column_bytes(stmt, 0);
+      const auto srcoffset = std::min(frameoffset * bytesPerFrame, blobbytes);
+      const auto srcbytes = numframes * bytesPerFrame;
+      const auto minbytes = std::min(srcbytes, blobbytes - srcoffset);
+      memcpy(dest, src + srcoffset, minbytes);
+      memset((char *) dest + minbytes, 0, srcbytes - minbytes);
+   }
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   return found;
+}
+
+void SqliteSampleBlock::CopySummaryFrames(const float *summary,
+   size_t frames, float *dest, size_t frameoffset, size_t numframes)
+{
+   const auto first = std::min(frameoffset, frames);
+   const auto copied = std::min(numframes, frames - first);
+   std::copy(summary + first * fields,
+      summary + (first + copied) * fields, dest);
+   std::fill(dest + copied * fields, dest + numframes * fields, 0.0f);
+}
+
+void SqliteSampleBlock::DeleteDerivedSummaries()
+{
+   mpFactory->ForgetDeferredSummaries(mBlockID);
+
+   if (mpFactory->mSummariesUnavailable || mpFactory->mSummariesMissing)
+      return;
+
+   // Prepare and cache statement...automatically finalized at DB close
+   int rc;
+   auto stmt = Conn()->TryPrepare(DBConnection::DeleteSummaries,
+      "DELETE FROM summaries WHERE blockid = ?1;", rc);
+   if (!stmt) {
+      if (SummariesMissing(rc))
+         mpFactory->mSummariesMissing = true;
+      return;
+   }
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_int64(stmt, 1, mBlockID))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Orphaned summaries are removed with orphaned blocks, so ignore failure
+   if (sqlite3_step(stmt) != SQLITE_DONE)
+      wxLogDebug(wxT("SqliteSampleBlock::DeleteDerivedSummaries - SQLITE error %s"),
+         sqlite3_errmsg(sqlite3_db_handle(stmt)));
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+}
+
+void SqliteSampleBlock::CompleteSummary(
+   PendingSummary &pending, constSamplePtr samples)
+{
+   if (pending.done)
+      return;
+
+   std::lock_guard<std::mutex> guard(pending.mutex);
+   if (pending.done || pending.cancelled)
+      return;
+
+   if (pending.pSamples)
+      samples = pending.pSamples->data.get();
+   wxASSERT(samples);
+   CalcSummary(pending.sizes, samples, pending.format, pending.count,
+      pending.summary);
+   pending.pSamples.reset();
+
+   pending.done = true;
+}
+
+void SqliteSampleBlock::MarkStored(PendingSummary &pending)
+{
+   if (pending.cancelled)
+      return;
+   pending.stored = true;
+   pending.summary.summary256.reset();
+   pending.summary.summary64k.reset();
+}
+
+bool SqliteSampleBlock::StoreSummary(DBConnection &connection,
+   const PendingSummary &pending)
+{
+   const auto &summary = pending.summary;
+
+   sqlite3_stmt *stmt = nullptr;
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      stmt = connection.Prepare(DBConnection::UpdateSampleBlockSummary,
+         "UPDATE sampleblocks SET summin = ?2, summax = ?3, sumrms = ?4,"
+         "                        summary256 = ?5, summary64k = ?6"
+         "  WHERE blockid = ?1;");
+   }
+   catch ( const AudacityException & ) {
+      return false;
+   }
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_int64(stmt, 1, pending.blockID) ||
+       sqlite3_bind_double(stmt, 2, summary.sumMin) ||
+       sqlite3_bind_double(stmt, 3, summary.sumMax) ||
+       sqlite3_bind_double(stmt, 4, summary.sumRms) ||
+       sqlite3_bind_blob(stmt, 5, summary.summary256.get(), pending.sizes.first, SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 6, summary.summary64k.get(), pending.sizes.second, SQLITE_STATIC))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Execute the statement
+   const auto rc = sqlite3_step(stmt);
+   if (rc != SQLITE_DONE)
+      wxLogDebug(wxT("SqliteSampleBlock::StoreSummary - SQLITE error %s"),
+         sqlite3_errmsg(sqlite3_db_handle(stmt)));
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   return rc == SQLITE_DONE;
+}
+
+auto SqliteSampleBlock::GetCompletedSummary() const -> const Summary *
+{
+   if (!mpPending)
+      return nullptr;
+   CompleteSummary(*mpPending);
+   return &mpPending->summary;
+}
+
+bool SqliteSampleBlock::CopyUnstoredSummary(ArrayOf<char> Summary::*pArray,
+   size_t bytes, float *dest, size_t frameoffset, size_t numframes) const
+{
+   if (!GetCompletedSummary())
+      return false;
+
+   // The arrays may be freed by the thread that stores them
+   std::lock_guard<std::mutex> guard(mpPending->mutex);
+   if (mpPending->stored)
+      return false;
+   CopySummary(mpPending->summary.*pArray, bytes, dest, frameoffset, numframes);
+   return true;
+}
+
+void SqliteSampleBlock::RecoverSummary()
+{
+   wxLogDebug(wxT("SqliteSampleBlock::RecoverSummary - block %lld"), mBlockID);
+
+   SampleBuffer buffer(mSampleCount, mSampleFormat);
+   DoGetSamples(buffer.ptr(), mSampleFormat, 0, mSampleCount);
+
+   auto pPending = std::make_shared<PendingSummary>();
+   pPending->blockID = mBlockID;
+   pPending->format = mSampleFormat;
+   pPending->count = mSampleCount;
+   pPending->sizes = SetSizes(mSampleCount, mSampleFormat);
+   CompleteSummary(*pPending, buffer.ptr());
+   // Loading may happen on any thread, and perhaps while drawing, so keep the
+   // summary in memory for the next batch commit or save to store
+   mpFactory->DeferSummary(pPending);
+   mpPending = std::move(pPending);
+}
+
 double SqliteSampleBlock::GetSumMin() const
 {
-   return mSumMin;
+   auto pSummary = GetCompletedSummary();
+   return pSummary ? pSummary->sumMin : mSumMin;
 }
 
 double SqliteSampleBlock::GetSumMax() const
 {
-   return mSumMax;
+   auto pSummary = GetCompletedSummary();
+   return pSummary ? pSummary->sumMax : mSumMax;
 }
 
 double SqliteSampleBlock::GetSumRms() const
 {
-   return mSumRms;
+   auto pSummary = GetCompletedSummary();
+   return pSummary ? pSummary->sumRms : mSumRms;
 }
 
 /// Retrieves the minimum, maximum, and maximum RMS of the
 /// specified sample data in this block.
 ///
+/// The stored summaries are used for all whole summary frames within the
+/// region; samples are read only for the unaligned head and tail.
+///
 /// @param start The offset in this block where the region should begin
 /// @param len   The number of samples to include in the region
 MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
@@ -479,7 +1740,7 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
 
    float min = FLT_MAX;
    float max = -FLT_MAX;
-   float sumsq = 0;
+   double sumsq = 0;
 
    if (!mValid)
    {
@@ -489,47 +1750,131 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
    if (start < mSampleCount)
    {
       len = std::min(len, mSampleCount - start);
+      const auto end = start + len;
 
-      // TODO: actually use summaries
-      SampleBuffer blockData(len, floatSample);
-      float *samples = (float *) blockData.ptr();
+      // Range of 256-sample frames lying wholly in the region.  The last
+      // frame of the block may be short, and is wholly in the region when
+      // the region extends to the end of the block.
+      const auto frame0 = (start + 255) / 256;
+      const auto frame1 = (end == mSampleCount) ? (end + 255) / 256 : end / 256;
 
-      size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
-      for (size_t i = 0; i < copied; ++i, ++samples)
-      {
-         float sample = *samples;
+      // Range of complete 64k-sample frames lying wholly in the region
+      const auto frame64k0 = (frame0 + 255) / 256;
+      const auto frame64k1 = std::min(frame1 / 256, mSampleCount / 65536);
 
-         if (sample > max)
-         {
-            max = sample;
-         }
-
-         if (sample < min)
+      bool summarized = false;
+      if (frame0 < frame1)
+      {
+         const auto interiorStart = frame0 * 256;
+         const auto interiorEnd = std::min(frame1 * 256, end);
+
+         float frameMin = FLT_MAX;
+         float frameMax = -FLT_MAX;
+         double frameSumsq = 0;
+
+         summarized = (frame64k0 < frame64k1)
+            ? GetSummaryMinMaxSumsq(frame0, frame64k0 * 256,
+                 frameMin, frameMax, frameSumsq) &&
+              GetSummary64kMinMaxSumsq(frame64k0, frame64k1,
+                 frameMin, frameMax, frameSumsq) &&
+              GetSummaryMinMaxSumsq(frame64k1 * 256, frame1,
+                 frameMin, frameMax, frameSumsq)
+            : GetSummaryMinMaxSumsq(frame0, frame1,
+                 frameMin, frameMax, frameSumsq);
+
+         if (summarized)
          {
-            min = sample;
+            min = frameMin;
+            max = frameMax;
+            sumsq = frameSumsq;
+            GetSamplesMinMaxSumsq(start, interiorStart - start, min, max, sumsq);
+            GetSamplesMinMaxSumsq(interiorEnd, end - interiorEnd, min, max, sumsq);
          }
-
-         sumsq += (sample * sample);
       }
+
+      if (!summarized)
+         // Too short to contain a whole frame, or summaries were unreadable
+         GetSamplesMinMaxSumsq(start, len, min, max, sumsq);
    }
 
    return { min, max, (float) sqrt(sumsq / len) };
 }
 
+/// Accumulates extremes and the sum of squares of samples in this block
+void SqliteSampleBlock::GetSamplesMinMaxSumsq(size_t start, size_t len,
+   float &min, float &max, double &sumsq)
+{
+   if (len == 0)
+      return;
+
+   SampleBuffer blockData(len, floatSample);
+   float *samples = (float *) blockData.ptr();
+
+   size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
+   SampleStatistics::Accumulate(samples, copied, min, max, sumsq);
+}
+
+/// Accumulates extremes and the sum of squares from 256-sample summary
+/// frames [frame0, frame1); returns false if the summary can't be read
+bool SqliteSampleBlock::GetSummaryMinMaxSumsq(size_t frame0, size_t frame1,
+   float &min, float &max, double &sumsq)
+{
+   if (frame0 >= frame1)
+      return true;
+
+   const auto numframes = frame1 - frame0;
+   Floats summary{ numframes * fields };
+   if (!GetSummary256(summary.get(), frame0, numframes))
+      return false;
+
+   double frameSumsq = 0;
+   SampleStatistics::AccumulateFrames(
+      summary.get(), numframes, min, max, frameSumsq);
+   sumsq += frameSumsq * 256;
+
+   // The rms of the last frame may be for fewer than 256 samples
+   const auto lastCount = mSampleCount - (frame1 - 1) * 256;
+   if (lastCount < 256)
+   {
+      const double rms = summary[(numframes - 1) * fields + 2];
+      sumsq -= rms * rms * (256 - lastCount);
+   }
+
+   return true;
+}
+
+/// Accumulates extremes and the sum of squares from complete 64k-sample
+/// summary frames [frame0, frame1); returns false if the summary can't be read
+bool SqliteSampleBlock::GetSummary64kMinMaxSumsq(size_t frame0, size_t frame1,
+   float &min, float &max, double &sumsq)
+{
+   if (frame0 >= frame1)
+      return true;
+
+   const auto numframes = frame1 - frame0;
+   Floats summary{ numframes * fields };
+   if (!GetSummary64k(summary.get(), frame0, numframes))
+      return false;
+
+   double frameSumsq = 0;
+   SampleStatistics::AccumulateFrames(
+      summary.get(), numframes, min, max, frameSumsq);
+   sumsq += frameSumsq * 65536;
+
+   return true;
+}
+
 /// Retrieves the minimum, maximum, and maximum RMS of this entire
 /// block.  This is faster than the other GetMinMax function since
 /// these values are already computed.
 MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS() const
 {
-   return { (float) mSumMin, (float) mSumMax, (float) mSumRms };
+   return { (float) GetSumMin(), (float) GetSumMax(), (float) GetSumRms() };
 }
 
 size_t SqliteSampleBlock::GetSpaceUsage() const
 {
-   if (IsSilent())
-      return 0;
-   else
-      return ProjectFileIO::GetDiskUsage(*Conn(), mBlockID);
+   return mSpaceUsage;
 }
 
 size_t SqliteSampleBlock::GetBlob(void *dest,
@@ -539,8 +1884,6 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
                                   size_t srcoffset,
                                   size_t srcbytes)
 {
-   auto db = DB();
-
    wxASSERT(!IsSilent());
 
    if (!mValid)
@@ -563,7 +1906,7 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
    rc = sqlite3_step(stmt);
    if (rc != SQLITE_ROW)
    {
-      wxLogDebug(wxT("SqliteSampleBlock::GetBlob - SQLITE error %s"), sqlite3_errmsg(db));
+      wxLogDebug(wxT("SqliteSampleBlock::GetBlob - SQLITE error %s"), sqlite3_errmsg(sqlite3_db_handle(stmt)));
 
       // Clear statement bindings and rewind statement
       sqlite3_clear_bindings(stmt);
@@ -615,7 +1958,6 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
 
 void SqliteSampleBlock::Load(SampleBlockID sbid)
 {
-   auto db = DB();
    int rc;
 
    wxASSERT(sbid > 0);
@@ -623,6 +1965,7 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
    mValid = false;
    mSampleCount = 0;
    mSampleBytes = 0;
+   mSpaceUsage = 0;
    mSumMin = FLT_MAX;
    mSumMax = -FLT_MAX;
    mSumMin = 0.0;
@@ -630,7 +1973,8 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::LoadSampleBlock,
       "SELECT sampleformat, summin, summax, sumrms,"
-      "       length(samples)"
+      "       length(samples),"
+      "       length(summary256) + length(summary64k)"
       "  FROM sampleblocks WHERE blockid = ?1;");
 
    // Bind statement parameters
@@ -645,7 +1989,7 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
    rc = sqlite3_step(stmt);
    if (rc != SQLITE_ROW)
    {
-      wxLogDebug(wxT("SqliteSampleBlock::Load - SQLITE error %s"), sqlite3_errmsg(db));
+      wxLogDebug(wxT("SqliteSampleBlock::Load - SQLITE error %s"), sqlite3_errmsg(sqlite3_db_handle(stmt)));
 
       // Clear statement bindings and rewind statement
       sqlite3_clear_bindings(stmt);
@@ -658,21 +2002,39 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
 
    // Retrieve returned data
    mBlockID = sbid;
-   mSampleFormat = (sampleFormat) sqlite3_column_int(stmt, 0);
+   const auto storedFormat = sqlite3_column_int64(stmt, 0);
+   mSampleFormat = UnpackFormat(storedFormat);
+   mCodec = UnpackCodec(storedFormat);
+   // The summary is null if the row was inserted with it pending, and the
+   // program ended before a worker could compute it
+   const bool unsummarized = (sqlite3_column_type(stmt, 1) == SQLITE_NULL);
    mSumMin = sqlite3_column_double(stmt, 1);
    mSumMax = sqlite3_column_double(stmt, 2);
    mSumRms = sqlite3_column_double(stmt, 3);
-   mSampleBytes = sqlite3_column_int(stmt, 4);
-   mSampleCount = mSampleBytes / SAMPLE_SIZE(mSampleFormat);
+   const size_t blobBytes = sqlite3_column_int64(stmt, 4);
+   if (mCodec == SampleBlockCodec::Raw)
+   {
+      mSampleBytes = blobBytes;
+      mSampleCount = mSampleBytes / SAMPLE_SIZE(mSampleFormat);
+   }
+   else
+   {
+      mSampleCount = UnpackCount(storedFormat);
+      mSampleBytes = mSampleCount * SAMPLE_SIZE(mSampleFormat);
+   }
+   mSpaceUsage = blobBytes + sqlite3_column_int64(stmt, 5);
 
    // Clear statement bindings and rewind statement
    sqlite3_clear_bindings(stmt);
    sqlite3_reset(stmt);
 
    mValid = true;
+
+   if (unsummarized && !mpPending)
+      RecoverSummary();
 }
 
-void SqliteSampleBlock::Commit(Sizes sizes)
+void SqliteSampleBlock::Commit(Sizes sizes, const Summary *pSummary)
 {
    const auto mSummary256Bytes = sizes.first;
    const auto mSummary64kBytes = sizes.second;
@@ -680,6 +2042,27 @@ void SqliteSampleBlock::Commit(Sizes sizes)
    auto db = DB();
    int rc;
 
+   // Compress if the project wants it and the codec can do it exactly
+   // and profitably; else store the samples as they are
+   ArrayOf<char> encoded;
+   size_t encodedBytes = 0;
+   mCodec = mpFactory->GetCodec();
+   if (mCodec != SampleBlockCodec::Raw &&
+       !SampleBlockCodec::Encode(mCodec, mSamples.get(), mSampleFormat,
+          mSampleCount, encoded, encodedBytes))
+      mCodec = SampleBlockCodec::Raw;
+
+   // Builds that read only older files would take the packed format for a
+   // sample format and the encoded bytes for samples; make them refuse the
+   // file instead, or else store the samples as they are
+   if (mCodec != SampleBlockCodec::Raw &&
+       !Conn()->RequireVersion(ProjectFileIO::ExtensionsVersion))
+      mCodec = SampleBlockCodec::Raw;
+
+   const bool raw = (mCodec == SampleBlockCodec::Raw);
+   const auto blob = raw ? mSamples.get() : encoded.get();
+   const auto blobBytes = raw ? mSampleBytes : encodedBytes;
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::InsertSampleBlock,
       "INSERT INTO sampleblocks (sampleformat, summin, summax, sumrms,"
@@ -689,19 +2072,28 @@ void SqliteSampleBlock::Commit(Sizes sizes)
    // Bind statement parameters
    // Might return SQLITE_MISUSE which means it's our mistake that we violated
    // preconditions; should return SQL_OK which is 0
-   if (sqlite3_bind_int(stmt, 1, mSampleFormat) ||
-       sqlite3_bind_double(stmt, 2, mSumMin) ||
-       sqlite3_bind_double(stmt, 3, mSumMax) ||
-       sqlite3_bind_double(stmt, 4, mSumRms) ||
-       sqlite3_bind_blob(stmt, 5, mSummary256.get(), mSummary256Bytes, SQLITE_STATIC) ||
-       sqlite3_bind_blob(stmt, 6, mSummary64k.get(), mSummary64kBytes, SQLITE_STATIC) ||
-       sqlite3_bind_blob(stmt, 7, mSamples.get(), mSampleBytes, SQLITE_STATIC))
+   // A pending summary leaves the summary columns null
+   if (sqlite3_bind_int64(stmt, 1,
+          PackFormat(mSampleFormat, mCodec, mSampleCount)) ||
+       (pSummary &&
+          (sqlite3_bind_double(stmt, 2, pSummary->sumMin) ||
+           sqlite3_bind_double(stmt, 3, pSummary->sumMax) ||
+           sqlite3_bind_double(stmt, 4, pSummary->sumRms) ||
+           sqlite3_bind_blob(stmt, 5, pSummary->summary256.get(), mSummary256Bytes, SQLITE_STATIC) ||
+           sqlite3_bind_blob(stmt, 6, pSummary->summary64k.get(), mSummary64kBytes, SQLITE_STATIC))) ||
+       sqlite3_bind_blob(stmt, 7, blob, blobBytes, SQLITE_STATIC))
    {
       wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
    }
  
-   // Execute the statement
+   // Execute the statement.  Other threads may insert blocks too, so hold
+   // the connection until the id of the new row is known.
+   const auto mutex = sqlite3_db_mutex(db);
+   sqlite3_mutex_enter(mutex);
    rc = sqlite3_step(stmt);
+   if (rc == SQLITE_DONE)
+      mBlockID = sqlite3_last_insert_rowid(db);
+   sqlite3_mutex_leave(mutex);
    if (rc != SQLITE_DONE)
    {
       wxLogDebug(wxT("SqliteSampleBlock::Commit - SQLITE error %s"), sqlite3_errmsg(db));
@@ -715,19 +2107,49 @@ void SqliteSampleBlock::Commit(Sizes sizes)
       Conn()->ThrowException( true );
    }
 
-   // Retrieve returned data
-   mBlockID = sqlite3_last_insert_rowid(db);
+   // Count the summaries, even if pending, which will fill them soon
+   mSpaceUsage = blobBytes + mSummary256Bytes + mSummary64kBytes;
+
+   // Newly written samples are likely to be read soon for display, so hand
+   // them to the cache rather than freeing them
+   auto pContents = std::make_shared<SampleBlockCache::Contents>();
+   pContents->data = std::move(mSamples);
+   pContents->bytes = mSampleBytes;
+   mpFactory->mCache.Insert(mBlockID, pContents);
 
    // Reset local arrays
    mSamples.reset();
-   mSummary256.reset();
-   mSummary64k.reset();
 
    // Clear statement bindings and rewind statement
    sqlite3_clear_bindings(stmt);
    sqlite3_reset(stmt);
 
+   if (pSummary)
+   {
+      mSumMin = pSummary->sumMin;
+      mSumMax = pSummary->sumMax;
+      mSumRms = pSummary->sumRms;
+   }
+   else
+   {
+      auto pPending = std::make_shared<PendingSummary>();
+      pPending->blockID = mBlockID;
+      pPending->format = mSampleFormat;
+      pPending->count = mSampleCount;
+      pPending->sizes = sizes;
+      pPending->pSamples = std::move(pContents);
+      mpPending = pPending;
+      if (!mpFactory->EnqueueSummary(pPending))
+      {
+         // The batch ended meanwhile
+         CompleteSummary(*pPending);
+         mpFactory->DeferSummary(pPending);
+      }
+   }
+
    mValid = true;
+
+   mpFactory->OnCommitted(mSpaceUsage);
 }
 
 void SqliteSampleBlock::Delete()
@@ -767,6 +2189,8 @@ void SqliteSampleBlock::Delete()
    // Clear statement bindings and rewind statement
    sqlite3_clear_bindings(stmt);
    sqlite3_reset(stmt);
+
+   DeleteDerivedSummaries();
 }
 
 void SqliteSampleBlock::SaveXML(XMLWriter &xmlFile)
@@ -786,77 +2210,72 @@ auto SqliteSampleBlock::SetSizes(
    return { frames256 * bytesPerFrame, frames64k * bytesPerFrame };
 }
 
-/// Calculates summary block data describing this sample data.
+/// Calculates summary block data describing sample data.
 ///
-/// This method also has the side effect of setting the mSumMin,
-/// mSumMax, and mSumRms members of this class.
+/// The block-level minimum, maximum, and RMS are computed too.
+/// This does not use the block, so that worker threads may call it.
 ///
-void SqliteSampleBlock::CalcSummary(Sizes sizes)
+void SqliteSampleBlock::CalcSummary(Sizes sizes, constSamplePtr src,
+   sampleFormat format, size_t count, Summary &summary)
 {
    const auto mSummary256Bytes = sizes.first;
    const auto mSummary64kBytes = sizes.second;
 
    Floats samplebuffer;
-   float *samples;
+   const float *samples = nullptr;
 
-   if (mSampleFormat == floatSample)
+   // 16 bit samples are summarized as they are, without conversion
+   const bool int16 = (format == int16Sample);
+   const short *shorts = (const short *) src;
+
+   if (format == floatSample)
    {
-      samples = (float *) mSamples.get();
+      samples = (const float *) src;
    }
-   else
+   else if (!int16)
    {
-      samplebuffer.reinit((unsigned) mSampleCount);
-      CopySamples(mSamples.get(),
-                  mSampleFormat,
+      samplebuffer.reinit((unsigned) count);
+      CopySamples(src,
+                  format,
                   (samplePtr) samplebuffer.get(),
                   floatSample,
-                  mSampleCount);
+                  count);
       samples = samplebuffer.get();
    }
    
-   mSummary256.reinit(mSummary256Bytes);
-   mSummary64k.reinit(mSummary64kBytes);
+   summary.summary256.reinit(mSummary256Bytes);
+   summary.summary64k.reinit(mSummary64kBytes);
 
-   float *summary256 = (float *) mSummary256.get();
-   float *summary64k = (float *) mSummary64k.get();
+   float *summary256 = (float *) summary.summary256.get();
+   float *summary64k = (float *) summary.summary64k.get();
 
    float min;
    float max;
-   float sumsq;
+   double sumsq;
    double totalSquares = 0.0;
    double fraction = 0.0;
 
    // Recalc 256 summaries
-   int sumLen = (mSampleCount + 255) / 256;
+   int sumLen = (count + 255) / 256;
    int summaries = 256;
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = samples[i * 256];
-      max = samples[i * 256];
-      sumsq = min * min;
+      min = FLT_MAX;
+      max = -FLT_MAX;
+      sumsq = 0.0;
 
       int jcount = 256;
-      if (jcount > mSampleCount - i * 256)
+      if (jcount > count - i * 256)
       {
-         jcount = mSampleCount - i * 256;
+         jcount = count - i * 256;
          fraction = 1.0 - (jcount / 256.0);
       }
 
-      for (int j = 1; j < jcount; ++j)
-      {
-         float f1 = samples[i * 256 + j];
-         sumsq += f1 * f1;
-
-         if (f1 < min)
-         {
-            min = f1;
-         }
-         else if (f1 > max)
-         {
-            max = f1;
-         }
-      }
+      if (int16)
+         SampleStatistics::Accumulate(shorts + i * 256, jcount, min, max, sumsq);
+      else
+         SampleStatistics::Accumulate(samples + i * 256, jcount, min, max, sumsq);
 
       totalSquares += sumsq;
 
@@ -878,35 +2297,21 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    }
 
    // Calculate now while we can do it accurately
-   mSumRms = sqrt(totalSquares / mSampleCount);
+   summary.sumRms = sqrt(totalSquares / count);
 
    // Recalc 64K summaries
-   sumLen = (mSampleCount + 65535) / 65536;
+   sumLen = (count + 65535) / 65536;
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = summary256[3 * i * 256];
-      max = summary256[3 * i * 256 + 1];
-      sumsq = summary256[3 * i * 256 + 2];
-      sumsq *= sumsq;
+      min = FLT_MAX;
+      max = -FLT_MAX;
+      sumsq = 0.0;
 
-      for (int j = 1; j < 256; ++j)
-      {
-         // we can overflow the useful summary256 values here, but have put
-         // non-harmful values in them
-         if (summary256[3 * (i * 256 + j)] < min)
-         {
-            min = summary256[3 * (i * 256 + j)];
-         }
-
-         if (summary256[3 * (i * 256 + j) + 1] > max)
-         {
-            max = summary256[3 * (i * 256 + j) + 1];
-         }
-
-         float r1 = summary256[3 * (i * 256 + j) + 2];
-         sumsq += r1 * r1;
-      }
+      // we can overflow the useful summary256 values here, but have put
+      // non-harmful values in them
+      SampleStatistics::AccumulateFrames(
+         &summary256[3 * i * 256], 256, min, max, sumsq);
 
       double denom = (i < sumLen - 1) ? 256.0 : summaries - fraction;
       float rms = (float) sqrt(sumsq / denom);
@@ -927,24 +2332,13 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    }
 
    // Recalc block-level summary (mRMS already calculated)
-   min = summary64k[0];
-   max = summary64k[1];
-
-   for (int i = 1; i < sumLen; ++i)
-   {
-      if (summary64k[i * fields] < min)
-      {
-         min = summary64k[i * fields];
-      }
-
-      if (summary64k[i * fields + 1] > max)
-      {
-         max = summary64k[i * fields + 1];
-      }
-   }
+   min = FLT_MAX;
+   max = -FLT_MAX;
+   sumsq = 0.0;
+   SampleStatistics::AccumulateFrames(summary64k, sumLen, min, max, sumsq);
 
-   mSumMin = min;
-   mSumMax = max;
+   summary.sumMin = min;
+   summary.sumMax = max;
 }
 
 // Inject our database implementation at startup
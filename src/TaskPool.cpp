@@ -0,0 +1,95 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file TaskPool.cpp
+
+**********************************************************************/
+
+#include "TaskPool.h"
+
+TaskPool::TaskPool( size_t nThreads )
+{
+   mThreads.reserve( nThreads );
+   for ( size_t ii = 0; ii < nThreads; ++ii )
+      mThreads.emplace_back( [this]{ Thread(); } );
+}
+
+TaskPool::~TaskPool()
+{
+   {
+      std::lock_guard<std::mutex> guard( mMutex );
+      mStop = true;
+   }
+   mStart.notify_all();
+   for ( auto &thread : mThreads )
+      thread.join();
+}
+
+void TaskPool::Run( size_t nTasks, const Task &task )
+{
+   if ( nTasks == 0 )
+      return;
+
+   // Don't wake the threads for one task
+   const bool parallel = nTasks > 1 && !mThreads.empty();
+   {
+      std::lock_guard<std::mutex> guard( mMutex );
+      mpTask = &task;
+      mnTasks = nTasks;
+      mNext = 0;
+      mpException = nullptr;
+      if ( parallel ) {
+         ++mBatch;
+         mBusy = mThreads.size();
+      }
+   }
+   if ( parallel )
+      mStart.notify_all();
+
+   Work();
+
+   std::exception_ptr pException;
+   {
+      std::unique_lock<std::mutex> lock( mMutex );
+      mFinish.wait( lock, [this]{ return mBusy == 0; } );
+      mpTask = nullptr;
+      pException = mpException;
+   }
+   if ( pException )
+      std::rethrow_exception( pException );
+}
+
+void TaskPool::Thread()
+{
+   unsigned long long batch = 0;
+   std::unique_lock<std::mutex> lock( mMutex );
+   while ( true ) {
+      mStart.wait( lock, [&]{ return mStop || mBatch != batch; } );
+      if ( mStop )
+         return;
+      batch = mBatch;
+
+      lock.unlock();
+      Work();
+      lock.lock();
+
+      if ( --mBusy == 0 )
+         mFinish.notify_one();
+   }
+}
+
+void TaskPool::Work()
+{
+   size_t ii;
+   while ( ( ii = mNext++ ) < mnTasks ) {
+      try {
+         ( *mpTask )( ii );
+      }
+      catch ( ... ) {
+         std::lock_guard<std::mutex> guard( mMutex );
+         if ( !mpException )
+            mpException = std::current_exception();
+      }
+   }
+}
@@ -0,0 +1,73 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file TaskPool.h
+@brief Run independent tasks of one batch on several threads
+
+**********************************************************************/
+
+#ifndef __AUDACITY_TASK_POOL__
+#define __AUDACITY_TASK_POOL__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Threads that share the tasks of each batch given to Run()
+/*! The thread calling Run() works too.  Each thread claims the next
+    unclaimed task when it finishes one, so threads that draw quick tasks
+    take more of them, and the batch is done about when its slowest task is.
+    Run() may be called by only one thread at a time. */
+class TaskPool
+{
+public:
+   //! Task of a batch, given its index
+   using Task = std::function< void( size_t ) >;
+
+   //! Start threads in addition to the one that will call Run()
+   explicit TaskPool( size_t nThreads );
+   ~TaskPool();
+
+   TaskPool( const TaskPool& ) = delete;
+   TaskPool &operator=( const TaskPool& ) = delete;
+
+   //! Number of threads in addition to the caller of Run()
+   size_t GetThreadCount() const { return mThreads.size(); }
+
+   //! Call task(0) ... task(nTasks - 1), returning when all are done
+   /*! If tasks throw, the others still run; then the first exception is
+       rethrown */
+   void Run( size_t nTasks, const Task &task );
+
+private:
+   void Thread();
+   //! Do tasks of the batch until none are unclaimed
+   void Work();
+
+   std::vector<std::thread> mThreads;
+
+   std::mutex mMutex;
+   //! Signalled when a batch starts, or when the threads must stop
+   std::condition_variable mStart;
+   //! Signalled when the last thread finishes its share of the batch
+   std::condition_variable mFinish;
+
+   // Guarded by mMutex
+   unsigned long long mBatch{ 0 };
+   size_t mBusy{ 0 };
+   bool mStop{ false };
+   std::exception_ptr mpException;
+
+   // Set before the threads are notified of the batch
+   const Task *mpTask{ nullptr };
+   size_t mnTasks{ 0 };
+   std::atomic<size_t> mNext{ 0 };
+};
+
+#endif
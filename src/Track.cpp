@@ -122,6 +122,21 @@ Track::Holder Track::Duplicate() const
    return result;
 }
 
+Track::Holder Track::Snapshot(const Track *pPrevious) const
+{
+   auto result = CloneSharing(pPrevious);
+
+   if (mpView)
+      mpView->CopyTo( *result );
+
+   return result;
+}
+
+Track::Holder Track::CloneSharing(const Track *) const
+{
+   return Clone();
+}
+
 Track::~Track()
 {
 }
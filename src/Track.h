@@ -402,6 +402,12 @@ private:
    // public nonvirtual duplication function that invokes Clone():
    virtual Holder Duplicate() const;
 
+   //! Like Duplicate(), but the result may share data with pPrevious
+   /*! pPrevious, if not null, is an earlier duplicate of this track that
+       no one will ever modify, such as a track in an undo state.  Then the
+       result must not be modified either. */
+   Holder Snapshot(const Track *pPrevious) const;
+
    // Called when this track is merged to stereo with another, and should
    // take on some parameters of its partner.
    virtual void Merge(const Track &orig);
@@ -463,6 +469,10 @@ private:
    // the track data proper (not associated data such as for groups and views):
    virtual Holder Clone() const = 0;
 
+   // Subclass may override this part of Snapshot(), to share unchanged
+   // data with the previous snapshot; default just invokes Clone():
+   virtual Holder CloneSharing(const Track *pPrevious) const;
+
    virtual TrackKind GetKind() const { return TrackKind::None; }
 
    template<typename T>
@@ -277,6 +277,27 @@ bool UndoManager::RedoAvailable()
    return (current < (int)stack.size() - 1);
 }
 
+namespace {
+   //! Duplicate the tracks for an undo state
+   /*! Clips that did not change since the previous state are shared with it
+       and not copied, so that the cost of pushing a state is proportional to
+       the change and not to the size of the project.  This is safe because
+       tracks in undo states are never modified, only duplicated again. */
+   std::shared_ptr<TrackList>
+   Snapshot(const TrackList &tracks, TrackList *pPrevious)
+   {
+      auto tracksCopy = TrackList::Create( nullptr );
+      for (auto t : tracks) {
+         if ( t->GetId() == TrackId{} )
+            // Don't copy a pending added track
+            continue;
+         auto pOld = pPrevious ? pPrevious->FindById( t->GetId() ) : nullptr;
+         tracksCopy->Add(t->Snapshot(pOld));
+      }
+      return tracksCopy;
+   }
+}
+
 void UndoManager::ModifyState(const TrackList * l,
                               const SelectedRegion &selectedRegion,
                               const std::shared_ptr<Tags> &tags)
@@ -286,17 +307,8 @@ void UndoManager::ModifyState(const TrackList * l,
    }
 
 //   SonifyBeginModifyState();
-   // Delete current -- not necessary, but let's reclaim space early
-   stack[current]->state.tracks.reset();
-
-   // Duplicate
-   auto tracksCopy = TrackList::Create( nullptr );
-   for (auto t : *l) {
-      if ( t->GetId() == TrackId{} )
-         // Don't copy a pending added track
-         continue;
-      tracksCopy->Add(t->Duplicate());
-   }
+   // Duplicate, sharing what is unchanged since the current state
+   auto tracksCopy = Snapshot(*l, stack[current]->state.tracks.get());
 
    // Replace
    stack[current]->state.tracks = std::move(tracksCopy);
@@ -343,13 +355,8 @@ void UndoManager::PushState(const TrackList * l,
       return;
    }
 
-   auto tracksCopy = TrackList::Create( nullptr );
-   for (auto t : *l) {
-      if ( t->GetId() == TrackId{} )
-         // Don't copy a pending added track
-         continue;
-      tracksCopy->Add(t->Duplicate());
-   }
+   auto tracksCopy = Snapshot(*l,
+      current >= 0 ? stack[current]->state.tracks.get() : nullptr);
 
    mayConsolidate = true;
 
@@ -23,6 +23,7 @@
 
 #include "Experimental.h"
 
+#include <float.h>
 #include <math.h>
 #include <vector>
 #include <wx/log.h>
@@ -32,6 +33,7 @@
 #include "Prefs.h"
 #include "Envelope.h"
 #include "Resample.h"
+#include "SampleStatistics.h"
 #include "WaveTrack.h"
 #include "Profiler.h"
 #include "InconsistencyException.h"
@@ -159,6 +161,26 @@ WaveClip::WaveClip(const WaveClip& orig,
    mIsPlaceholder = orig.GetIsPlaceholder();
 }
 
+bool WaveClip::IsSameAs(const WaveClip &other) const
+{
+   if (mOffset != other.mOffset ||
+       mRate != other.mRate ||
+       mColourIndex != other.mColourIndex ||
+       mIsPlaceholder != other.mIsPlaceholder ||
+       mCutLines.size() != other.mCutLines.size())
+      return false;
+
+   if (!mSequence->IsSameAs(*other.mSequence) ||
+       !mEnvelope->IsSameAs(*other.mEnvelope))
+      return false;
+
+   for (size_t ii = 0, count = mCutLines.size(); ii < count; ++ii)
+      if (!mCutLines[ii]->IsSameAs(*other.mCutLines[ii]))
+         return false;
+
+   return true;
+}
+
 WaveClip::WaveClip(const WaveClip& orig,
                    const SampleBlockFactoryPtr &factory,
                    bool copyCutlines,
@@ -254,7 +276,7 @@ double WaveClip::GetEndTime() const
 {
    auto numSamples = mSequence->GetNumSamples();
 
-   double maxLen = mOffset + (numSamples+mAppendBufferLen).as_double()/mRate;
+   double maxLen = mOffset + (numSamples+mSequence->GetAppendBufferLen()).as_double()/mRate;
    // JS: calculated value is not the length;
    // it is a maximum value and can be negative; no clipping to 0
 
@@ -284,7 +306,7 @@ sampleCount WaveClip::GetNumSamples() const
 bool WaveClip::WithinClip(double t) const
 {
    auto ts = (sampleCount)floor(t * mRate + 0.5);
-   return ts > GetStartSample() && ts < GetEndSample() + mAppendBufferLen;
+   return ts > GetStartSample() && ts < GetEndSample() + mSequence->GetAppendBufferLen();
 }
 
 bool WaveClip::BeforeClip(double t) const
@@ -296,7 +318,7 @@ bool WaveClip::BeforeClip(double t) const
 bool WaveClip::AfterClip(double t) const
 {
    auto ts = (sampleCount)floor(t * mRate + 0.5);
-   return ts >= GetEndSample() + mAppendBufferLen;
+   return ts >= GetEndSample() + mSequence->GetAppendBufferLen();
 }
 
 // A sample at time t could be in the clip, but 
@@ -305,7 +327,7 @@ bool WaveClip::AfterClip(double t) const
 bool WaveClip::IsClipStartAfterClip(double t) const
 {
    auto ts = (sampleCount)floor(t * mRate + 0.5);
-   return ts >= GetEndSample() + mAppendBufferLen;
+   return ts >= GetEndSample() + mSequence->GetAppendBufferLen();
 }
 
 
@@ -503,45 +525,38 @@ bool WaveClip::GetWaveDisplay(WaveDisplay &display, double t0,
       //compute the values that are outside the overlap from scratch.
       if (a < p1) {
          sampleFormat seqFormat = mSequence->GetSampleFormat();
+         const auto appendBufferLen = mSequence->GetAppendBufferLen();
+         const auto appendBuffer = mSequence->GetAppendBuffer();
          bool didUpdate = false;
          for(auto i = a; i < p1; i++) {
             auto left = std::max(sampleCount{ 0 },
                                  where[i] - numSamples);
-            auto right = std::min(sampleCount{ mAppendBufferLen },
+            auto right = std::min(sampleCount{ appendBufferLen },
                                   where[i + 1] - numSamples);
 
             //wxCriticalSectionLocker locker(mAppendCriticalSection);
 
             if (right > left) {
                Floats b;
-               float *pb{};
-               // left is nonnegative and at most mAppendBufferLen:
+               const float *pb{};
+               // left is nonnegative and at most appendBufferLen:
                auto sLeft = left.as_size_t();
-               // The difference is at most mAppendBufferLen:
+               // The difference is at most appendBufferLen:
                size_t len = ( right - left ).as_size_t();
 
                if (seqFormat == floatSample)
-                  pb = &((float *)mAppendBuffer.ptr())[sLeft];
+                  pb = &((const float *)appendBuffer)[sLeft];
                else {
                   b.reinit(len);
                   pb = b.get();
-                  CopySamples(mAppendBuffer.ptr() + sLeft * SAMPLE_SIZE(seqFormat),
+                  CopySamples(appendBuffer + sLeft * SAMPLE_SIZE(seqFormat),
                               seqFormat,
-                              (samplePtr)pb, floatSample, len);
+                              (samplePtr)b.get(), floatSample, len);
                }
 
-               float theMax, theMin, sumsq;
-               {
-                  const float val = pb[0];
-                  theMax = theMin = val;
-                  sumsq = val * val;
-               }
-               for(decltype(len) j = 1; j < len; j++) {
-                  const float val = pb[j];
-                  theMax = std::max(theMax, val);
-                  theMin = std::min(theMin, val);
-                  sumsq += val * val;
-               }
+               float theMax = -FLT_MAX, theMin = FLT_MAX;
+               double sumsq = 0;
+               SampleStatistics::Accumulate(pb, len, theMin, theMax, sumsq);
 
                min[i] = theMin;
                max[i] = theMax;
@@ -1207,14 +1222,6 @@ bool WaveClip::Append(constSamplePtr buffer, sampleFormat format,
                       size_t len, unsigned int stride)
 {
    //wxLogDebug(wxT("Append: len=%lli"), (long long) len);
-   bool result = false;
-
-   auto maxBlockSize = mSequence->GetMaxBlockSize();
-   auto blockSize = mSequence->GetIdealAppendLen();
-   sampleFormat seqFormat = mSequence->GetSampleFormat();
-
-   if (!mAppendBuffer.ptr())
-      mAppendBuffer.Allocate(maxBlockSize, seqFormat);
 
    auto cleanup = finally( [&] {
       // use No-fail-guarantee
@@ -1222,41 +1229,8 @@ bool WaveClip::Append(constSamplePtr buffer, sampleFormat format,
       MarkChanged();
    } );
 
-   for(;;) {
-      if (mAppendBufferLen >= blockSize) {
-         // flush some previously appended contents
-         // use Strong-guarantee
-         mSequence->Append(mAppendBuffer.ptr(), seqFormat, blockSize);
-         result = true;
-
-         // use No-fail-guarantee for rest of this "if"
-         memmove(mAppendBuffer.ptr(),
-                 mAppendBuffer.ptr() + blockSize * SAMPLE_SIZE(seqFormat),
-                 (mAppendBufferLen - blockSize) * SAMPLE_SIZE(seqFormat));
-         mAppendBufferLen -= blockSize;
-         blockSize = mSequence->GetIdealAppendLen();
-      }
-
-      if (len == 0)
-         break;
-
-      // use No-fail-guarantee for rest of this "for"
-      wxASSERT(mAppendBufferLen <= maxBlockSize);
-      auto toCopy = std::min(len, maxBlockSize - mAppendBufferLen);
-
-      CopySamples(buffer, format,
-                  mAppendBuffer.ptr() + mAppendBufferLen * SAMPLE_SIZE(seqFormat),
-                  seqFormat,
-                  toCopy,
-                  true, // high quality
-                  stride);
-
-      mAppendBufferLen += toCopy;
-      buffer += toCopy * SAMPLE_SIZE(format) * stride;
-      len -= toCopy;
-   }
-
-   return result;
+   // The sequence accumulates the samples in its open tail block
+   return mSequence->AppendBuffered(buffer, format, len, stride);
 }
 
 /*! @excsafety{Mixed} */
@@ -1267,23 +1241,20 @@ clip gets appended; no previously flushed contents are lost. */
 void WaveClip::Flush()
 {
    //wxLogDebug(wxT("WaveClip::Flush"));
-   //wxLogDebug(wxT("   mAppendBufferLen=%lli"), (long long) mAppendBufferLen);
+   //wxLogDebug(wxT("   append buffer length=%lli"), (long long) mSequence->GetAppendBufferLen());
    //wxLogDebug(wxT("   previous sample count %lli"), (long long) mSequence->GetNumSamples());
 
-   if (mAppendBufferLen > 0) {
+   if (mSequence->GetAppendBufferLen() > 0) {
 
       auto cleanup = finally( [&] {
-         // Blow away the append buffer even in case of failure.  May lose some
-         // data but don't leave the track in an un-flushed state.
-
          // Use No-fail-guarantee of these steps.
-         mAppendBufferLen = 0;
          UpdateEnvelopeTrackLen();
          MarkChanged();
       } );
 
-      mSequence->Append(mAppendBuffer.ptr(), mSequence->GetSampleFormat(),
-         mAppendBufferLen);
+      // The sequence discards the append buffer even in case of failure.
+      // May lose some data but doesn't leave the track in an un-flushed state.
+      mSequence->Flush();
    }
 
    //wxLogDebug(wxT("now sample count %lli"), (long long) mSequence->GetNumSamples());
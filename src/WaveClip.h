@@ -197,6 +197,11 @@ public:
 
    virtual ~WaveClip();
 
+   //! Whether a copy of this clip, with cutlines, would be the same as other
+   /*! This is cheap compared with copying:  sample blocks are compared by
+       identity and not by contents, and nothing is allocated */
+   bool IsSameAs(const WaveClip &other) const;
+
    void ConvertToSampleFormat(sampleFormat format,
       const std::function<void(size_t)> & progressReport = {});
 
@@ -368,8 +373,6 @@ protected:
 
    mutable std::unique_ptr<WaveCache> mWaveCache;
    mutable std::unique_ptr<SpecCache> mSpecCache;
-   SampleBuffer  mAppendBuffer {};
-   size_t        mAppendBufferLen { 0 };
 
    // Cut Lines are nothing more than ordinary wave clips, with the
    // offset relative to the start of the clip.
@@ -39,6 +39,7 @@ from the project that will own the track.
 #include <float.h>
 #include <math.h>
 #include <algorithm>
+#include <unordered_map>
 
 #include "float_cast.h"
 
@@ -82,13 +83,28 @@ WaveTrack::Holder WaveTrackFactory::DuplicateWaveTrack(const WaveTrack &orig)
 }
 
 
+auto WaveTrackFactory::ReadDefaults() -> Defaults
+{
+   return { QualityPrefs::SampleFormatChoice(),
+      TracksPrefs::GetDefaultAudioTrackNamePreference() };
+}
+
+auto WaveTrackFactory::GetDefaults() const -> Defaults
+{
+   return mpDefaults ? *mpDefaults : ReadDefaults();
+}
+
 WaveTrack::Holder WaveTrackFactory::NewWaveTrack(sampleFormat format, double rate)
 {
+   const auto defaults = GetDefaults();
    if (format == (sampleFormat)0)
-      format = QualityPrefs::SampleFormatChoice();
+      format = defaults.format;
    if (rate == 0)
       rate = mSettings.GetRate();
-   return std::make_shared<WaveTrack> ( mpFactory, format, rate );
+   auto result = std::make_shared<WaveTrack> ( mpFactory, format, rate );
+   result->SetDefaultName(defaults.name);
+   result->SetName(defaults.name);
+   return result;
 }
 
 WaveTrack::WaveTrack( const SampleBlockFactoryPtr &pFactory,
@@ -105,8 +121,7 @@ WaveTrack::WaveTrack( const SampleBlockFactoryPtr &pFactory,
    mOldGain[0] = 0.0;
    mOldGain[1] = 0.0;
    mWaveColorIndex = 0;
-   SetDefaultName(TracksPrefs::GetDefaultAudioTrackNamePreference());
-   SetName(GetDefaultName());
+   // WaveTrackFactory names new tracks; copies take the names of originals
    mDisplayMin = -1.0;
    mDisplayMax = 1.0;
    mSpectrumMin = mSpectrumMax = -1; // so values will default to settings
@@ -357,6 +372,43 @@ Track::Holder WaveTrack::Clone() const
    return std::make_shared<WaveTrack>( *this );
 }
 
+Track::Holder WaveTrack::CloneSharing(const Track *pPrevious) const
+{
+   auto pOld = dynamic_cast<const WaveTrack*>(pPrevious);
+   if (!pOld || pOld->mpFactory != mpFactory) {
+      auto result = std::make_shared<WaveTrack>( *this );
+      for (const auto &pClip : mClips)
+         result->mClipSources.push_back(pClip.get());
+      return result;
+   }
+
+   // Copy everything but the clips
+   auto result = std::make_shared<WaveTrack>( mpFactory, mFormat, mRate );
+   result->vrulerSize = vrulerSize;
+   result->Reinit( *this );
+   result->mOffset = mOffset;
+
+   // Find the clips of the previous snapshot by the clips they were made
+   // from, and reuse each that a copy would reproduce
+   std::unordered_map<const WaveClip*, const WaveClipHolder*> oldClips;
+   const auto count =
+      std::min(pOld->mClipSources.size(), pOld->mClips.size());
+   for (size_t ii = 0; ii < count; ++ii)
+      oldClips.emplace(pOld->mClipSources[ii], &pOld->mClips[ii]);
+
+   for (const auto &pClip : mClips) {
+      const auto iter = oldClips.find(pClip.get());
+      if (iter != oldClips.end() && pClip->IsSameAs(**iter->second))
+         result->mClips.push_back(*iter->second);
+      else
+         result->mClips.push_back
+            ( std::make_unique<WaveClip>( *pClip, mpFactory, true ) );
+      result->mClipSources.push_back(pClip.get());
+   }
+
+   return result;
+}
+
 double WaveTrack::GetRate() const
 {
    return mRate;
@@ -1727,6 +1779,15 @@ XMLTagHandler *WaveTrack::HandleXMLChild(const wxChar *tag)
 
 void WaveTrack::WriteXML(XMLWriter &xmlFile) const
 // may throw
+{
+   WriteXML(xmlFile, [&](const WaveClip &clip) -> XMLWriter & {
+      clip.WriteXML(xmlFile);
+      return xmlFile;
+   });
+}
+
+void WaveTrack::WriteXML(XMLWriter &xmlFile, const ClipWriter &writeClip) const
+// may throw
 {
    xmlFile.StartTag(wxT("wavetrack"));
    this->Track::WriteCommonXMLAttributes( xmlFile );
@@ -1739,12 +1800,13 @@ void WaveTrack::WriteXML(XMLWriter &xmlFile) const
    xmlFile.WriteAttr(wxT("colorindex"), mWaveColorIndex );
    xmlFile.WriteAttr(wxT("sampleformat"), static_cast<long>(mFormat) );
 
+   XMLWriter *pWriter = &xmlFile;
    for (const auto &clip : mClips)
    {
-      clip->WriteXML(xmlFile);
+      pWriter = &writeClip(*clip);
    }
 
-   xmlFile.EndTag(wxT("wavetrack"));
+   pWriter->EndTag(wxT("wavetrack"));
 }
 
 bool WaveTrack::GetErrorOpening()
@@ -84,6 +84,7 @@ private:
    void Init(const WaveTrack &orig);
 
    Track::Holder Clone() const override;
+   Track::Holder CloneSharing(const Track *pPrevious) const override;
 
    friend class WaveTrackFactory;
 
@@ -302,6 +303,12 @@ private:
    XMLTagHandler *HandleXMLChild(const wxChar *tag) override;
    void WriteXML(XMLWriter &xmlFile) const override;
 
+   //! Writes each clip and returns the writer for what follows it
+   using ClipWriter = std::function< XMLWriter &(const WaveClip &clip) >;
+   //! Write as the other WriteXML() does, but let writeClip write the clips,
+   //! so that the document may be split among several writers
+   void WriteXML(XMLWriter &xmlFile, const ClipWriter &writeClip) const;
+
    // Returns true if an error occurred while reading from XML
    bool GetErrorOpening() override;
 
@@ -548,6 +555,9 @@ private:
    //
 
    WaveClipHolders mClips;
+   //! In a snapshot made by CloneSharing(), the clip of the track that each
+   //! of mClips was copied from or matched; the clip may be gone since
+   std::vector<const WaveClip*> mClipSources;
 
    sampleFormat  mFormat;
    int           mRate;
@@ -679,21 +689,44 @@ class AUDACITY_DLL_API WaveTrackFactory final
    static WaveTrackFactory &Reset( AudacityProject &project );
    static void Destroy( AudacityProject &project );
 
+   //! Defaults for new tracks that come from preferences
+   struct Defaults
+   {
+      sampleFormat format;
+      wxString name;
+   };
+   //! Read the defaults from preferences, which only the main thread may do
+   static Defaults ReadDefaults();
+
    WaveTrackFactory( const ProjectSettings &settings,
       const SampleBlockFactoryPtr &pFactory)
       : mSettings{ settings }
       , mpFactory(pFactory)
    {
    }
+   //! A factory that may make tracks on another thread, as for parallel
+   //! import, with defaults read in advance
+   WaveTrackFactory( const ProjectSettings &settings,
+      const SampleBlockFactoryPtr &pFactory,
+      const Defaults &defaults)
+      : mSettings{ settings }
+      , mpFactory(pFactory)
+      , mpDefaults{ std::make_unique<Defaults>(defaults) }
+   {
+   }
    WaveTrackFactory( const WaveTrackFactory & ) PROHIBITED;
    WaveTrackFactory &operator=( const WaveTrackFactory & ) PROHIBITED;
 
    const SampleBlockFactoryPtr &GetSampleBlockFactory() const
    { return mpFactory; }
 
+   //! The defaults given to the constructor, or else read now
+   Defaults GetDefaults() const;
+
  private:
    const ProjectSettings &mSettings;
    SampleBlockFactoryPtr mpFactory;
+   const std::unique_ptr<const Defaults> mpDefaults;
  public:
    std::shared_ptr<WaveTrack> DuplicateWaveTrack(const WaveTrack &orig);
    std::shared_ptr<WaveTrack> NewWaveTrack(
@@ -16,7 +16,11 @@
 #include "audacity/EffectInterface.h"
 #include "MemoryX.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
 #include <wx/time.h>
 
 class RealtimeEffectState
@@ -33,6 +37,11 @@ public:
       unsigned chans, float **inbuf, float **outbuf, size_t numSamples);
    bool IsRealtimeActive();
 
+   // Suspending while the callback may process this one effect takes two
+   // steps, with a wait for the callback between them
+   void PrepareSuspend();
+   bool FinishSuspend();
+
 private:
    EffectClientInterface &mEffect;
 
@@ -42,6 +51,51 @@ private:
    std::atomic<int> mRealtimeSuspendCount{ 1 };    // Effects are initially suspended
 };
 
+#if defined(EXPERIMENTAL_REALTIME_ALLOCATION_CHECK)
+namespace {
+// Set while this thread is in the audio callback or the realtime effect chain
+thread_local bool sInRealtimeCallback = false;
+
+void FailRealtimeAllocation(const wxChar *msg)
+{
+   // Clear the flag first, because reporting allocates
+   sInRealtimeCallback = false;
+   wxFAIL_MSG(msg);
+}
+}
+
+RealtimeAllocationCheck::RealtimeAllocationCheck()
+   : mWasChecking{ sInRealtimeCallback }
+{
+   sInRealtimeCallback = true;
+}
+
+RealtimeAllocationCheck::~RealtimeAllocationCheck()
+{
+   sInRealtimeCallback = mWasChecking;
+}
+
+void *operator new(std::size_t size)
+{
+   if (sInRealtimeCallback)
+      FailRealtimeAllocation(wxT("Allocation in the audio callback"));
+   if (auto p = malloc(size ? size : 1))
+      return p;
+   throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept
+{
+   if (p && sInRealtimeCallback)
+      FailRealtimeAllocation(wxT("Deallocation in the audio callback"));
+   free(p);
+}
+
+#define REALTIME_ALLOCATION_CHECK RealtimeAllocationCheck allocationCheck
+#else
+#define REALTIME_ALLOCATION_CHECK
+#endif
+
 RealtimeEffectManager & RealtimeEffectManager::Get()
 {
    static RealtimeEffectManager rem;
@@ -49,29 +103,52 @@ RealtimeEffectManager & RealtimeEffectManager::Get()
 }
 
 RealtimeEffectManager::RealtimeEffectManager()
+   : mpStates{ std::make_unique<const States>() }
 {
-   mRealtimeLock.Enter();
-   mRealtimeActive = false;
-   mRealtimeSuspended = true;
-   mRealtimeLatency = 0;
-   mRealtimeLock.Leave();
+   mpPublished.store(mpStates.get());
 }
 
 RealtimeEffectManager::~RealtimeEffectManager()
 {
 }
 
+void RealtimeEffectManager::Publish(States states)
+{
+   auto pOld = std::move(mpStates);
+   mpStates = std::make_unique<const States>(std::move(states));
+   mpPublished.store(mpStates.get());
+
+   // A cycle that began before the store may still be using the old list
+   Synchronize();
+
+   // pOld, and states removed from the chain with it, are destroyed here,
+   // not in the callback
+}
+
+void RealtimeEffectManager::Synchronize()
+{
+   // The sequentially consistent store of mpPublished or mRealtimeSuspended
+   // that precedes this, and the increment of mCycle at the start of a cycle,
+   // guarantee that either that cycle sees the store, or this sees the
+   // odd count and waits
+   const auto cycle = mCycle.load();
+   if (cycle & 1)
+      while (mCycle.load() == cycle)
+         std::this_thread::yield();
+}
+
 #if defined(EXPERIMENTAL_EFFECTS_RACK)
 void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
 {
    // Block RealtimeProcess()
    RealtimeSuspend();
 
-   decltype( mStates ) newStates;
-   auto begin = mStates.begin(), end = mStates.end();
+   States newStates;
+   auto oldStates = *mpStates;
+   auto begin = oldStates.begin(), end = oldStates.end();
    for ( auto pEffect : effects ) {
       auto found = std::find_if( begin, end,
-         [=]( const decltype( mStates )::value_type &state ){
+         [=]( const States::value_type &state ){
             return state && &state->GetEffect() == pEffect;
          }
       );
@@ -79,7 +156,7 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
          // Tell New effect to get ready
          pEffect->RealtimeInitialize();
          newStates.emplace_back(
-            std::make_unique< RealtimeEffectState >( *pEffect ) );
+            std::make_shared< RealtimeEffectState >( *pEffect ) );
       }
       else {
          // Preserve state for effect that remains in the chain
@@ -88,14 +165,13 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
    }
 
    // Remaining states that were not moved need to clean up
-   for ( auto &state : mStates ) {
+   for ( auto &state : oldStates ) {
       if ( state )
          state->GetEffect().RealtimeFinalize();
    }
 
-   // Get rid of the old chain
-   // And install the NEW one
-   mStates.swap( newStates );
+   // Install the NEW chain, and get rid of the old one
+   Publish( std::move( newStates ) );
 
    // Allow RealtimeProcess() to, well, process 
    RealtimeResume();
@@ -104,7 +180,7 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
 
 bool RealtimeEffectManager::RealtimeIsActive()
 {
-   return mStates.size() != 0;
+   return mpStates->size() != 0;
 }
 
 bool RealtimeEffectManager::RealtimeIsSuspended()
@@ -117,9 +193,8 @@ void RealtimeEffectManager::RealtimeAddEffect(EffectClientInterface *effect)
    // Block RealtimeProcess()
    RealtimeSuspend();
 
-   // Add to list of active effects
-   mStates.emplace_back( std::make_unique< RealtimeEffectState >( *effect ) );
-   auto &state = mStates.back();
+   // The callback does not see the new state until it is published
+   auto state = std::make_shared< RealtimeEffectState >( *effect );
 
    // Initialize effect if realtime is already active
    if (mRealtimeActive)
@@ -133,7 +208,11 @@ void RealtimeEffectManager::RealtimeAddEffect(EffectClientInterface *effect)
          state->RealtimeAddProcessor(i, mRealtimeChans[i], mRealtimeRates[i]);
       }
    }
-   
+
+   // Add to list of active effects
+   auto newStates = *mpStates;
+   newStates.push_back( std::move( state ) );
+   Publish( std::move( newStates ) );
 
    // Allow RealtimeProcess() to, well, process 
    RealtimeResume();
@@ -149,16 +228,19 @@ void RealtimeEffectManager::RealtimeRemoveEffect(EffectClientInterface *effect)
       // Cleanup realtime processing
       effect->RealtimeFinalize();
    }
-      
+
    // Remove from list of active effects
-   auto end = mStates.end();
-   auto found = std::find_if( mStates.begin(), end,
-      [&](const decltype(mStates)::value_type &state){
+   auto newStates = *mpStates;
+   auto end = newStates.end();
+   auto found = std::find_if( newStates.begin(), end,
+      [&](const States::value_type &state){
          return &state->GetEffect() == effect;
       }
    );
-   if (found != end)
-      mStates.erase(found);
+   if (found != end) {
+      newStates.erase(found);
+      Publish( std::move( newStates ) );
+   }
 
    // Allow RealtimeProcess() to, well, process 
    RealtimeResume();
@@ -178,7 +260,7 @@ void RealtimeEffectManager::RealtimeInitialize(double rate)
    mRealtimeActive = true;
 
    // Tell each effect to get ready for action
-   for (auto &state : mStates) {
+   for (auto &state : *mpStates) {
       state->GetEffect().SetSampleRate(rate);
       state->GetEffect().RealtimeInitialize();
    }
@@ -189,7 +271,8 @@ void RealtimeEffectManager::RealtimeInitialize(double rate)
 
 void RealtimeEffectManager::RealtimeAddProcessor(int group, unsigned chans, float rate)
 {
-   for (auto &state : mStates)
+   // The audio stream is not yet started, so the states may change in place
+   for (auto &state : *mpStates)
       state->RealtimeAddProcessor(group, chans, rate);
 
    mRealtimeChans.push_back(chans);
@@ -205,7 +288,7 @@ void RealtimeEffectManager::RealtimeFinalize()
    mRealtimeLatency = 0;
 
    // Tell each effect to clean up as well
-   for (auto &state : mStates)
+   for (auto &state : *mpStates)
       state->GetEffect().RealtimeFinalize();
 
    // Reset processor parameters
@@ -218,63 +301,56 @@ void RealtimeEffectManager::RealtimeFinalize()
 
 void RealtimeEffectManager::RealtimeSuspend()
 {
-   mRealtimeLock.Enter();
-
    // Already suspended...bail
    if (mRealtimeSuspended)
-   {
-      mRealtimeLock.Leave();
       return;
-   }
 
    // Show that we aren't going to be doing anything
    mRealtimeSuspended = true;
 
+   // Let a cycle that began before that finish
+   Synchronize();
+
    // And make sure the effects don't either
-   for (auto &state : mStates)
+   for (auto &state : *mpStates)
       state->RealtimeSuspend();
-
-   mRealtimeLock.Leave();
 }
 
 void RealtimeEffectManager::RealtimeSuspendOne( EffectClientInterface &effect )
 {
-   auto begin = mStates.begin(), end = mStates.end();
+   auto begin = mpStates->begin(), end = mpStates->end();
    auto found = std::find_if( begin, end,
-      [&effect]( const decltype( mStates )::value_type &state ){
+      [&effect]( const States::value_type &state ){
          return state && &state->GetEffect() == &effect;
       }
    );
-   if ( found != end )
-      (*found)->RealtimeSuspend();
+   if ( found != end ) {
+      // Stop the callback from processing the effect before suspending it
+      (*found)->PrepareSuspend();
+      Synchronize();
+      (*found)->FinishSuspend();
+   }
 }
 
 void RealtimeEffectManager::RealtimeResume()
 {
-   mRealtimeLock.Enter();
-
    // Already running...bail
    if (!mRealtimeSuspended)
-   {
-      mRealtimeLock.Leave();
       return;
-   }
 
    // Tell the effects to get ready for more action
-   for (auto &state : mStates)
+   for (auto &state : *mpStates)
       state->RealtimeResume();
 
    // And we should too
    mRealtimeSuspended = false;
-
-   mRealtimeLock.Leave();
 }
 
 void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
 {
-   auto begin = mStates.begin(), end = mStates.end();
+   auto begin = mpStates->begin(), end = mpStates->end();
    auto found = std::find_if( begin, end,
-      [&effect]( const decltype( mStates )::value_type &state ){
+      [&effect]( const States::value_type &state ){
          return state && &state->GetEffect() == &effect;
       }
    );
@@ -287,21 +363,31 @@ void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
 //
 void RealtimeEffectManager::RealtimeProcessStart()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   REALTIME_ALLOCATION_CHECK;
+
+   // Begin the cycle before looking at the chain, so that the main thread
+   // does not free what this sees until RealtimeProcessEnd
+   ++mCycle;
+   mpCycleStates = mpPublished.load();
 
    // Can be suspended because of the audio stream being paused or because effects
-   // have been suspended.
-   if (!mRealtimeSuspended)
+   // have been suspended.  Decide once for the whole cycle.
+   mCycleSuspended = mRealtimeSuspended.load();
+   mCycleBlockSize = 0;
+   if (!mCycleSuspended)
    {
-      for (auto &state : mStates)
+      for (auto &state : *mpCycleStates)
       {
+         // Effects such as VST plug-ins have buffers of this size
+         const auto blockSize = state->GetEffect().GetBlockSize();
+         if (blockSize > 0 &&
+             (mCycleBlockSize == 0 || blockSize < mCycleBlockSize))
+            mCycleBlockSize = blockSize;
+
          if (state->IsRealtimeActive())
             state->GetEffect().RealtimeProcessStart();
       }
    }
-
-   mRealtimeLock.Leave();
 }
 
 //
@@ -309,14 +395,12 @@ void RealtimeEffectManager::RealtimeProcessStart()
 //
 size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float **buffers, size_t numSamples)
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   REALTIME_ALLOCATION_CHECK;
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended, so allow the samples to pass as-is.
-   if (mRealtimeSuspended || mStates.empty())
+   if (mCycleSuspended || !mpCycleStates || mpCycleStates->empty())
    {
-      mRealtimeLock.Leave();
       return numSamples;
    }
 
@@ -339,7 +423,7 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
    // Now call each effect in the chain while swapping buffer pointers to feed the
    // output of one effect as the input to the next effect
    size_t called = 0;
-   for (auto &state : mStates)
+   for (auto &state : *mpCycleStates)
    {
       if (state->IsRealtimeActive())
       {
@@ -371,8 +455,6 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
    // Remember the latency
    mRealtimeLatency = (int) (wxGetUTCTimeMillis() - start).GetValue();
 
-   mRealtimeLock.Leave();
-
    //
    // This is wrong...needs to handle tails
    //
@@ -384,21 +466,25 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
 //
 void RealtimeEffectManager::RealtimeProcessEnd()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
-
-   // Can be suspended because of the audio stream being paused or because effects
-   // have been suspended.
-   if (!mRealtimeSuspended)
    {
-      for (auto &state : mStates)
+      REALTIME_ALLOCATION_CHECK;
+
+      // Can be suspended because of the audio stream being paused or because effects
+      // have been suspended.
+      if (!mCycleSuspended)
       {
-         if (state->IsRealtimeActive())
-            state->GetEffect().RealtimeProcessEnd();
+         for (auto &state : *mpCycleStates)
+         {
+            if (state->IsRealtimeActive())
+               state->GetEffect().RealtimeProcessEnd();
+         }
       }
    }
 
-   mRealtimeLock.Leave();
+   // End the cycle; the main thread may now free what this saw
+   mpCycleStates = nullptr;
+   mCycleSuspended = true;
+   ++mCycle;
 }
 
 int RealtimeEffectManager::GetRealtimeLatency()
@@ -420,6 +506,20 @@ bool RealtimeEffectState::RealtimeSuspend()
    return result;
 }
 
+void RealtimeEffectState::PrepareSuspend()
+{
+   mRealtimeSuspendCount++;
+}
+
+bool RealtimeEffectState::FinishSuspend()
+{
+   auto result = mEffect.RealtimeSuspend();
+   if ( !result ) {
+      mRealtimeSuspendCount--;
+   }
+   return result;
+}
+
 bool RealtimeEffectState::RealtimeResume()
 {
    auto result = mEffect.RealtimeResume();
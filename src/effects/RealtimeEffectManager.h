@@ -11,13 +11,39 @@
 #ifndef __AUDACITY_REALTIME_EFFECT_MANAGER__
 #define __AUDACITY_REALTIME_EFFECT_MANAGER__
 
+#include "../Experimental.h"
+
+#include <atomic>
 #include <memory>
 #include <vector>
-#include <wx/thread.h>
 
 class EffectClientInterface;
 class RealtimeEffectState;
 
+#if defined(EXPERIMENTAL_REALTIME_ALLOCATION_CHECK)
+//! While one exists, the thread fails an assertion when it allocates or
+//! frees memory; make one for the whole of the audio callback
+/*! These may nest */
+class AUDACITY_DLL_API RealtimeAllocationCheck
+{
+public:
+   RealtimeAllocationCheck();
+   ~RealtimeAllocationCheck();
+
+   RealtimeAllocationCheck( const RealtimeAllocationCheck& ) = delete;
+   RealtimeAllocationCheck &operator=( const RealtimeAllocationCheck& ) = delete;
+
+private:
+   bool mWasChecking;
+};
+#endif
+
+//! Manages the chain of realtime effects applied during playback
+/*! The chain is changed only in the main thread.  Each change publishes a new,
+    immutable list of states to the audio callback by an atomic swap of a
+    pointer, in the manner of read-copy-update.  The callback takes no locks
+    and allocates nothing; the main thread waits for any callback cycle that
+    may still see the old list, then frees it. */
 class AUDACITY_DLL_API RealtimeEffectManager final
 {
 public:
@@ -39,20 +65,46 @@ public:
    void RealtimeSuspendOne( EffectClientInterface &effect );
    void RealtimeResume();
    void RealtimeResumeOne( EffectClientInterface &effect );
+
+   // These are called in the audio callback, each cycle beginning with
+   // RealtimeProcessStart and ending with RealtimeProcessEnd
    void RealtimeProcessStart();
    size_t RealtimeProcess(int group, unsigned chans, float **buffers, size_t numSamples);
    void RealtimeProcessEnd();
+   //! Most samples that each call of RealtimeProcess may pass in this cycle,
+   //! the least of the block sizes of the effects; 0 for no limit
+   size_t GetRealtimeBlockSize() const { return mCycleBlockSize; }
+
    int GetRealtimeLatency();
 
 private:
+   using States = std::vector< std::shared_ptr<RealtimeEffectState> >;
+
    RealtimeEffectManager();
    ~RealtimeEffectManager();
 
-   wxCriticalSection mRealtimeLock;
-   std::vector< std::unique_ptr<RealtimeEffectState> > mStates;
-   int mRealtimeLatency;
-   bool mRealtimeSuspended;
-   bool mRealtimeActive;
+   //! Replace the chain seen by the callback, and free the old one when the
+   //! callback is done with it
+   void Publish(States states);
+   //! Wait until the end of any callback cycle in progress
+   void Synchronize();
+
+   // Owned and changed only by the main thread
+   std::unique_ptr<const States> mpStates;
+   // The same list, as the callback reads it
+   std::atomic<const States*> mpPublished{ nullptr };
+   // Odd while the callback is between RealtimeProcessStart and
+   // RealtimeProcessEnd
+   std::atomic<unsigned long> mCycle{ 0 };
+
+   // Used only in the callback, during one cycle
+   const States *mpCycleStates{};
+   bool mCycleSuspended{ true };
+   size_t mCycleBlockSize{ 0 };
+
+   std::atomic<int> mRealtimeLatency{ 0 };
+   std::atomic<bool> mRealtimeSuspended{ true };
+   bool mRealtimeActive{ false };
    std::vector<unsigned> mRealtimeChans;
    std::vector<double> mRealtimeRates;
 };
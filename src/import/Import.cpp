@@ -41,6 +41,11 @@ ImportLOF.cpp, and ImportAUP.cpp.
 #include "ImportPlugin.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 
 #include <wx/textctrl.h>
@@ -49,10 +54,14 @@ ImportLOF.cpp, and ImportAUP.cpp.
 #include <wx/listbox.h>
 #include <wx/log.h>
 #include <wx/sizer.h>         //for wxBoxSizer
+#include "../AudacityException.h"
 #include "../FFmpeg.h"
 #include "../FileNames.h"
 #include "../ShuttleGui.h"
 #include "../Project.h"
+#include "../ProjectSettings.h"
+#include "../SampleBlock.h"
+#include "../Tags.h"
 #include "../WaveTrack.h"
 
 #include "../Prefs.h"
@@ -453,46 +462,13 @@ std::unique_ptr<ExtImportItem> Importer::CreateDefaultImportItem()
    return new_item;
 }
 
-// returns number of tracks imported
-bool Importer::Import( AudacityProject &project,
-                     const FilePath &fName,
-                     WaveTrackFactory *trackFactory,
-                     TrackHolders &tracks,
-                     Tags *tags,
-                     TranslatableString &errorMessage)
+auto Importer::GetImportPlugins(const FilePath &fName) -> ImportPluginPtrs
 {
-   AudacityProject *pProj = &project;
-   auto cleanup = valueRestorer( pProj->mbBusyImporting, true );
-
    const FileExtension extension{ fName.AfterLast(wxT('.')) };
 
-   // Always refuse to import MIDI, even though the FFmpeg plugin pretends to know how (but makes very bad renderings)
-#ifdef USE_MIDI
-   // MIDI files must be imported, not opened
-   if (FileNames::IsMidi(fName)) {
-      errorMessage = XO(
-"\"%s\" \nis a MIDI file, not an audio file. \nAudacity cannot open this type of file for playing, but you can\nedit it by clicking File > Import > MIDI.")
-         .Format( fName );
-      return false;
-   }
-#endif
-
-   // Bug #2647: Peter has a Word 2000 .doc file that is recognized and imported by FFmpeg.
-   if (wxFileName(fName).GetExt() == wxT("doc")) {
-      errorMessage =
-         XO("\"%s\" \nis a not an audio file. \nAudacity cannot open this type of file.")
-         .Format( fName );
-      return false;
-   }
-
-   using ImportPluginPtrs = std::vector< ImportPlugin* >;
-
    // This list is used to call plugins in correct order
    ImportPluginPtrs importPlugins;
 
-   // This list is used to remember plugins that should have been compatible with the file.
-   ImportPluginPtrs compatiblePlugins;
-
    // Not implemented (yet?)
    wxString mime_type = wxT("*");
 
@@ -604,6 +580,47 @@ bool Importer::Import( AudacityProject &project,
       }
    }
 
+   return importPlugins;
+}
+
+// returns number of tracks imported
+bool Importer::Import( AudacityProject &project,
+                     const FilePath &fName,
+                     WaveTrackFactory *trackFactory,
+                     TrackHolders &tracks,
+                     Tags *tags,
+                     TranslatableString &errorMessage)
+{
+   AudacityProject *pProj = &project;
+   auto cleanup = valueRestorer( pProj->mbBusyImporting, true );
+
+   const FileExtension extension{ fName.AfterLast(wxT('.')) };
+
+   // Always refuse to import MIDI, even though the FFmpeg plugin pretends to know how (but makes very bad renderings)
+#ifdef USE_MIDI
+   // MIDI files must be imported, not opened
+   if (FileNames::IsMidi(fName)) {
+      errorMessage = XO(
+"\"%s\" \nis a MIDI file, not an audio file. \nAudacity cannot open this type of file for playing, but you can\nedit it by clicking File > Import > MIDI.")
+         .Format( fName );
+      return false;
+   }
+#endif
+
+   // Bug #2647: Peter has a Word 2000 .doc file that is recognized and imported by FFmpeg.
+   if (wxFileName(fName).GetExt() == wxT("doc")) {
+      errorMessage =
+         XO("\"%s\" \nis a not an audio file. \nAudacity cannot open this type of file.")
+         .Format( fName );
+      return false;
+   }
+
+   // This list is used to call plugins in correct order
+   const ImportPluginPtrs importPlugins = GetImportPlugins(fName);
+
+   // This list is used to remember plugins that should have been compatible with the file.
+   ImportPluginPtrs compatiblePlugins;
+
    // Try the import plugins, in the permuted sequences just determined
    for (const auto plugin : importPlugins)
    {
@@ -627,7 +644,15 @@ bool Importer::Import( AudacityProject &project,
          else
             inFile->SetStreamUsage(0,TRUE);
 
-         auto res = inFile->Import(trackFactory, tracks, tags);
+         auto res = [&]{
+            // LOF and AUP imports push undo states and autosave, which must
+            // not wait inside a batch; other formats only create blocks
+            Optional<SampleBlockBatch> pBatch;
+            if (!extension.IsSameAs(wxT("lof"), false) &&
+                !extension.IsSameAs(wxT("aup"), false))
+               pBatch.emplace(trackFactory->GetSampleBlockFactory());
+            return inFile->Import(trackFactory, tracks, tags);
+         }();
 
          if (res == ProgressResult::Success || res == ProgressResult::Stopped)
          {
@@ -830,6 +855,330 @@ bool Importer::Import( AudacityProject &project,
    return false;
 }
 
+//-------------------------------------------------------------------------
+// Parallel import of several files
+//-------------------------------------------------------------------------
+
+namespace {
+
+//! A file that a worker thread decodes, for Importer::ImportFiles()
+struct ParallelImportJob
+{
+   std::unique_ptr<ImportFileHandle> pHandle;
+   //! Makes tracks with defaults read on the main thread
+   std::unique_ptr<WaveTrackFactory> pTrackFactory;
+   std::shared_ptr<Tags> pTags;
+
+   //! Written by the worker for the progress dialog
+   std::atomic<double> fraction{ 0.0 };
+
+   // Written by the worker before done is set
+   TrackHolders tracks;
+   ProgressResult result{ ProgressResult::Cancelled };
+   std::exception_ptr pException;
+   //! Guarded by the mutex of ParallelImportState
+   bool done{ false };
+};
+
+//! What the workers and the main thread share in Importer::ImportFiles()
+struct ParallelImportState
+{
+   std::mutex mutex;
+   //! Signalled when a job is queued or when no more will be
+   std::condition_variable available;
+   //! Signalled when a job is done
+   std::condition_variable finished;
+   std::deque<ParallelImportJob*> queue;
+   bool probing{ true };
+
+   //! Success, until the user stops or cancels
+   std::atomic<ProgressResult> control{ ProgressResult::Success };
+};
+
+//! Passes the progress of a job to the main thread, and the user's
+//! commands back
+class ParallelImportProgress final : public ImportProgress
+{
+public:
+   ParallelImportProgress(ParallelImportJob &job, ParallelImportState &state)
+      : mJob{ job }, mState{ state }
+   {
+   }
+
+   ProgressResult Update(double current, double total) override
+   {
+      if (total > 0)
+         mJob.fraction = std::max(0.0, std::min(1.0, current / total));
+      return mState.control;
+   }
+
+private:
+   ParallelImportJob &mJob;
+   ParallelImportState &mState;
+};
+
+void ParallelImportThread(ParallelImportState &state)
+{
+   std::unique_lock<std::mutex> lock(state.mutex);
+   while (true)
+   {
+      state.available.wait(lock,
+         [&]{ return !state.queue.empty() || !state.probing; });
+      if (state.queue.empty())
+         return;
+
+      auto &job = *state.queue.front();
+      state.queue.pop_front();
+      lock.unlock();
+
+      // Jobs not yet begun when the user stops or cancels are skipped
+      if (state.control == ProgressResult::Success)
+      {
+         try {
+            // Within the batch that ImportFiles() began
+            job.result = job.pHandle->Import(
+               job.pTrackFactory.get(), job.tracks, job.pTags.get());
+         }
+         catch (...) {
+            // Reported on the main thread
+            job.pException = std::current_exception();
+            job.result = ProgressResult::Failed;
+         }
+      }
+
+      lock.lock();
+      job.done = true;
+      state.finished.notify_all();
+   }
+}
+
+}
+
+std::unique_ptr<ImportFileHandle> Importer::OpenForParallelImport(
+   AudacityProject &project, const FilePath &fName)
+{
+   // Files that Import() refuses or treats specially must go that way
+   const FileExtension extension{ fName.AfterLast(wxT('.')) };
+   if (extension.IsSameAs(wxT("lof"), false) ||
+       extension.IsSameAs(wxT("aup"), false) ||
+       extension.IsSameAs(wxT("aup3"), false) ||
+       extension.IsSameAs(wxT("doc"), false))
+      return nullptr;
+#ifdef USE_MIDI
+   if (FileNames::IsMidi(fName))
+      return nullptr;
+#endif
+
+   // Probe with the plugin that Import() would try first
+   for (const auto plugin : GetImportPlugins(fName))
+   {
+      auto inFile = plugin->Open(fName, &project);
+      if ( (inFile != NULL) && (inFile->GetStreamCount() > 0) )
+      {
+         // A choice of streams needs a dialog
+         if (!plugin->SupportsParallelImport() || inFile->GetStreamCount() > 1)
+            return nullptr;
+         inFile->SetStreamUsage(0, true);
+         return inFile;
+      }
+   }
+   return nullptr;
+}
+
+void Importer::ImportFiles( AudacityProject &project,
+                            const FilePaths &fileNames,
+                            const FileResultHandler &onResult,
+                            const SerialImportHandler &onSerial )
+{
+   auto busy = valueRestorer( project.mbBusyImporting, true );
+
+   const auto nFiles = fileNames.size();
+   if (nFiles == 0)
+      return;
+
+   // Files are opened a little ahead of the workers, not all at once, which
+   // might exhaust file handles
+   const auto nThreads = std::max<size_t>(1,
+      std::min<size_t>(nFiles, std::thread::hardware_concurrency()));
+   const size_t maxQueued = 2 * nThreads;
+
+   // The blocks of all files decoded by workers are stored in one batch,
+   // begun, flushed and ended on this thread, so that the workers never own
+   // savepoints of the shared connection.  It ends after the workers do.
+   Optional<SampleBlockBatch> pBatch;
+   pBatch.emplace(WaveTrackFactory::Get(project).GetSampleBlockFactory());
+
+   ParallelImportState state;
+   std::vector<std::thread> threads;
+   // Null for files to import with Import()
+   std::vector<std::unique_ptr<ParallelImportJob>> jobs(nFiles);
+   size_t nProbed = 0;
+
+   auto cleanup = finally([&]{
+      {
+         std::lock_guard<std::mutex> guard(state.mutex);
+         state.probing = false;
+         if (state.control == ProgressResult::Success)
+            // Leaving early because of an exception
+            state.control = ProgressResult::Cancelled;
+      }
+      state.available.notify_all();
+      for (auto &thread : threads)
+         thread.join();
+   });
+
+   const auto probe = [&]{
+      while (nProbed < nFiles)
+      {
+         {
+            std::lock_guard<std::mutex> guard(state.mutex);
+            if (state.queue.size() >= maxQueued)
+               return;
+         }
+
+         const auto &fileName = fileNames[nProbed];
+         if (auto pHandle = OpenForParallelImport(project, fileName))
+         {
+            auto &job = jobs[nProbed];
+            job = std::make_unique<ParallelImportJob>();
+            job->pHandle = std::move(pHandle);
+            job->pHandle->SetProgress(
+               std::make_unique<ParallelImportProgress>(*job, state));
+            // Preferences may be read only on this thread
+            job->pTrackFactory = std::make_unique<WaveTrackFactory>(
+               ProjectSettings::Get(project),
+               WaveTrackFactory::Get(project).GetSampleBlockFactory(),
+               WaveTrackFactory::ReadDefaults());
+            job->pTags = std::make_shared<Tags>();
+            job->pTags->Clear();
+
+            if (threads.empty())
+               for (size_t ii = 0; ii < nThreads; ++ii)
+                  threads.emplace_back(
+                     [&state]{ ParallelImportThread(state); });
+
+            {
+               std::lock_guard<std::mutex> guard(state.mutex);
+               state.queue.push_back(job.get());
+            }
+            state.available.notify_one();
+         }
+         ++nProbed;
+      }
+
+      {
+         std::lock_guard<std::mutex> guard(state.mutex);
+         state.probing = false;
+      }
+      state.available.notify_all();
+   };
+
+   // One dialog for the progress of all files decoded by workers
+   Optional<ProgressDialog> progress;
+   size_t nWaited = 0;
+   const auto getFraction = [&]{
+      double fraction = nWaited;
+      for (size_t ii = nWaited; ii < nProbed; ++ii)
+         if (jobs[ii])
+            fraction += jobs[ii]->fraction;
+      return fraction;
+   };
+
+   // First let the workers decode everything they can
+   for (; nWaited < nFiles; ++nWaited)
+   {
+      const auto &fileName = fileNames[nWaited];
+
+      // Files before this one are all done, so the workers' queue is short
+      // enough to probe this one
+      if (state.control == ProgressResult::Success)
+         probe();
+      else if (state.control == ProgressResult::Cancelled)
+         break;
+
+      auto &pJob = jobs[nWaited];
+      if (!pJob)
+         continue;
+
+      auto &job = *pJob;
+      while (true)
+      {
+         {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            if (state.finished.wait_for(lock, std::chrono::milliseconds(100),
+               [&]{ return job.done; }))
+               break;
+         }
+
+         // Store what the workers decoded meanwhile, so that the write-ahead
+         // log is checkpointed as the import goes
+         pBatch->Flush();
+
+         if (state.control == ProgressResult::Success)
+            probe();
+         if (!progress)
+            progress.emplace(XO("Importing Files"));
+         const auto result = progress->Update(
+            getFraction(), (double) nFiles,
+            Verbatim( wxFileName{ fileName }.GetFullName() ));
+         if (result != ProgressResult::Success &&
+             state.control == ProgressResult::Success)
+            state.control = result;
+      }
+
+      // Release the file
+      job.pHandle.reset();
+   }
+   progress.reset();
+
+   // Commit the blocks before adding tracks, which pushes undo states and
+   // autosaves in savepoints of its own
+   pBatch.reset();
+
+   if (state.control == ProgressResult::Cancelled)
+      return;
+
+   // Then deliver the files in order
+   for (size_t ii = 0; ii < nFiles; ++ii)
+   {
+      const auto &fileName = fileNames[ii];
+
+      auto &pJob = jobs[ii];
+      if (!pJob)
+      {
+         // After the user stops, deliver only the work already begun
+         if (state.control == ProgressResult::Success)
+            onSerial(fileName);
+         continue;
+      }
+
+      auto &job = *pJob;
+      if (job.pException)
+         GuardedCall( [&]{ std::rethrow_exception(job.pException); } );
+
+      FileResult result;
+      result.fileName = fileName;
+      const auto res = job.result;
+      if (res == ProgressResult::Success || res == ProgressResult::Stopped)
+      {
+         auto &tracks = job.tracks;
+         // importer shouldn't give us empty groups of channels!
+         tracks.erase( std::remove_if( tracks.begin(), tracks.end(),
+            std::mem_fn( &NewChannelGroup::empty ) ), tracks.end() );
+         result.tracks = std::move(tracks);
+         result.pTags = job.pTags;
+      }
+      pJob.reset();
+
+      if (!result.tracks.empty())
+         onResult(result);
+      else if (res == ProgressResult::Success)
+         // Let Import() try other importers, as it does after one that
+         // finds nothing
+         onSerial(fileName);
+   }
+}
+
 //-------------------------------------------------------------------------
 // ImportStreamDialog
 //-------------------------------------------------------------------------
@@ -13,6 +13,8 @@
 
 #include "ImportForwards.h"
 #include "audacity/Types.h"
+#include <functional>
+#include <memory>
 #include <vector>
 #include <wx/tokenzr.h> // for enum wxStringTokenizerMode
 
@@ -172,7 +174,39 @@ public:
               Tags *tags,
               TranslatableString &errorMessage);
 
+   //! Outcome of one of the files of ImportFiles()
+   struct FileResult
+   {
+      FilePath fileName;
+      TrackHolders tracks;
+      //! Tags read from the file, to merge into the project's
+      std::shared_ptr<Tags> pTags;
+   };
+   using FileResultHandler = std::function< void( FileResult & ) >;
+   using SerialImportHandler = std::function< void( const FilePath & ) >;
+
+   /**
+    * Import several files, decoding at once on worker threads those whose
+    * importers allow it, with one progress dialog for all of those.
+    * When decoding is done, on the main thread and in the order of the
+    * files, calls onResult for each file so decoded with success, and
+    * onSerial for each other file, which should be imported with Import().
+    * Calls back not at all if the user cancels.
+    */
+   void ImportFiles( AudacityProject &project,
+                     const FilePaths &fileNames,
+                     const FileResultHandler &onResult,
+                     const SerialImportHandler &onSerial );
+
 private:
+   //! Open a file that can be decoded on a worker thread, else return null
+   std::unique_ptr<ImportFileHandle> OpenForParallelImport(
+      AudacityProject &project, const FilePath &fName );
+
+   using ImportPluginPtrs = std::vector< ImportPlugin* >;
+   //! The plugins to try for a file, in order of preference
+   ImportPluginPtrs GetImportPlugins(const FilePath &fName);
+
    static Importer mInstance;
 
    ExtImportItems mExtImportItems;
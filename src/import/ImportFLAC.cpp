@@ -132,6 +132,8 @@ class FLACImportPlugin final : public ImportPlugin
    TranslatableString GetPluginFormatDescription() override;
    std::unique_ptr<ImportFileHandle> Open(
       const FilePath &Filename, AudacityProject*)  override;
+
+   bool SupportsParallelImport() const override { return true; }
 };
 
 
@@ -92,6 +92,8 @@ public:
    TranslatableString GetPluginFormatDescription() override;
    std::unique_ptr<ImportFileHandle> Open(
       const FilePath &Filename, AudacityProject*) override;
+
+   bool SupportsParallelImport() const override { return true; }
 };
 
 
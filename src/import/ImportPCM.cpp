@@ -80,6 +80,8 @@ public:
    TranslatableString GetPluginFormatDescription() override;
    std::unique_ptr<ImportFileHandle> Open(
       const FilePath &Filename, AudacityProject*) override;
+
+   bool SupportsParallelImport() const override { return true; }
 };
 
 
@@ -325,10 +327,18 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
       if (maxBlock < 1)
          return ProgressResult::Failed;
 
-      SampleBuffer srcbuffer, buffer;
+      // 24 bit int is read as float, and the append function converts it.
+      // This is how PCMAliasBlockFile worked too.
+      const auto readFormat =
+         (mFormat == int16Sample) ? int16Sample : floatSample;
+
+      // Reads of whole blocks let the tracks take a mono file's samples
+      // without copying them through their append buffers, and take each
+      // channel of an interleaved file with only the one copy that
+      // de-interleaves it
+      SampleBuffer srcbuffer;
       wxASSERT(mInfo.channels >= 0);
-      while (NULL == srcbuffer.Allocate(maxBlock * mInfo.channels, mFormat).ptr() ||
-             NULL == buffer.Allocate(maxBlock, mFormat).ptr())
+      while (NULL == srcbuffer.Allocate(maxBlock * mInfo.channels, readFormat).ptr())
       {
          maxBlock /= 2;
          if (maxBlock < 1)
@@ -341,9 +351,8 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
       do {
          block = maxBlock;
 
-         if (mFormat == int16Sample)
+         if (readFormat == int16Sample)
             block = SFCall<sf_count_t>(sf_readf_short, mFile.get(), (short *)srcbuffer.ptr(), block);
-         //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile worked too.
          else
             block = SFCall<sf_count_t>(sf_readf_float, mFile.get(), (float *)srcbuffer.ptr(), block);
 
@@ -354,20 +363,10 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
 
          if (block) {
             auto iter = channels.begin();
-            for(int c=0; c<mInfo.channels; ++iter, ++c) {
-               if (mFormat==int16Sample) {
-                  for(int j=0; j<block; j++)
-                     ((short *)buffer.ptr())[j] =
-                        ((short *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-               else {
-                  for(int j=0; j<block; j++)
-                     ((float *)buffer.ptr())[j] =
-                        ((float *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-
-               iter->get()->Append(buffer.ptr(), (mFormat == int16Sample)?int16Sample:floatSample, block);
-            }
+            for(int c=0; c<mInfo.channels; ++iter, ++c)
+               iter->get()->Append(
+                  srcbuffer.ptr() + c * SAMPLE_SIZE(readFormat),
+                  readFormat, block, mInfo.channels);
             framescompleted += block;
          }
 
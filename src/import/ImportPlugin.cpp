@@ -15,6 +15,29 @@ Paul Licameli split from Import.cpp
 #include "../widgets/ProgressDialog.h"
 #include "../prefs/QualityPrefs.h"
 
+ImportProgress::~ImportProgress() = default;
+
+namespace {
+//! Reports progress of an import on the main thread to a dialog
+class DialogImportProgress final : public ImportProgress
+{
+public:
+   DialogImportProgress(
+      const TranslatableString &title, const TranslatableString &message)
+      : mDialog{ title, message }
+   {
+   }
+
+   ProgressResult Update(double current, double total) override
+   {
+      return mDialog.Update(current, total);
+   }
+
+private:
+   ProgressDialog mDialog;
+};
+}
+
 ImportFileHandle::ImportFileHandle(const FilePath & filename)
 :  mFilename(filename)
 {
@@ -26,18 +49,30 @@ ImportFileHandle::~ImportFileHandle()
 
 void ImportFileHandle::CreateProgress()
 {
+   if (mProgress)
+      return;
+
    wxFileName ff( mFilename );
 
    auto title = XO("Importing %s").Format( GetFileDescription() );
-   mProgress = std::make_unique< ProgressDialog >(
+   mProgress = std::make_unique< DialogImportProgress >(
       title, Verbatim( ff.GetFullName() ) );
 }
 
+void ImportFileHandle::SetProgress(std::unique_ptr<ImportProgress> pProgress)
+{
+   mProgress = std::move(pProgress);
+}
+
 sampleFormat ImportFileHandle::ChooseFormat(sampleFormat effectiveFormat)
 {
    // Consult user preference
-   auto defaultFormat = QualityPrefs::SampleFormatChoice();
+   return ChooseFormat(effectiveFormat, QualityPrefs::SampleFormatChoice());
+}
 
+sampleFormat ImportFileHandle::ChooseFormat(
+   sampleFormat effectiveFormat, sampleFormat defaultFormat)
+{
    // Don't choose format narrower than effective or default
    auto format = std::max(effectiveFormat, defaultFormat);
 
@@ -51,5 +86,7 @@ sampleFormat ImportFileHandle::ChooseFormat(sampleFormat effectiveFormat)
 std::shared_ptr<WaveTrack> ImportFileHandle::NewWaveTrack(
    WaveTrackFactory &trackFactory, sampleFormat effectiveFormat, double rate)
 {
-   return trackFactory.NewWaveTrack(ChooseFormat(effectiveFormat), rate);
+   // The factory's defaults may have been read in advance, for a worker thread
+   return trackFactory.NewWaveTrack(
+      ChooseFormat(effectiveFormat, trackFactory.GetDefaults().format), rate);
 }
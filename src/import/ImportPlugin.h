@@ -94,6 +94,11 @@ public:
    virtual std::unique_ptr<ImportFileHandle> Open(
       const FilePath &Filename, AudacityProject*) = 0;
 
+   // Whether handles may import on a worker thread, concurrently with
+   // other imports.  Then ImportFileHandle::Import must not use the GUI or
+   // preferences, and must make tracks only with the given factory.
+   virtual bool SupportsParallelImport() const { return false; }
+
    virtual ~ImportPlugin() { }
 
 protected:
@@ -110,6 +115,15 @@ protected:
 class WaveTrack;
 using TrackHolders = std::vector< std::vector< std::shared_ptr<WaveTrack> > >;
 
+//! Receives the progress of an import, and says whether to go on
+class ImportProgress /* not final */
+{
+public:
+   virtual ~ImportProgress();
+
+   virtual ProgressResult Update(double current, double total) = 0;
+};
+
 class ImportFileHandle /* not final */
 {
 public:
@@ -118,9 +132,14 @@ public:
    virtual ~ImportFileHandle();
 
    // The importer should call this to create the progress dialog and
-   // identify the filename being imported.
+   // identify the filename being imported.  It does nothing if
+   // SetProgress() was called.
    void CreateProgress();
 
+   // Report progress to the given object instead of to a dialog, as when
+   // importing on a worker thread
+   void SetProgress(std::unique_ptr<ImportProgress> pProgress);
+
    // This is similar to GetPluginFormatDescription, but if possible the
    // importer will return a more specific description of the
    // specific file that is open.
@@ -154,6 +173,9 @@ public:
 
    //! Choose appropriate format, which will not be narrower than the specified one
    static sampleFormat ChooseFormat(sampleFormat effectiveFormat);
+   //! Choose as above, given the format that preferences choose
+   static sampleFormat ChooseFormat(
+      sampleFormat effectiveFormat, sampleFormat defaultFormat);
 
    //! Build a wave track with appropriate format, which will not be narrower than the specified one
    std::shared_ptr<WaveTrack> NewWaveTrack( WaveTrackFactory &trackFactory,
@@ -161,7 +183,7 @@ public:
 
 protected:
    FilePath mFilename;
-   std::unique_ptr<ProgressDialog> mProgress;
+   std::unique_ptr<ImportProgress> mProgress;
 };
 
 
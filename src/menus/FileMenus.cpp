@@ -149,10 +149,11 @@ void DoImport(const CommandContext &context, bool isRaw)
                .AddImportedTracks(fileName, std::move(newTracks));
          }
       }
-      else {
-         ProjectFileManager::Get( project ).Import(fileName);
-      }
    }
+
+   if (!isRaw)
+      ProjectFileManager::Get( project ).ImportFiles(
+         FilePaths{ selectedFiles.begin(), selectedFiles.end() });
 }
 
 }
@@ -0,0 +1,122 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  MixKernelsTest.cpp
+
+  Checks each kernel of MixKernels against the scalar one
+
+**********************************************************************/
+
+#include "MixKernels.h"
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Samples past the end of the destination, which no kernel may change
+enum : size_t { Guard = 16 };
+
+std::vector<float> MakeSamples(size_t len, unsigned seed)
+{
+   std::mt19937 generator{ seed };
+   std::uniform_real_distribution<float> sample{ -1.5f, 1.5f };
+   std::vector<float> samples(len);
+   for (auto &value : samples)
+      value = sample(generator);
+   return samples;
+}
+
+//! An operation on a destination of len samples of each of stride channels
+using Operation =
+   std::function< void( float *dst, const float *src, size_t stride,
+      size_t len ) >;
+
+//! Apply the operation with the scalar kernel and with the kernel to
+//! destinations of the same samples, which then must be identical
+bool Agree(const char *name, MixKernels::Kernel kernel,
+   const Operation &operation, bool strided)
+{
+   const size_t lengths[] = { 0, 1, 3, 7, 8, 9, 17, 64, 513, 4099 };
+   bool ok = true;
+   for (size_t stride = 1; stride <= (strided ? 3 : 1); ++stride)
+      for (auto len : lengths) {
+         const auto src = MakeSamples(len * stride, 1);
+         const auto dst = MakeSamples(len * stride + Guard, 2);
+
+         auto expected = dst;
+         MixKernels::SetKernel(MixKernels::Scalar);
+         operation(expected.data(), src.data(), stride, len);
+
+         auto result = dst;
+         MixKernels::SetKernel(kernel);
+         operation(result.data(), src.data(), stride, len);
+
+         if (memcmp(expected.data(), result.data(),
+               expected.size() * sizeof(float))) {
+            std::cout << "Kernel " << MixKernels::GetName(kernel)
+               << " disagrees with the scalar kernel in " << name
+               << " of " << len << " samples with stride " << stride << "\n";
+            ok = false;
+         }
+      }
+   return ok;
+}
+
+bool TestKernel(MixKernels::Kernel kernel)
+{
+   bool ok = true;
+   ok = Agree("Scale", kernel,
+      [](float *dst, const float *, size_t, size_t len){
+         MixKernels::Scale(dst, len, 0.7f); }, false) && ok;
+   ok = Agree("Multiply", kernel,
+      [](float *dst, const float *src, size_t, size_t len){
+         MixKernels::Multiply(dst, src, len); }, false) && ok;
+   ok = Agree("ScaleAccumulate", kernel,
+      [](float *dst, const float *src, size_t stride, size_t len){
+         MixKernels::ScaleAccumulate(dst, stride, src, len, 0.3f); },
+      true) && ok;
+   ok = Agree("RampAccumulate", kernel,
+      [](float *dst, const float *src, size_t stride, size_t len){
+         MixKernels::RampAccumulate(dst, stride, src, len, 0.4f,
+            len ? 0.5f / len : 0); },
+      true) && ok;
+   ok = Agree("Interleave", kernel,
+      [](float *dst, const float *src, size_t stride, size_t len){
+         MixKernels::Interleave(dst, stride, src, len); }, true) && ok;
+   ok = Agree("Deinterleave", kernel,
+      [](float *dst, const float *src, size_t stride, size_t len){
+         MixKernels::Deinterleave(dst, src, stride, len); },
+      true) && ok;
+   ok = Agree("Clamp", kernel,
+      [](float *dst, const float *, size_t, size_t len){
+         if (len > 2)
+            dst[len / 2] = std::numeric_limits<float>::quiet_NaN();
+         MixKernels::Clamp(dst, len); }, false) && ok;
+   return ok;
+}
+
+}
+
+int main()
+{
+   std::cout << "==> Testing MixKernels\n";
+   const auto original = MixKernels::GetKernel();
+   bool ok = true;
+   for (int k = 0; k < MixKernels::nKernels; ++k) {
+      const auto kernel = static_cast<MixKernels::Kernel>(k);
+      if (!MixKernels::IsAvailable(kernel)) {
+         std::cout << "Kernel " << MixKernels::GetName(kernel)
+            << " is not available\n";
+         continue;
+      }
+      ok = TestKernel(kernel) && ok;
+   }
+   MixKernels::SetKernel(original);
+   return ok ? 0 : 1;
+}
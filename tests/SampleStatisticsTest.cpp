@@ -0,0 +1,143 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  SampleStatisticsTest.cpp
+
+  Checks each kernel of SampleStatistics against the scalar one
+
+**********************************************************************/
+
+#include "SampleStatistics.h"
+
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Results
+{
+   float min{ FLT_MAX }, max{ -FLT_MAX };
+   double sumsq{ 0 };
+};
+
+struct Data
+{
+   std::vector<float> floats;
+   std::vector<short> shorts;
+};
+
+Data MakeData(size_t len)
+{
+   std::mt19937 generator{ 234657 };
+   std::uniform_int_distribution<int> sample{ -32768, 32767 };
+   std::uniform_int_distribution<int> noise{ 0, 999 };
+   Data data;
+   for (size_t ii = 0; ii < len; ++ii) {
+      const auto value = (short)sample(generator);
+      data.shorts.push_back(value);
+      data.floats.push_back(value / 32768.0f + noise(generator) / 1e7f);
+   }
+   return data;
+}
+
+// Float samples, int16 samples, and the floats taken as summary frames
+std::vector<Results> Accumulate(const Data &data, size_t offset, size_t count)
+{
+   std::vector<Results> results(3);
+   SampleStatistics::Accumulate(data.floats.data() + offset, count,
+      results[0].min, results[0].max, results[0].sumsq);
+   SampleStatistics::Accumulate(data.shorts.data() + offset, count,
+      results[1].min, results[1].max, results[1].sumsq);
+   SampleStatistics::AccumulateFrames(data.floats.data() + offset, count / 3,
+      results[2].min, results[2].max, results[2].sumsq);
+   return results;
+}
+
+bool Agree(const Results &result, const Results &expected)
+{
+   // Extremes are exact; sums of squares may differ by rounding
+   return result.min == expected.min && result.max == expected.max &&
+      std::fabs(result.sumsq - expected.sumsq) <=
+         1e-5 * std::max(1.0, expected.sumsq);
+}
+
+bool TestKernels()
+{
+   const size_t len = 1 << 20;
+   const auto data = MakeData(len);
+
+   // Odd offsets and lengths exercise the unaligned ends
+   const size_t checks[][2] = {
+      { 0, len }, { 1, 1000 }, { 3, 17 }, { 5, 2 }, { 7, 4099 }, { 9, 0 } };
+
+   SampleStatistics::SetKernel(SampleStatistics::Scalar);
+   std::vector<std::vector<Results>> expected;
+   for (const auto &check : checks)
+      expected.push_back(Accumulate(data, check[0], check[1]));
+
+   bool ok = true;
+   for (int k = 0; k < SampleStatistics::nKernels; ++k) {
+      const auto kernel = static_cast<SampleStatistics::Kernel>(k);
+      if (!SampleStatistics::IsAvailable(kernel)) {
+         std::cout << "Kernel " << SampleStatistics::GetName(kernel)
+            << " is not available\n";
+         continue;
+      }
+      SampleStatistics::SetKernel(kernel);
+      for (size_t c = 0; c < expected.size(); ++c) {
+         const auto results = Accumulate(data, checks[c][0], checks[c][1]);
+         for (size_t r = 0; r < results.size(); ++r)
+            if (!Agree(results[r], expected[c][r])) {
+               std::cout << "Kernel " << SampleStatistics::GetName(kernel)
+                  << " disagrees with the scalar kernel for "
+                  << checks[c][1] << " samples at " << checks[c][0] << "\n";
+               ok = false;
+            }
+      }
+   }
+   return ok;
+}
+
+bool TestNaNs()
+{
+   // Every kernel ignores NaNs, as comparisons of one sample at a time do
+   std::vector<float> samples(37, 0.25f);
+   samples[0] = samples[17] = samples[36] =
+      std::numeric_limits<float>::quiet_NaN();
+   samples[5] = -0.5f;
+   samples[30] = 0.75f;
+
+   bool ok = true;
+   for (int k = 0; k < SampleStatistics::nKernels; ++k) {
+      const auto kernel = static_cast<SampleStatistics::Kernel>(k);
+      if (!SampleStatistics::IsAvailable(kernel))
+         continue;
+      SampleStatistics::SetKernel(kernel);
+      Results results;
+      SampleStatistics::Accumulate(samples.data(), samples.size(),
+         results.min, results.max, results.sumsq);
+      if (results.min != -0.5f || results.max != 0.75f) {
+         std::cout << "Kernel " << SampleStatistics::GetName(kernel)
+            << " does not ignore NaNs\n";
+         ok = false;
+      }
+   }
+   return ok;
+}
+
+}
+
+int main()
+{
+   std::cout << "==> Testing SampleStatistics\n";
+   const auto original = SampleStatistics::GetKernel();
+   bool ok = TestKernels();
+   ok = TestNaNs() && ok;
+   SampleStatistics::SetKernel(original);
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  SqliteBlobCacheTest.cpp
+
+  Checks that a reader thread with a cached blob handle sees the blocks
+  and summaries committed by another connection, as DBConnection reads
+  them on the threads' read-only connections
+
+**********************************************************************/
+
+#include "SqliteBlobCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sqlite3.h>
+
+namespace {
+
+const char *const FileName = "SqliteBlobCacheTest.aup3";
+
+void RemoveFiles()
+{
+   for (auto suffix : { "", "-wal", "-shm" })
+      std::remove((std::string{ FileName } + suffix).c_str());
+}
+
+bool Exec(sqlite3 *db, const char *sql)
+{
+   if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) == SQLITE_OK)
+      return true;
+   std::cout << sql << ": " << sqlite3_errmsg(db) << "\n";
+   return false;
+}
+
+//! Run on another thread and wait for it, as a reader thread would
+void OnReaderThread(const std::function< void() > &work)
+{
+   std::thread{ work }.join();
+}
+
+//! Read the summary of a block as GetSummary256 does, with a statement
+std::string ReadSummary(sqlite3 *db, long long blockid)
+{
+   sqlite3_stmt *stmt = nullptr;
+   std::string result;
+   if (sqlite3_prepare_v2(db,
+         "SELECT summary256 FROM sampleblocks WHERE blockid = ?1;",
+         -1, &stmt, nullptr) == SQLITE_OK &&
+       sqlite3_bind_int64(stmt, 1, blockid) == SQLITE_OK &&
+       sqlite3_step(stmt) == SQLITE_ROW)
+      result.assign(
+         static_cast<const char *>(sqlite3_column_blob(stmt, 0)),
+         sqlite3_column_bytes(stmt, 0));
+   sqlite3_finalize(stmt);
+   return result;
+}
+
+std::string ReadSamples(SqliteBlobCache &cache, sqlite3 *db, long long blockid)
+{
+   char buffer[16];
+   size_t bytes = sizeof buffer;
+   if (cache.Read(0, db, "sampleblocks", "samples", blockid, buffer, 0, bytes)
+       != SQLITE_OK)
+      return {};
+   return std::string(buffer, bytes);
+}
+
+bool TestReaderSeesCommits()
+{
+   sqlite3 *writer = nullptr, *reader = nullptr;
+   const auto cleanup = [&]{
+      sqlite3_close(reader);
+      sqlite3_close(writer);
+   };
+
+   if (sqlite3_open(FileName, &writer) != SQLITE_OK ||
+       !Exec(writer, "PRAGMA journal_mode = WAL;") ||
+       !Exec(writer,
+          "CREATE TABLE sampleblocks"
+          " (blockid INTEGER PRIMARY KEY, samples BLOB, summary256 BLOB);"
+          "INSERT INTO sampleblocks VALUES (1, 'samples1', 'summary1');") ||
+       sqlite3_open_v2(FileName, &reader, SQLITE_OPEN_READONLY, nullptr)
+          != SQLITE_OK) {
+      cleanup();
+      return false;
+   }
+
+   SqliteBlobCache cache;
+   bool ok = true;
+   const auto check = [&](bool condition, const char *what) {
+      if (!condition) {
+         std::cout << what << "\n";
+         ok = false;
+      }
+   };
+
+   // Leaves the reader thread's handle open on the first block
+   OnReaderThread([&]{
+      check(ReadSamples(cache, reader, 1) == "samples1",
+         "The reader could not read the first block");
+   });
+
+   check(Exec(writer,
+      "INSERT INTO sampleblocks VALUES (2, 'samples2', 'summary2');"),
+      "The writer could not commit the second block");
+
+   OnReaderThread([&]{
+      // The stale handle is replaced for a row committed since it opened
+      check(ReadSamples(cache, reader, 2) == "samples2",
+         "The reader could not read the samples of a new block");
+   });
+
+   check(Exec(writer,
+      "INSERT INTO sampleblocks VALUES (3, 'samples3', 'summary3');"),
+      "The writer could not commit the third block");
+
+   OnReaderThread([&]{
+      // As DBConnection does before preparing statements on the thread's
+      // read-only connection
+      cache.CloseForThread(reader);
+      check(ReadSummary(reader, 3) == "summary3",
+         "The reader could not read the summary of a new block");
+      check(ReadSamples(cache, reader, 3) == "samples3",
+         "The reader could not read the samples of a new block");
+   });
+
+   cache.Clear();
+   cleanup();
+   return ok;
+}
+
+}
+
+int main()
+{
+   std::cout << "==> Testing SqliteBlobCache\n";
+   RemoveFiles();
+   const bool ok = TestReaderSeesCommits();
+   RemoveFiles();
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  TaskPoolTest.cpp
+
+  Checks that TaskPool runs each task of a batch once, on any number of
+  threads, and passes exceptions to the caller
+
+**********************************************************************/
+
+#include "TaskPool.h"
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+bool TestEachTaskOnce(TaskPool &pool)
+{
+   bool ok = true;
+   for (size_t nTasks : { 0, 1, 2, 7, 1000 }) {
+      // Repeated batches reuse the threads
+      for (int batch = 0; batch < 20; ++batch) {
+         std::unique_ptr<std::atomic<int>[]> counts{
+            new std::atomic<int>[nTasks] };
+         for (size_t ii = 0; ii < nTasks; ++ii)
+            counts[ii] = 0;
+         pool.Run(nTasks, [&](size_t ii){ ++counts[ii]; });
+         for (size_t ii = 0; ii < nTasks; ++ii)
+            if (counts[ii] != 1) {
+               std::cout << "With " << pool.GetThreadCount()
+                  << " threads, task " << ii << " of " << nTasks
+                  << " ran " << counts[ii] << " times\n";
+               ok = false;
+               break;
+            }
+      }
+   }
+   return ok;
+}
+
+bool TestException(TaskPool &pool)
+{
+   const size_t nTasks = 100;
+   std::atomic<size_t> ran{ 0 };
+   bool thrown = false;
+   try {
+      pool.Run(nTasks, [&](size_t ii){
+         ++ran;
+         if (ii % 10 == 3)
+            throw std::runtime_error{ "task failed" };
+      });
+   }
+   catch (const std::runtime_error &) {
+      thrown = true;
+   }
+   if (!thrown || ran != nTasks) {
+      std::cout << "With " << pool.GetThreadCount()
+         << " threads, exceptions of tasks were not passed on after "
+            "all tasks ran\n";
+      return false;
+   }
+
+   // The pool is still usable
+   std::atomic<size_t> after{ 0 };
+   pool.Run(nTasks, [&](size_t){ ++after; });
+   if (after != nTasks) {
+      std::cout << "With " << pool.GetThreadCount()
+         << " threads, the pool failed after an exception\n";
+      return false;
+   }
+   return true;
+}
+
+}
+
+int main()
+{
+   std::cout << "==> Testing TaskPool\n";
+   bool ok = true;
+   for (size_t nThreads : { 0, 1, 3 }) {
+      TaskPool pool{ nThreads };
+      ok = TestEachTaskOnce(pool) && ok;
+      ok = TestException(pool) && ok;
+   }
+   return ok ? 0 : 1;
+}